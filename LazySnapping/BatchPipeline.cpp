@@ -0,0 +1,389 @@
+#include "BatchPipeline.h"
+#include "WatershedHelper.h"
+#include "LazySnapping.h"
+#include "SnappingModel.h"
+#include "SessionRecorder.h"
+#include "SessionReplay.h"
+#include "MaskEncoding.h"
+#include "Trace.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+/// <summary>
+/// One session on its way through the pipeline. Every stage releases what the next ones do not need.
+/// </summary>
+struct BatchItem
+{
+	string SessionPath;
+	vector<SessionEvent> Events;
+	Mat Image;
+	shared_ptr<const SnappingModel> Model;
+	Mat Segmentation;
+	vector<uchar> NodeLabels;
+};
+
+/// <summary>
+/// Blocking first in first out queue with a fixed capacity.
+/// </summary>
+template<typename T> class BoundedQueue
+{
+public:
+	BoundedQueue(size_t capacity) : m_capacity(capacity), m_closed(false) {}
+
+	/// <summary>
+	/// Add an item, waiting while the queue is full.
+	/// </summary>
+	void Push(T item)
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this]() { return m_items.size() < m_capacity; });
+		m_items.push_back(move(item));
+		m_notEmpty.notify_one();
+	}
+
+	/// <summary>
+	/// Take the oldest item, waiting while the queue is empty.
+	/// </summary>
+	/// <returns>False if the queue is closed and empty.</returns>
+	bool Pop(T& item)
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this]() { return !m_items.empty() || m_closed; });
+		if (m_items.empty())
+			return false;
+		item = move(m_items.front());
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	/// <summary>
+	/// Mark the end of the input. Waiting consumers return once the queue is drained.
+	/// </summary>
+	void Close()
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_closed = true;
+		m_notEmpty.notify_all();
+	}
+
+private:
+	mutex m_mutex;
+	condition_variable m_notFull;
+	condition_variable m_notEmpty;
+	deque<T> m_items;
+	size_t m_capacity;
+	bool m_closed;
+};
+
+typedef BoundedQueue<unique_ptr<BatchItem>> BatchQueue;
+
+static mutex outputMutex;
+
+static void printSkip(const string& path, const string& reason)
+{
+	lock_guard<mutex> lock(outputMutex);
+	cout << "Skip " << path << ", " << reason << endl;
+}
+
+/// <summary>
+/// Check whether the result of a session depends on its intermediate results, not only on its final marks and parameters.
+/// </summary>
+static bool dependsOnHistory(const vector<SessionEvent>& events)
+{
+	for each(auto& event in events)
+	{
+		if (event.EventType == SessionEvent::Type::Undo || event.EventType == SessionEvent::Type::Redo
+			|| event.EventType == SessionEvent::Type::Parametric || event.EventType == SessionEvent::Type::Resume)
+			return true;
+	}
+	return false;
+}
+
+/// <summary>
+/// Run one thread of a stage until its input is drained.
+/// </summary>
+/// <param name="input">The input queue.</param>
+/// <param name="output">The output queue, null for the last stage.</param>
+/// <param name="work">Process one item. Returns false to drop the item.</param>
+/// <param name="report">The stage report the thread times are added to.</param>
+/// <param name="reportMutex">The mutex guarding the reports.</param>
+static void runStage(BatchQueue* input, BatchQueue* output, const function<bool(BatchItem&)>& work, BatchStageReport* report, mutex* reportMutex)
+{
+	double tickToMs = 1000.0 / getTickFrequency();
+	double busy = 0, starved = 0, blocked = 0;
+	int items = 0;
+	while (true)
+	{
+		unique_ptr<BatchItem> item;
+		int64 start = getTickCount();
+		bool ok = input->Pop(item);
+		int64 popped = getTickCount();
+		starved += (popped - start) * tickToMs;
+		if (!ok)
+			break;
+
+		bool keep = false;
+		try
+		{
+			keep = work(*item);
+		}
+		catch (const exception* e)
+		{
+			printSkip(item->SessionPath, e->what());
+			delete e;
+		}
+		catch (const exception& e)
+		{
+			printSkip(item->SessionPath, e.what());
+		}
+		int64 done = getTickCount();
+		busy += (done - popped) * tickToMs;
+		items++;
+
+		if (keep && output)
+		{
+			output->Push(move(item));
+			blocked += (getTickCount() - done) * tickToMs;
+		}
+	}
+
+	lock_guard<mutex> lock(*reportMutex);
+	report->Items += items;
+	report->BusyMs += busy;
+	report->StarvedMs += starved;
+	report->BlockedMs += blocked;
+}
+
+BatchPipeline::BatchPipeline(const BatchOptions& options /* = BatchOptions() */)
+	: m_options(options), m_wallMs(0)
+{
+	if (m_options.DecodeThreads < 1 || m_options.SuperpixelThreads < 1 || m_options.SolveThreads < 1 || m_options.WriteThreads < 1)
+		throw new exception("Every stage needs at least one thread.");
+	if (m_options.QueueCapacity < 1)
+		throw new exception("Queue capacity must be positive.");
+#ifdef _WIN32
+	_mkdir(m_options.OutputDirectory.c_str());
+#else
+	mkdir(m_options.OutputDirectory.c_str(), 0755);
+#endif
+}
+
+BatchPipeline::~BatchPipeline()
+{
+}
+
+int BatchPipeline::Run(const vector<string>& sessionPaths)
+{
+	// The session list is the input of the first stage.
+	BatchQueue paths(max(sessionPaths.size(), static_cast<size_t>(1)));
+	for each(auto& path in sessionPaths)
+	{
+		unique_ptr<BatchItem> item(new BatchItem());
+		item->SessionPath = path;
+		paths.Push(move(item));
+	}
+	paths.Close();
+
+	BatchQueue decoded(m_options.QueueCapacity);
+	BatchQueue superpixels(m_options.QueueCapacity);
+	BatchQueue solved(m_options.QueueCapacity);
+	atomic<int> written(0);
+	string outputDirectory = m_options.OutputDirectory;
+
+	auto decode = [](BatchItem& item)
+	{
+		TRACE_SCOPE("batch decode");
+		string imagePath;
+		if (!SessionRecorder::Load(item.SessionPath, imagePath, item.Events))
+		{
+			printSkip(item.SessionPath, "cannot read the session");
+			return false;
+		}
+		item.Image = imread(imagePath);
+		if (item.Image.empty() || item.Image.type() != CV_8UC3)
+		{
+			printSkip(item.SessionPath, "cannot read " + imagePath);
+			return false;
+		}
+		return true;
+	};
+	auto superpixel = [](BatchItem& item)
+	{
+		TRACE_SCOPE("batch superpixel");
+		WatershedHelper watershedHelper(item.Image, 10, 10, 2, 2);
+		watershedHelper.Process();
+		item.Model = make_shared<SnappingModel>(make_shared<TiledLabelMap>(make_shared<TiledImage>(watershedHelper.GetMask())), watershedHelper.GetColors(), watershedHelper.GetGraph());
+		item.Image.release();
+		return true;
+	};
+	MaskFormat format = m_options.Format;
+	double epsilon = m_options.PolygonEpsilon;
+	auto solve = [format](BatchItem& item)
+	{
+		TRACE_SCOPE("batch solve");
+		LazySnapping lazySnapping(item.Model);
+		bool solved = false;
+		if (dependsOnHistory(item.Events))
+		{
+			// Undo, redo and the parametric sweep need the results in between, so every event is replayed.
+			SessionReplay replay(lazySnapping);
+			for each(auto& event in item.Events)
+				replay.Apply(event);
+			solved = replay.HasResult();
+		}
+		else
+		{
+			// Only the final marks and parameters of the session matter.
+			Mat paint = Mat::zeros(item.Model->GetLabels()->Size(), CV_8UC1);
+			for each(auto& event in item.Events)
+			{
+				switch (event.EventType)
+				{
+				case SessionEvent::Type::Stroke:
+					for (size_t k = 1; k < event.Points.size(); k++)
+						line(paint, event.Points[k - 1], event.Points[k], Scalar(event.Mode + 1), 2);
+					break;
+				case SessionEvent::Type::ClusterNum:
+					lazySnapping.SetClusterNum(static_cast<int>(event.Value));
+					break;
+				case SessionEvent::Type::E2Weight:
+					lazySnapping.SetE2Weight(event.Value);
+					break;
+				case SessionEvent::Type::Reset:
+					paint = Scalar::all(0);
+					break;
+				case SessionEvent::Type::LookupBits:
+					lazySnapping.SetE1LookupBits(static_cast<int>(event.Value));
+					break;
+				case SessionEvent::Type::Deadline:
+					lazySnapping.SetSolveDeadline(event.Value);
+					break;
+				default:
+					// ROI mode only matters between solves.
+					break;
+				}
+			}
+			solved = lazySnapping.Process(paint);
+		}
+		item.Events.clear();
+		if (!solved)
+		{
+			printSkip(item.SessionPath, "no foreground and background marks");
+			return false;
+		}
+		// Compact formats are streamed from the labels, which are kept with the model.
+		if (format == MaskFormat::Png)
+		{
+			item.Segmentation = lazySnapping.GetSegmentation();
+			item.Model.reset();
+		}
+		else
+			item.NodeLabels = lazySnapping.GetNodeLabels();
+		return true;
+	};
+	auto write = [&written, outputDirectory, format, epsilon](BatchItem& item)
+	{
+		TRACE_SCOPE("batch write");
+
+		// The mask is named after the session file.
+		string name = item.SessionPath.substr(item.SessionPath.find_last_of("/\\") + 1);
+		name = outputDirectory + "/" + name.substr(0, name.find_last_of('.'));
+		bool ok = false;
+		if (format == MaskFormat::Rle)
+			ok = WriteMaskRle(name += ".rle.json", *item.Model->GetLabels(), item.NodeLabels);
+		else if (format == MaskFormat::Polygons)
+			ok = WriteMaskPolygons(name += ".poly.json", *item.Model->GetLabels(), item.NodeLabels, epsilon);
+		else
+		{
+			vector<uchar> buffer;
+			if (!imencode(".png", item.Segmentation, buffer))
+			{
+				printSkip(item.SessionPath, "cannot encode the mask");
+				return false;
+			}
+			ofstream file(name += ".png", ios::binary | ios::trunc);
+			file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+			ok = static_cast<bool>(file.flush());
+		}
+		if (!ok)
+		{
+			printSkip(item.SessionPath, "cannot write " + name);
+			return false;
+		}
+		written++;
+		return true;
+	};
+
+	m_report.assign(4, BatchStageReport());
+	m_report[0].Name = "decode";
+	m_report[1].Name = "superpixel";
+	m_report[2].Name = "solve";
+	m_report[3].Name = "write";
+	int threadCounts[4] = { m_options.DecodeThreads, m_options.SuperpixelThreads, m_options.SolveThreads, m_options.WriteThreads };
+	BatchQueue* queues[5] = { &paths, &decoded, &superpixels, &solved, nullptr };
+	function<bool(BatchItem&)> works[4] = { decode, superpixel, solve, write };
+
+	// The last thread of a stage closes the queue of the next one.
+	mutex reportMutex;
+	atomic<int> remaining[4];
+	vector<thread> threads;
+	int64 start = getTickCount();
+	for (int s = 0; s < 4; s++)
+	{
+		m_report[s].Threads = threadCounts[s];
+		remaining[s] = threadCounts[s];
+		for (int t = 0; t < threadCounts[s]; t++)
+		{
+			threads.push_back(thread([&, s]()
+			{
+				runStage(queues[s], queues[s + 1], works[s], &m_report[s], &reportMutex);
+				if (--remaining[s] == 0 && queues[s + 1])
+					queues[s + 1]->Close();
+			}));
+		}
+	}
+	for each(auto& stageThread in threads)
+		stageThread.join();
+	m_wallMs = (getTickCount() - start) * 1000.0 / getTickFrequency();
+	return written;
+}
+
+const vector<BatchStageReport>& BatchPipeline::GetReport() const
+{
+	return m_report;
+}
+
+void BatchPipeline::PrintReport(ostream& stream) const
+{
+	stream << left << setw(12) << "stage" << setw(9) << "threads" << setw(8) << "items" << setw(10) << "ms/item"
+		<< setw(8) << "busy" << setw(10) << "starved" << "blocked" << endl;
+	for each(auto& stage in m_report)
+	{
+		// Shares of the thread time the stage had during the run.
+		double threadMs = max(stage.Threads * m_wallMs, 1e-3);
+		stream << left << setw(12) << stage.Name << setw(9) << stage.Threads << setw(8) << stage.Items << fixed << setprecision(2)
+			<< setw(10) << (stage.Items > 0 ? stage.BusyMs / stage.Items : 0) << setprecision(1)
+			<< setw(8) << 100 * stage.BusyMs / threadMs << setw(10) << 100 * stage.StarvedMs / threadMs
+			<< 100 * stage.BlockedMs / threadMs << endl;
+	}
+	stream << "wall ms " << fixed << setprecision(2) << m_wallMs << endl;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <string>
+#include <ostream>
+
+/// <summary>
+/// Mask file format of the batch pipeline.
+/// Png encodes the full mask. Rle and Polygons are streamed from the labels, see MaskEncoding.
+/// </summary>
+enum class MaskFormat
+{
+	Png,
+	Rle,
+	Polygons
+};
+
+/// <summary>
+/// Thread counts and queue sizes of the batch pipeline.
+/// </summary>
+struct BatchOptions
+{
+	int DecodeThreads = 2;			// Read session files and decode images. Mostly I/O.
+	int SuperpixelThreads = 2;		// Watershed super pixels and the snapping model.
+	int SolveThreads = 2;			// Clustering, graph cut and segmentation.
+	int WriteThreads = 1;			// Encode and write the masks. Mostly I/O.
+	int QueueCapacity = 4;			// Items waiting between two stages. Bounds the images in memory.
+	std::string OutputDirectory = "batch";
+	MaskFormat Format = MaskFormat::Png;
+	double PolygonEpsilon = 1.0;	// Simplification tolerance of polygon masks in pixels.
+};
+
+/// <summary>
+/// Time spent by the threads of one stage.
+/// </summary>
+struct BatchStageReport
+{
+	std::string Name;
+	int Threads = 0;
+	int Items = 0;
+	double BusyMs = 0;			// Processing items, summed over the threads.
+	double StarvedMs = 0;		// Waiting for input.
+	double BlockedMs = 0;		// Waiting for room in the output queue.
+};
+
+/// <summary>
+/// Segment a batch of recorded sessions offline. Every session goes through the stages
+/// decode, super pixel, solve and write, which run on their own threads and are connected by
+/// bounded queues, so I/O of one image overlaps the computation of others.
+/// The solve applies the final marks and parameters of the session once, and the mask is
+/// written named after the session file, as a PNG or streamed as run lengths or polygons.
+/// </summary>
+class BatchPipeline
+{
+public:
+	BatchPipeline(const BatchOptions& options = BatchOptions());
+	~BatchPipeline();
+
+public:
+	/// <summary>
+	/// Process the sessions and wait until every mask is written.
+	/// </summary>
+	/// <param name="sessionPaths">The session file paths, see SessionRecorder.</param>
+	/// <returns>The number of masks written.</returns>
+	int Run(const std::vector<std::string>& sessionPaths);
+
+	/// <summary>
+	/// Get the stage times of the last run.
+	/// </summary>
+	const std::vector<BatchStageReport>& GetReport() const;
+
+	/// <summary>
+	/// Print the utilization of every stage in the last run: the share of the wall time its threads
+	/// were busy, starved of input or blocked on output. A busy stage with starved successors is
+	/// the bottleneck and needs more threads; a mostly blocked stage may give some up.
+	/// </summary>
+	void PrintReport(std::ostream& stream) const;
+
+private:
+	BatchOptions m_options;
+	std::vector<BatchStageReport> m_report;
+	double m_wallMs;
+};
@@ -0,0 +1,636 @@
+#include "Benchmark.h"
+#include "WatershedHelper.h"
+#include "LazySnapping.h"
+#include "MultiObjectSnapping.h"
+#include "SessionRecorder.h"
+#include "SessionReplay.h"
+#include "SyntheticData.h"
+#include "VideoSnapping.h"
+#include "ProblemIO.h"
+#include "MaskEncoding.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+/// <summary>
+/// Build synthetic scribbles. The image border is marked as background and a cross at the image center as foreground.
+/// </summary>
+static Mat buildScribbles(const Size& size)
+{
+	Mat paint(size, CV_8UC1);
+	paint = Scalar::all(0);
+	rectangle(paint, Rect(0, 0, size.width, size.height), Scalar(2), 3);
+	Point center(size.width / 2, size.height / 2);
+	int radius = min(size.width, size.height) / 10;
+	line(paint, center - Point(radius, 0), center + Point(radius, 0), Scalar(1), 2);
+	line(paint, center - Point(0, radius), center + Point(0, radius), Scalar(1), 2);
+	return paint;
+}
+
+/// <summary>
+/// Fraction of Canny edge pixels lying within 2 pixels of a superpixel boundary.
+/// </summary>
+static float boundaryRecall(const Mat& srcImage, const Mat& maskImage)
+{
+	Mat gray, edges;
+	cvtColor(srcImage, gray, COLOR_BGR2GRAY);
+	Canny(gray, edges, 50, 150);
+
+	Mat boundary(maskImage.size(), CV_8UC1);
+	boundary = Scalar::all(0);
+	for (int i = 0; i < maskImage.rows; i++)
+	{
+		const int* maskptr = maskImage.ptr<int>(i);
+		const int* nextptr = maskImage.ptr<int>(min(i + 1, maskImage.rows - 1));
+		uchar* boundaryptr = boundary.ptr<uchar>(i);
+		for (int j = 0; j < maskImage.cols; j++)
+		{
+			if ((j + 1 < maskImage.cols && maskptr[j] != maskptr[j + 1]) || maskptr[j] != nextptr[j])
+				boundaryptr[j] = 255;
+		}
+	}
+	dilate(boundary, boundary, getStructuringElement(MORPH_RECT, Size(5, 5)));
+
+	int edgeCount = countNonZero(edges);
+	if (edgeCount == 0)
+		return 1.0f;
+	Mat hit;
+	bitwise_and(edges, boundary, hit);
+	return static_cast<float>(countNonZero(hit)) / edgeCount;
+}
+
+void RunSeedBenchmark(const vector<string>& imagePaths)
+{
+	const SeedMode modes[2] = { SeedMode::Grid, SeedMode::Adaptive };
+	const string modeNames[2] = { "grid", "adaptive" };
+	double tickToMs = 1000.0 / getTickFrequency();
+
+	cout << left << setw(36) << "image" << setw(10) << "mode" << setw(8) << "nodes"
+		<< setw(14) << "superpixel ms" << setw(10) << "solve ms" << "recall" << endl;
+	for each(auto& path in imagePaths)
+	{
+		Mat srcImage = imread(path);
+		if (srcImage.empty() || srcImage.type() != CV_8UC3)
+		{
+			cout << "Skip " << path << endl;
+			continue;
+		}
+		Mat paint = buildScribbles(srcImage.size());
+
+		for (int m = 0; m < 2; m++)
+		{
+			WatershedHelper watershedHelper(srcImage, 10, 10, 2, 2);
+			watershedHelper.SetSeedMode(modes[m]);
+			int64 start = getTickCount();
+			watershedHelper.Process();
+			double superpixelTime = (getTickCount() - start) * tickToMs;
+
+			Mat maskImage = watershedHelper.GetMask();
+			LazySnapping lazySnapping(maskImage, watershedHelper.GetColors(), watershedHelper.GetGraph());
+			start = getTickCount();
+			lazySnapping.Process(paint);
+			double solveTime = (getTickCount() - start) * tickToMs;
+
+			cout << left << setw(36) << path << setw(10) << modeNames[m] << setw(8) << watershedHelper.GetColors().size()
+				<< setw(14) << fixed << setprecision(2) << superpixelTime << setw(10) << solveTime
+				<< setprecision(3) << boundaryRecall(srcImage, maskImage) << endl;
+		}
+	}
+}
+
+/// <summary>
+/// Nearest rank percentile of sorted values.
+/// </summary>
+static double percentile(const vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	int rank = static_cast<int>(ceil(p * sorted.size()));
+	return sorted[max(rank, 1) - 1];
+}
+
+static void printLatencies(const string& name, vector<double> latencies)
+{
+	sort(latencies.begin(), latencies.end());
+	cout << left << setw(36) << name << setw(8) << latencies.size() << fixed << setprecision(2)
+		<< setw(10) << percentile(latencies, 0.5) << setw(10) << percentile(latencies, 0.95)
+		<< setw(10) << percentile(latencies, 0.99) << (latencies.empty() ? 0 : latencies.back()) << endl;
+}
+
+/// <summary>
+/// Drive lazy snapping through session events the same way the interactive loop does.
+/// </summary>
+/// <returns>The latency of every event that produced a new segmentation in milliseconds.</returns>
+static vector<double> replayEvents(LazySnapping& lazySnapping, const vector<SessionEvent>& events)
+{
+	double tickToMs = 1000.0 / getTickFrequency();
+	SessionReplay replay(lazySnapping);
+
+	vector<double> latencies;
+	for each(auto& event in events)
+	{
+		int64 start = getTickCount();
+		if (replay.Apply(event))
+			latencies.push_back((getTickCount() - start) * tickToMs);
+	}
+	return latencies;
+}
+
+/// <summary>
+/// Load a session file and build the model of its image.
+/// </summary>
+/// <returns>False if the session or its image cannot be read.</returns>
+static bool loadSessionModel(const string& path, vector<SessionEvent>& events, shared_ptr<const SnappingModel>& model)
+{
+	string imagePath;
+	if (!SessionRecorder::Load(path, imagePath, events))
+	{
+		cout << "Skip " << path << endl;
+		return false;
+	}
+	Mat srcImage = imread(imagePath);
+	if (srcImage.empty() || srcImage.type() != CV_8UC3)
+	{
+		cout << "Skip " << path << ", cannot read " << imagePath << endl;
+		return false;
+	}
+
+	WatershedHelper watershedHelper(srcImage, 10, 10, 2, 2);
+	watershedHelper.Process();
+	model = make_shared<SnappingModel>(make_shared<TiledLabelMap>(make_shared<TiledImage>(watershedHelper.GetMask())), watershedHelper.GetColors(), watershedHelper.GetGraph());
+	return true;
+}
+
+void RunSessionReplay(const vector<string>& sessionPaths)
+{
+	vector<double> allLatencies;
+
+	cout << left << setw(36) << "session" << setw(8) << "events" << setw(10) << "p50 ms"
+		<< setw(10) << "p95 ms" << setw(10) << "p99 ms" << "max ms" << endl;
+	for each(auto& path in sessionPaths)
+	{
+		vector<SessionEvent> events;
+		shared_ptr<const SnappingModel> model;
+		if (!loadSessionModel(path, events, model))
+			continue;
+
+		LazySnapping lazySnapping(model);
+		vector<double> latencies = replayEvents(lazySnapping, events);
+		allLatencies.insert(allLatencies.end(), latencies.begin(), latencies.end());
+		printLatencies(path, latencies);
+	}
+	printLatencies("all", allLatencies);
+}
+
+void RunTiledSession(const string& sessionPath, int tileSize /* = 1024 */)
+{
+	double tickToMs = 1000.0 / getTickFrequency();
+	string imagePath;
+	vector<SessionEvent> events;
+	if (!SessionRecorder::Load(sessionPath, imagePath, events))
+	{
+		cout << "Cannot read session " << sessionPath << endl;
+		return;
+	}
+
+	// The labels and the segmentation live in mapped files next to the session.
+	shared_ptr<TiledImage> labels;
+	vector<Vec3b> colors;
+	vector<Connection> graph;
+	int64 start = getTickCount();
+	{
+		Mat srcImage = imread(imagePath);
+		if (srcImage.empty() || srcImage.type() != CV_8UC3)
+		{
+			cout << "Cannot read " << imagePath << endl;
+			return;
+		}
+		labels = make_shared<TiledImage>(sessionPath + ".labels", srcImage.size(), CV_32SC1, tileSize);
+		WatershedHelper watershedHelper(srcImage, 10, 10, 2, 2);
+		watershedHelper.ProcessTiled(*labels);
+		colors = watershedHelper.GetColors();
+		graph = watershedHelper.GetGraph();
+	}
+	double superpixelTime = (getTickCount() - start) * tickToMs;
+
+	shared_ptr<const SnappingModel> model = make_shared<SnappingModel>(make_shared<TiledLabelMap>(labels), colors, graph);
+	graph.clear();
+	shared_ptr<TiledImage> segmentation = make_shared<TiledImage>(sessionPath + ".segmentation", labels->Size(), CV_8UC1, tileSize);
+	LazySnapping lazySnapping(model, segmentation);
+	vector<double> latencies = replayEvents(lazySnapping, events);
+
+	string maskPath = sessionPath.substr(0, sessionPath.find_last_of('.')) + ".rle.json";
+	start = getTickCount();
+	bool written = WriteMaskRle(maskPath, *model->GetLabels(), lazySnapping.GetNodeLabels());
+	double writeTime = (getTickCount() - start) * tickToMs;
+
+	cout << "Tiled super pixels " << model->GetNodeCount() << " nodes in " << fixed << setprecision(2) << superpixelTime << " ms" << endl;
+	cout << left << setw(36) << "session" << setw(8) << "events" << setw(10) << "p50 ms"
+		<< setw(10) << "p95 ms" << setw(10) << "p99 ms" << "max ms" << endl;
+	printLatencies(sessionPath, latencies);
+	cout << (written ? "Wrote " : "Cannot write ") << maskPath << " in " << writeTime << " ms" << endl;
+	MemoryReport report;
+	lazySnapping.GetMemoryReport(report);
+	report.Print(cout);
+}
+
+void RunMultiObject(const string& imagePath, const string& paintPath)
+{
+	Mat srcImage = imread(imagePath);
+	Mat paint = imread(paintPath, IMREAD_GRAYSCALE);
+	if (srcImage.empty() || srcImage.type() != CV_8UC3 || paint.size() != srcImage.size())
+	{
+		cout << "Cannot read " << imagePath << " with a paint image of its size " << paintPath << endl;
+		return;
+	}
+
+	double tickToMs = 1000.0 / getTickFrequency();
+	WatershedHelper watershedHelper(srcImage, 10, 10, 2, 2);
+	watershedHelper.Process();
+	MultiObjectSnapping multiObject(watershedHelper.GetMask(), watershedHelper.GetColors(), watershedHelper.GetGraph());
+	int64 start = getTickCount();
+	if (!multiObject.Process(paint))
+	{
+		cout << "No object and background seeds in " << paintPath << endl;
+		return;
+	}
+	double processTime = (getTickCount() - start) * tickToMs;
+	cout << multiObject.GetObjectCount() << " objects in " << fixed << setprecision(2) << processTime << " ms" << endl;
+
+	// Blend a distinct hue of every object over the image.
+	Mat palette(1, 256, CV_8UC3);
+	for (int k = 0; k < 256; k++)
+		palette.at<Vec3b>(0, k) = Vec3b(static_cast<uchar>(k * 47 % 180), 255, 255);
+	cvtColor(palette, palette, COLOR_HSV2BGR);
+	Mat objectMap = multiObject.GetObjectMap();
+	Mat result = srcImage.clone();
+	for (int i = 0; i < result.rows; i++)
+	{
+		const uchar* objectptr = objectMap.ptr<uchar>(i);
+		Vec3b* resptr = result.ptr<Vec3b>(i);
+		for (int j = 0; j < result.cols; j++)
+		{
+			if (objectptr[j] > 0)
+				resptr[j] = resptr[j] / 2 + palette.at<Vec3b>(0, objectptr[j]) / 2;
+		}
+	}
+	if (imwrite("objects.png", result))
+		cout << "Wrote objects.png" << endl;
+	else
+		cout << "Cannot write objects.png" << endl;
+}
+
+void RunVideoBenchmark(const string& directory, const string& paintPath /* = "" */)
+{
+	vector<String> paths;
+	glob(directory + "/*", paths);
+	vector<Mat> frames;
+	for each(auto& path in paths)
+	{
+		Mat frame = imread(path);
+		if (frame.empty())
+			continue;
+		if (!frames.empty() && frame.size() != frames[0].size())
+		{
+			cout << "Skip " << path << ", the frame size differs from the first frame" << endl;
+			continue;
+		}
+		frames.push_back(frame);
+	}
+	if (frames.size() < 2)
+	{
+		cout << "Need at least two frames in " << directory << endl;
+		return;
+	}
+	Mat paint = paintPath.empty() ? buildScribbles(frames[0].size()) : imread(paintPath, IMREAD_GRAYSCALE);
+	if (paint.size() != frames[0].size())
+	{
+		cout << "Cannot read a paint image of the frame size " << paintPath << endl;
+		return;
+	}
+	cout << frames.size() << " frames of " << frames[0].cols << "x" << frames[0].rows << endl;
+
+	double tickToMs = 1000.0 / getTickFrequency();
+	vector<Mat> rest(frames.begin() + 1, frames.end());
+
+	// Frame by frame: every latency covers the super pixels and the solve of one frame.
+	VideoSnapping serial;
+	if (!serial.Start(frames[0], paint))
+	{
+		cout << "No foreground and background marks on the first frame" << endl;
+		return;
+	}
+	vector<double> latencies;
+	int failed = 0;
+	int64 start = getTickCount();
+	for each(auto& frame in rest)
+	{
+		int64 frameStart = getTickCount();
+		if (serial.ProcessFrame(frame).empty())
+			failed++;
+		latencies.push_back((getTickCount() - frameStart) * tickToMs);
+	}
+	double serialTime = (getTickCount() - start) * tickToMs;
+
+	// Pipelined: the super pixels of upcoming frames overlap the solve.
+	VideoSnapping pipelined;
+	pipelined.Start(frames[0], paint);
+	start = getTickCount();
+	vector<Mat> masks = pipelined.ProcessSequence(rest);
+	double pipelinedTime = (getTickCount() - start) * tickToMs;
+	int pipelinedFailed = static_cast<int>(count_if(masks.begin(), masks.end(), [](const Mat& mask) { return mask.empty(); }));
+
+	cout << left << setw(36) << "frame" << setw(8) << "frames" << setw(10) << "p50 ms"
+		<< setw(10) << "p95 ms" << setw(10) << "p99 ms" << "max ms" << endl;
+	printLatencies("serial", latencies);
+	cout << fixed << setprecision(2)
+		<< "serial " << rest.size() * 1000.0 / serialTime << " fps, " << failed << " failed frames" << endl
+		<< "pipelined " << rest.size() * 1000.0 / pipelinedTime << " fps, " << pipelinedFailed << " failed frames" << endl;
+}
+
+void RunConcurrentSessions(const vector<string>& sessionPaths, int threadCount)
+{
+	if (threadCount < 1)
+	{
+		cout << "Thread count must be positive." << endl;
+		return;
+	}
+
+	double tickToMs = 1000.0 / getTickFrequency();
+	cout << left << setw(36) << "session" << setw(10) << "threads" << setw(12) << "serial ms"
+		<< setw(14) << "parallel ms" << setw(10) << "speedup" << "mismatches" << endl;
+	for each(auto& path in sessionPaths)
+	{
+		vector<SessionEvent> events;
+		shared_ptr<const SnappingModel> model;
+		if (!loadSessionModel(path, events, model))
+			continue;
+
+		// Every session runs on its own thread. Clustering uses a fixed seed, so all of them must match the reference.
+		auto runSession = [&events, &model](Mat& segmentation)
+		{
+			try
+			{
+				LazySnapping lazySnapping(model);
+				replayEvents(lazySnapping, events);
+				segmentation = lazySnapping.GetSegmentation();
+			}
+			catch (const exception* e)
+			{
+				cout << e->what() << endl;
+				delete e;
+			}
+		};
+
+		Mat expected;
+		int64 start = getTickCount();
+		thread(runSession, ref(expected)).join();
+		double serialTime = (getTickCount() - start) * tickToMs;
+
+		vector<Mat> results(threadCount);
+		vector<thread> threads;
+		start = getTickCount();
+		for (int t = 0; t < threadCount; t++)
+			threads.push_back(thread(runSession, ref(results[t])));
+		for each(auto& session in threads)
+			session.join();
+		double parallelTime = (getTickCount() - start) * tickToMs;
+
+		int mismatches = 0;
+		for each(auto& result in results)
+		{
+			if (result.empty() || expected.empty() || countNonZero(result != expected) > 0)
+				mismatches++;
+		}
+		cout << left << setw(36) << path << setw(10) << threadCount << fixed << setprecision(2)
+			<< setw(12) << serialTime << setw(14) << parallelTime
+			<< setw(10) << serialTime * threadCount / max(parallelTime, 1e-3) << mismatches << endl;
+	}
+}
+
+/// <summary>
+/// Get the resident memory of the process in bytes, current and peak.
+/// </summary>
+static void processMemory(size_t& current, size_t& peak)
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	current = counters.WorkingSetSize;
+	peak = counters.PeakWorkingSetSize;
+#else
+	long pages = 0, residentPages = 0;
+	ifstream statm("/proc/self/statm");
+	statm >> pages >> residentPages;
+	current = static_cast<size_t>(residentPages) * sysconf(_SC_PAGESIZE);
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	peak = static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+/// <summary>
+/// One measurement of the scaling benchmark.
+/// </summary>
+struct ScalingRow
+{
+	string Stage;
+	string Variant;
+	double Size;		// Pixels for image stages, nodes for graph stages.
+	size_t Nodes;
+	size_t Edges;
+	double Time;		// Milliseconds.
+	double Retained;	// Memory still held after the stage in megabytes.
+	double Peak;		// Process peak memory in megabytes.
+};
+
+/// <summary>
+/// Time a stage and measure the memory it leaves allocated.
+/// </summary>
+template <typename Func>
+static ScalingRow measureStage(const string& stage, const string& variant, double size, Func func)
+{
+	const double toMb = 1.0 / (1 << 20);
+	size_t before, after, peak;
+	processMemory(before, peak);
+	int64 start = getTickCount();
+	func();
+	double time = (getTickCount() - start) * 1000.0 / getTickFrequency();
+	processMemory(after, peak);
+
+	ScalingRow row;
+	row.Stage = stage;
+	row.Variant = variant;
+	row.Size = size;
+	row.Nodes = 0;
+	row.Edges = 0;
+	row.Time = time;
+	row.Retained = after > before ? (after - before) * toMb : 0;
+	row.Peak = peak * toMb;
+	return row;
+}
+
+/// <summary>
+/// Write a row to the CSV file and the console. The scaling exponent is log(time ratio) / log(size ratio)
+/// against the previous row of the same stage and variant; 1 is linear.
+/// </summary>
+static void writeScalingRow(ofstream& csv, vector<ScalingRow>& rows, const ScalingRow& row)
+{
+	string exponent;
+	for (auto it = rows.rbegin(); it != rows.rend(); ++it)
+	{
+		if (it->Stage != row.Stage || it->Variant != row.Variant)
+			continue;
+		if (it->Time > 0 && row.Time > 0 && row.Size > it->Size)
+			exponent = to_string(log(row.Time / it->Time) / log(row.Size / it->Size));
+		break;
+	}
+	rows.push_back(row);
+
+	ostringstream line;
+	line << fixed << setprecision(2) << row.Stage << "," << row.Variant << "," << static_cast<int64>(row.Size) << ","
+		<< row.Nodes << "," << row.Edges << "," << row.Time << "," << row.Retained << "," << row.Peak << "," << exponent;
+	csv << line.str() << endl;
+	cout << line.str() << endl;
+}
+
+void RunScalingBenchmark(const string& csvPath, double maxMegapixels /* = 16 */, int maxNodes /* = 1 << 20 */)
+{
+	ofstream csv(csvPath, ios::out | ios::trunc);
+	if (!csv.is_open())
+	{
+		cout << "Cannot write " << csvPath << endl;
+		return;
+	}
+	const string header = "stage,variant,size,nodes,edges,ms,retained_mb,peak_mb,exponent";
+	csv << header << endl;
+	cout << header << endl;
+	vector<ScalingRow> rows;
+
+	// Image stages on 4:3 textured images, 4x more pixels each step.
+	vector<double> megapixels;
+	for (double mp = 0.25; mp < maxMegapixels; mp *= 4)
+		megapixels.push_back(mp);
+	megapixels.push_back(maxMegapixels);
+	for each(auto mp in megapixels)
+	{
+		int width = static_cast<int>(sqrt(mp * 1e6 * 4 / 3));
+		Size size(width, width * 3 / 4);
+		double pixels = static_cast<double>(size.area());
+
+		Mat srcImage;
+		writeScalingRow(csv, rows, measureStage("generate", "textured", pixels, [&]()
+		{
+			srcImage = GenerateTexturedImage(size);
+		}));
+
+		WatershedHelper watershedHelper(srcImage, 10, 10, 2, 2);
+		ScalingRow row = measureStage("watershed", "textured", pixels, [&]()
+		{
+			watershedHelper.Process();
+		});
+		vector<Connection> graph = watershedHelper.GetGraph();
+		row.Nodes = graph.size();
+		for each(auto& connection in graph)
+			row.Edges += connection.Edges.size();
+		writeScalingRow(csv, rows, row);
+
+		Mat paint = buildScribbles(size);
+		unique_ptr<LazySnapping> lazySnapping;
+		size_t nodes = row.Nodes, edges = row.Edges;
+		row = measureStage("lazysnapping", "textured", pixels, [&]()
+		{
+			lazySnapping = make_unique<LazySnapping>(watershedHelper.GetMask(), watershedHelper.GetColors(), graph);
+			lazySnapping->Process(paint);
+		});
+		row.Nodes = nodes;
+		row.Edges = edges;
+		writeScalingRow(csv, rows, row);
+	}
+
+	// Max flow on synthetic graphs, 4x more nodes each step.
+	const CapacityDistribution distributions[3] = { CapacityDistribution::Uniform, CapacityDistribution::Exponential, CapacityDistribution::Bimodal };
+	const string distributionNames[3] = { "uniform", "exponential", "bimodal" };
+	vector<int> nodeCounts;
+	for (int n = 1 << 14; n < maxNodes; n *= 4)
+		nodeCounts.push_back(n);
+	nodeCounts.push_back(maxNodes);
+	for each(auto n in nodeCounts)
+	{
+		for (int topology = 0; topology < 2; topology++)
+		{
+			for (int d = 0; d < 3; d++)
+			{
+				int side = static_cast<int>(sqrt(static_cast<double>(n)));
+				CutProblem problem = topology == 0 ? GenerateGridProblem(side, max(n / side, 1), distributions[d]) : GeneratePlanarProblem(n, distributions[d]);
+				string variant = (topology == 0 ? "grid/" : "planar/") + distributionNames[d];
+
+				unique_ptr<Graph<float, float, float>> graph;
+				ScalingRow row = measureStage("graph_build", variant, problem.NodeCount, [&]()
+				{
+					graph = make_unique<Graph<float, float, float>>(problem.NodeCount, static_cast<int>(problem.Edges.size()));
+					BuildGraph(problem, *graph);
+				});
+				row.Nodes = problem.NodeCount;
+				row.Edges = problem.Edges.size();
+				writeScalingRow(csv, rows, row);
+
+				row = measureStage("maxflow", variant, problem.NodeCount, [&]()
+				{
+					graph->maxflow();
+				});
+				row.Nodes = problem.NodeCount;
+				row.Edges = problem.Edges.size();
+				writeScalingRow(csv, rows, row);
+			}
+		}
+	}
+}
+
+void RunProblemBenchmark(const vector<string>& problemPaths)
+{
+	double tickToMs = 1000.0 / getTickFrequency();
+
+	cout << left << setw(36) << "problem" << setw(10) << "nodes" << setw(10) << "edges"
+		<< setw(10) << "load ms" << setw(10) << "solve ms" << "flow" << endl;
+	for each(auto& path in problemPaths)
+	{
+		CutProblem problem;
+		int64 start = getTickCount();
+		if (!LoadProblem(path, problem))
+		{
+			cout << "Skip " << path << endl;
+			continue;
+		}
+		double loadTime = (getTickCount() - start) * tickToMs;
+
+		start = getTickCount();
+		Graph<float, float, float> graph(problem.NodeCount, static_cast<int>(problem.Edges.size()));
+		BuildGraph(problem, graph);
+		float flow = graph.maxflow();
+		double solveTime = (getTickCount() - start) * tickToMs;
+
+		cout << left << setw(36) << path << setw(10) << problem.NodeCount << setw(10) << problem.Edges.size()
+			<< fixed << setprecision(2) << setw(10) << loadTime << setw(10) << solveTime << flow << endl;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+/// <summary>
+/// Compare grid and adaptive seed generation on the specified images.
+/// For each image and seed mode, report node count, superpixel time, solve time and boundary recall.
+/// The solve uses synthetic scribbles: image border as background and a cross at the center as foreground.
+/// </summary>
+/// <param name="imagePaths">The image file paths.</param>
+void RunSeedBenchmark(const std::vector<std::string>& imagePaths);
+
+/// <summary>
+/// Replay recorded sessions headless and report the latency percentiles of every process call.
+/// The super pixels are computed once per session and excluded from the latency.
+/// </summary>
+/// <param name="sessionPaths">The session file paths, see SessionRecorder.</param>
+void RunSessionReplay(const std::vector<std::string>& sessionPaths);
+
+/// <summary>
+/// Replay a session on the tiled path: watershed tile by tile into a mapped label file, solve with a mapped
+/// segmentation file and stream the final mask out as run lengths next to the session, see WriteMaskRle.
+/// The source image is still decoded into memory by imread and the paint mask is a full frame
+/// CV_8UC1 image, so only the labels, the segmentation and the output are streamed.
+/// </summary>
+/// <param name="sessionPath">The session file path, see SessionRecorder.</param>
+/// <param name="tileSize">The tile width and height of the mapped storages.</param>
+void RunTiledSession(const std::string& sessionPath, int tileSize = 1024);
+
+/// <summary>
+/// Segment several objects of an image at once with MultiObjectSnapping and write the object map,
+/// colored over the image, to objects.png.
+/// </summary>
+/// <param name="imagePath">The image file path.</param>
+/// <param name="paintPath">The CV_8UC1 paint image path. 1 to 254 for the seeds of each object, 255 for background.</param>
+void RunMultiObject(const std::string& imagePath, const std::string& paintPath);
+
+/// <summary>
+/// Segment a frame sequence with VideoSnapping and report the per-frame latency and frame rate, first
+/// frame by frame, then with the super pixels of upcoming frames computed concurrently by ProcessSequence.
+/// The frames are decoded into memory before timing.
+/// </summary>
+/// <param name="directory">The directory of the frames, in file name order.</param>
+/// <param name="paintPath">The CV_8UC1 paint image of the first frame, 1 for foreground and 2 for background.
+/// Empty for synthetic scribbles: the border as background and a cross at the center as foreground.</param>
+void RunVideoBenchmark(const std::string& directory, const std::string& paintPath = "");
+
+/// <summary>
+/// Replay every session on several threads at once, each with its own LazySnapping on one shared model,
+/// and compare the wall time and the final segmentations with a single replay.
+/// </summary>
+/// <param name="sessionPaths">The session file paths, see SessionRecorder.</param>
+/// <param name="threadCount">The number of concurrent sessions per file.</param>
+void RunConcurrentSessions(const std::vector<std::string>& sessionPaths, int threadCount);
+
+/// <summary>
+/// Measure how the pipeline stages scale with the input size on deterministic synthetic data.
+/// Textured images of growing size go through WatershedHelper and LazySnapping, and random grid and
+/// planar graphs with every capacity distribution go through Graph::maxflow. Time and memory of every
+/// stage and size are written as CSV, with the local scaling exponent against the previous size,
+/// so super-linear stages stand out with an exponent well above 1.
+/// </summary>
+/// <param name="csvPath">The CSV output path. The rows are also printed.</param>
+/// <param name="maxMegapixels">The largest image size in megapixels.</param>
+/// <param name="maxNodes">The largest graph size in nodes.</param>
+void RunScalingBenchmark(const std::string& csvPath, double maxMegapixels = 16, int maxNodes = 1 << 20);
+
+/// <summary>
+/// Solve exported min cut problems with Graph::maxflow and report load time, solve time and flow.
+/// </summary>
+/// <param name="problemPaths">The problem file paths, DIMACS or binary, see ProblemIO.</param>
+void RunProblemBenchmark(const std::vector<std::string>& problemPaths);
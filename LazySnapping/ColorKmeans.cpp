@@ -0,0 +1,319 @@
+#include "ColorKmeans.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <cfloat>
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+// Colors per parallel block. A multiple of the SIMD width, so the blocks and their sums are the same on any thread count.
+static const int BlockSize = 1024;
+
+// Candidates per k-means++ center, as in cv::kmeans.
+static const int SeedTrials = 3;
+
+ColorKmeans::ColorKmeans(int clusterNum, int attempts /* = 3 */, int maxIterations /* = 10 */, double epsilon /* = 1.0 */)
+	: m_clusterNum(clusterNum), m_attempts(attempts), m_maxIterations(maxIterations), m_epsilon(epsilon), m_k(0), m_compactness(0)
+{
+	if (clusterNum < 1)
+		throw new exception("Cluster number must be positive.");
+	if (attempts < 1 || maxIterations < 1)
+		throw new exception("Attempts and iterations must be positive.");
+}
+
+ColorKmeans::~ColorKmeans()
+{
+}
+
+void ColorKmeans::Process(const vector<Vec3b>& nodeColors, const vector<int>& comps)
+{
+	if (comps.empty())
+		throw new exception("No colors to cluster.");
+
+	int n = static_cast<int>(comps.size());
+	for (int c = 0; c < 3; c++)
+		m_planes[c].resize(n);
+	for (int i = 0; i < n; i++)
+	{
+		const Vec3b& color = nodeColors[comps[i] - 1];
+		m_planes[0][i] = color[0];
+		m_planes[1][i] = color[1];
+		m_planes[2][i] = color[2];
+	}
+	m_k = min(n, m_clusterNum);
+
+	// A fixed seed makes the clusters independent of the calling thread.
+	RNG rng(0x2545F491);
+	vector<int> labels;
+	vector<Vec3d> sums;
+	vector<int> counts;
+	m_compactness = DBL_MAX;
+	for (int a = 0; a < m_attempts; a++)
+	{
+		double compactness = runAttempt(rng, labels, sums, counts);
+		if (compactness < m_compactness)
+		{
+			m_compactness = compactness;
+			m_labels = labels;
+			m_sums = sums;
+			m_counts = counts;
+		}
+	}
+}
+
+const vector<int>& ColorKmeans::GetLabels() const
+{
+	return m_labels;
+}
+
+vector<Vec3b> ColorKmeans::GetColors() const
+{
+	vector<Vec3b> colors(m_k);
+	for (int k = 0; k < m_k; k++)
+	{
+		if (m_counts[k] == 0)
+			throw new exception("Cluster has no element.");
+		colors[k] = Vec3b(saturate_cast<uchar>(m_sums[k][0] / m_counts[k]), saturate_cast<uchar>(m_sums[k][1] / m_counts[k]),
+			saturate_cast<uchar>(m_sums[k][2] / m_counts[k]));
+	}
+	return colors;
+}
+
+const vector<Vec3d>& ColorKmeans::GetSums() const
+{
+	return m_sums;
+}
+
+const vector<int>& ColorKmeans::GetCounts() const
+{
+	return m_counts;
+}
+
+double ColorKmeans::GetCompactness() const
+{
+	return m_compactness;
+}
+
+double ColorKmeans::runAttempt(RNG& rng, vector<int>& labels, vector<Vec3d>& sums, vector<int>& counts)
+{
+	int n = static_cast<int>(m_planes[0].size());
+	vector<Vec3f> centers;
+	seedCenters(rng, centers);
+	labels.resize(n);
+	vector<float> dists(n);
+
+	// Stop when no center moves more than epsilon, the same criteria as cv::kmeans.
+	double compactness = 0;
+	for (int iteration = 0; ; )
+	{
+		compactness = assignLabels(centers, labels, dists, sums, counts);
+		fillEmptyClusters(labels, dists, sums, counts);
+		double maxShift = 0;
+		for (int k = 0; k < m_k; k++)
+		{
+			Vec3f center(static_cast<float>(sums[k][0] / counts[k]), static_cast<float>(sums[k][1] / counts[k]),
+				static_cast<float>(sums[k][2] / counts[k]));
+			Vec3f shift = center - centers[k];
+			maxShift = max(maxShift, static_cast<double>(shift[0] * shift[0] + shift[1] * shift[1] + shift[2] * shift[2]));
+			centers[k] = center;
+		}
+		if (++iteration >= m_maxIterations || maxShift <= m_epsilon * m_epsilon)
+			break;
+	}
+	return compactness;
+}
+
+void ColorKmeans::seedCenters(RNG& rng, vector<Vec3f>& centers)
+{
+	int n = static_cast<int>(m_planes[0].size());
+	centers.resize(m_k);
+	int first = rng.uniform(0, n);
+	centers[0] = Vec3f(m_planes[0][first], m_planes[1][first], m_planes[2][first]);
+	vector<float> dists, trialDists, bestDists;
+	double sum = updateDistances(centers[0], vector<float>(n, FLT_MAX), dists);
+
+	for (int k = 1; k < m_k; k++)
+	{
+		double bestSum = DBL_MAX;
+		int bestIndex = 0;
+		for (int trial = 0; trial < SeedTrials; trial++)
+		{
+			// Draw a color with probability proportional to its squared distance.
+			double p = rng.uniform(0.0, 1.0) * sum;
+			int i = 0;
+			for (; i < n - 1; i++)
+			{
+				if ((p -= dists[i]) <= 0)
+					break;
+			}
+			double trialSum = updateDistances(Vec3f(m_planes[0][i], m_planes[1][i], m_planes[2][i]), dists, trialDists);
+			if (trialSum < bestSum)
+			{
+				bestSum = trialSum;
+				bestIndex = i;
+				swap(trialDists, bestDists);
+			}
+		}
+		centers[k] = Vec3f(m_planes[0][bestIndex], m_planes[1][bestIndex], m_planes[2][bestIndex]);
+		swap(dists, bestDists);
+		sum = bestSum;
+	}
+}
+
+double ColorKmeans::updateDistances(const Vec3f& center, const vector<float>& dists, vector<float>& newDists) const
+{
+	int n = static_cast<int>(m_planes[0].size());
+	newDists.resize(n);
+	const float* p0 = m_planes[0].data();
+	const float* p1 = m_planes[1].data();
+	const float* p2 = m_planes[2].data();
+	const float* distptr = dists.data();
+	float* newptr = newDists.data();
+	double sum = 0;
+	int i = 0;
+#if CV_SIMD128
+	v_float32x4 c0 = v_setall_f32(center[0]);
+	v_float32x4 c1 = v_setall_f32(center[1]);
+	v_float32x4 c2 = v_setall_f32(center[2]);
+	for (; i <= n - 4; i += 4)
+	{
+		v_float32x4 d0 = v_load(p0 + i) - c0;
+		v_float32x4 d1 = v_load(p1 + i) - c1;
+		v_float32x4 d2 = v_load(p2 + i) - c2;
+		v_float32x4 dist = v_min(d0 * d0 + d1 * d1 + d2 * d2, v_load(distptr + i));
+		v_store(newptr + i, dist);
+		sum += v_reduce_sum(dist);
+	}
+#endif
+	for (; i < n; i++)
+	{
+		float d0 = p0[i] - center[0];
+		float d1 = p1[i] - center[1];
+		float d2 = p2[i] - center[2];
+		newptr[i] = min(d0 * d0 + d1 * d1 + d2 * d2, distptr[i]);
+		sum += newptr[i];
+	}
+	return sum;
+}
+
+double ColorKmeans::assignLabels(const vector<Vec3f>& centers, vector<int>& labels, vector<float>& dists,
+	vector<Vec3d>& sums, vector<int>& counts) const
+{
+	int n = static_cast<int>(m_planes[0].size());
+	int blockCount = (n + BlockSize - 1) / BlockSize;
+
+	// Each block accumulates the three channel sums and color count of every cluster, then its distance sum.
+	int partialSize = m_k * 4 + 1;
+	vector<double> partialSums(static_cast<size_t>(blockCount) * partialSize, 0);
+	parallel_for_(Range(0, blockCount), [&](const Range& range)
+	{
+		for (int b = range.start; b < range.end; b++)
+		{
+			int start = b * BlockSize;
+			int end = min(n, start + BlockSize);
+			assignBlock(centers, start, end, labels.data(), dists.data());
+			double* partial = partialSums.data() + static_cast<size_t>(b) * partialSize;
+			for (int i = start; i < end; i++)
+			{
+				double* sum = partial + labels[i] * 4;
+				sum[0] += m_planes[0][i];
+				sum[1] += m_planes[1][i];
+				sum[2] += m_planes[2][i];
+				sum[3] += 1;
+				partial[m_k * 4] += dists[i];
+			}
+		}
+	});
+
+	sums.assign(m_k, Vec3d(0, 0, 0));
+	counts.assign(m_k, 0);
+	double compactness = 0;
+	for (int b = 0; b < blockCount; b++)
+	{
+		const double* partial = partialSums.data() + static_cast<size_t>(b) * partialSize;
+		for (int k = 0; k < m_k; k++)
+		{
+			sums[k] += Vec3d(partial[k * 4], partial[k * 4 + 1], partial[k * 4 + 2]);
+			counts[k] += static_cast<int>(partial[k * 4 + 3]);
+		}
+		compactness += partial[m_k * 4];
+	}
+	return compactness;
+}
+
+void ColorKmeans::assignBlock(const vector<Vec3f>& centers, int start, int end, int* labels, float* dists) const
+{
+	const float* p0 = m_planes[0].data();
+	const float* p1 = m_planes[1].data();
+	const float* p2 = m_planes[2].data();
+	int i = start;
+#if CV_SIMD128
+	for (; i <= end - 4; i += 4)
+	{
+		v_float32x4 x0 = v_load(p0 + i);
+		v_float32x4 x1 = v_load(p1 + i);
+		v_float32x4 x2 = v_load(p2 + i);
+		v_float32x4 best = v_setall_f32(FLT_MAX);
+		v_int32x4 bestLabel = v_setall_s32(0);
+		for (int k = 0; k < m_k; k++)
+		{
+			v_float32x4 d0 = x0 - v_setall_f32(centers[k][0]);
+			v_float32x4 d1 = x1 - v_setall_f32(centers[k][1]);
+			v_float32x4 d2 = x2 - v_setall_f32(centers[k][2]);
+			v_float32x4 dist = d0 * d0 + d1 * d1 + d2 * d2;
+			v_float32x4 closer = dist < best;
+			best = v_select(closer, dist, best);
+			bestLabel = v_select(v_reinterpret_as_s32(closer), v_setall_s32(k), bestLabel);
+		}
+		v_store(dists + i, best);
+		v_store(labels + i, bestLabel);
+	}
+#endif
+	for (; i < end; i++)
+	{
+		float best = FLT_MAX;
+		int bestLabel = 0;
+		for (int k = 0; k < m_k; k++)
+		{
+			float d0 = p0[i] - centers[k][0];
+			float d1 = p1[i] - centers[k][1];
+			float d2 = p2[i] - centers[k][2];
+			float dist = d0 * d0 + d1 * d1 + d2 * d2;
+			if (dist < best)
+			{
+				best = dist;
+				bestLabel = k;
+			}
+		}
+		dists[i] = best;
+		labels[i] = bestLabel;
+	}
+}
+
+void ColorKmeans::fillEmptyClusters(vector<int>& labels, vector<float>& dists, vector<Vec3d>& sums, vector<int>& counts) const
+{
+	int n = static_cast<int>(labels.size());
+	for (int k = 0; k < m_k; k++)
+	{
+		if (counts[k] > 0)
+			continue;
+
+		// There are at least as many colors as clusters, so some cluster has more than one.
+		int farthest = -1;
+		for (int i = 0; i < n; i++)
+		{
+			if (counts[labels[i]] > 1 && (farthest < 0 || dists[i] > dists[farthest]))
+				farthest = i;
+		}
+		if (farthest < 0)
+			return;
+
+		Vec3d color(m_planes[0][farthest], m_planes[1][farthest], m_planes[2][farthest]);
+		sums[labels[farthest]] -= color;
+		counts[labels[farthest]]--;
+		sums[k] += color;
+		counts[k]++;
+		labels[farthest] = k;
+		dists[farthest] = 0;
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+
+/// <summary>
+/// K-means clustering specialized for the 8 bit colors of components. It replaces cv::kmeans with the
+/// same criteria: k-means++ seeding, several attempts, at most maxIterations iterations per attempt and
+/// early exit once no center moves more than epsilon. Colors are kept as three planes, so the assignment
+/// compares four colors at once with SIMD. Assignment and center sums run in parallel over fixed blocks,
+/// and the seeds come from a fixed random generator, so the clusters only depend on the input.
+/// No cluster is left empty.
+/// </summary>
+class ColorKmeans
+{
+public:
+	ColorKmeans(int clusterNum, int attempts = 3, int maxIterations = 10, double epsilon = 1.0);
+	~ColorKmeans();
+
+public:
+	/// <summary>
+	/// Cluster the colors of the given components. The cluster number is reduced to the number of components.
+	/// </summary>
+	/// <param name="nodeColors">The color of every component.</param>
+	/// <param name="comps">The 1-based ids of the components to cluster. Must not be empty.</param>
+	void Process(const std::vector<cv::Vec3b>& nodeColors, const std::vector<int>& comps);
+
+	/// <summary>
+	/// Get the cluster of every clustered component, in the order of comps.
+	/// </summary>
+	const std::vector<int>& GetLabels() const;
+
+	/// <summary>
+	/// Get the mean color of every cluster.
+	/// </summary>
+	std::vector<cv::Vec3b> GetColors() const;
+
+	/// <summary>
+	/// Get the color sum of every cluster, e.g. to add more colors to the clusters later.
+	/// </summary>
+	const std::vector<cv::Vec3d>& GetSums() const;
+
+	/// <summary>
+	/// Get the number of colors in every cluster.
+	/// </summary>
+	const std::vector<int>& GetCounts() const;
+
+	/// <summary>
+	/// Get the sum of squared distances of the colors to their centers in the best attempt.
+	/// </summary>
+	double GetCompactness() const;
+
+private:
+	/// <summary>
+	/// Run one attempt from k-means++ seeds.
+	/// </summary>
+	/// <returns>The compactness of the attempt.</returns>
+	double runAttempt(cv::RNG& rng, std::vector<int>& labels, std::vector<cv::Vec3d>& sums, std::vector<int>& counts);
+
+	/// <summary>
+	/// Pick k-means++ centers: every next center is drawn with probability proportional to the squared
+	/// distance to the nearest center so far, taking the best of a few candidates.
+	/// </summary>
+	void seedCenters(cv::RNG& rng, std::vector<cv::Vec3f>& centers);
+
+	/// <summary>
+	/// Lower the distances to a new center.
+	/// </summary>
+	/// <param name="center">The new center.</param>
+	/// <param name="dists">The squared distances to the nearest center so far.</param>
+	/// <param name="newDists">The squared distances including the new center.</param>
+	/// <returns>The sum of newDists.</returns>
+	double updateDistances(const cv::Vec3f& center, const std::vector<float>& dists, std::vector<float>& newDists) const;
+
+	/// <summary>
+	/// Assign every color to the nearest center and sum the colors of every cluster.
+	/// Blocks are processed in parallel, and their sums are added in block order.
+	/// </summary>
+	/// <returns>The sum of squared distances to the nearest centers.</returns>
+	double assignLabels(const std::vector<cv::Vec3f>& centers, std::vector<int>& labels, std::vector<float>& dists,
+		std::vector<cv::Vec3d>& sums, std::vector<int>& counts) const;
+
+	/// <summary>
+	/// Assign the colors of one block with SIMD.
+	/// </summary>
+	void assignBlock(const std::vector<cv::Vec3f>& centers, int start, int end, int* labels, float* dists) const;
+
+	/// <summary>
+	/// Move the color farthest from its center into every empty cluster, as cv::kmeans does.
+	/// </summary>
+	void fillEmptyClusters(std::vector<int>& labels, std::vector<float>& dists, std::vector<cv::Vec3d>& sums, std::vector<int>& counts) const;
+
+private:
+	int m_clusterNum;
+	int m_attempts;
+	int m_maxIterations;
+	double m_epsilon;
+
+	int m_k;						// Cluster number of the last input.
+	std::vector<float> m_planes[3];	// The colors as planes of the three channels.
+	std::vector<int> m_labels;
+	std::vector<cv::Vec3d> m_sums;	// Color sum of every cluster.
+	std::vector<int> m_counts;
+	double m_compactness;
+};
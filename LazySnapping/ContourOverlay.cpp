@@ -0,0 +1,190 @@
+#include "ContourOverlay.h"
+#include "Trace.h"
+#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+ContourOverlay::ContourOverlay(const Mat& maskImage, int nodeCount)
+	: m_nodeCount(nodeCount), m_updatedPixels(0)
+{
+	if (maskImage.type() != CV_32SC1)
+		throw new exception("Mask image type must be CV_32SC1");
+
+	TiledLabelMap labels(make_shared<TiledImage>(maskImage));
+	buildBoundaries(labels);
+	Reset();
+}
+
+ContourOverlay::ContourOverlay(shared_ptr<const LabelMap> labels, int nodeCount)
+	: m_nodeCount(nodeCount), m_updatedPixels(0)
+{
+	buildBoundaries(*labels);
+	Reset();
+}
+
+ContourOverlay::~ContourOverlay()
+{
+}
+
+void ContourOverlay::Update(const vector<uchar>& nodeLabels, const Mat& background, Mat& overlay, const Vec3b& color /* = Vec3b(0, 255, 0) */)
+{
+	TRACE_SCOPE("contour drawing");
+	if (static_cast<int>(nodeLabels.size()) != m_nodeCount)
+		throw new exception("Node label number not match.");
+	if (background.type() != CV_8UC3 || overlay.type() != CV_8UC3)
+		throw new exception("Image type must be CV_8UC3");
+	if (background.size() != m_size || overlay.size() != m_size)
+		throw new exception("Image size not match.");
+
+	// Collect the adjacencies of the changed components once.
+	m_updatedPixels = 0;
+	vector<int> touched;
+	for (int i = 0; i < m_nodeCount; i++)
+	{
+		if (nodeLabels[i] == m_drawnLabels[i])
+			continue;
+		for (int k = m_nodeEdgeOffsets[i]; k < m_nodeEdgeOffsets[i + 1]; k++)
+		{
+			int edge = m_nodeEdges[k];
+			if (!m_visited[edge])
+			{
+				m_visited[edge] = 1;
+				touched.push_back(edge);
+			}
+		}
+	}
+
+	for each(auto& edge in touched)
+	{
+		m_visited[edge] = 0;
+		int a = m_edgeNodes[edge][0];
+		int b = m_edgeNodes[edge][1];
+		char side = -1;
+		if (nodeLabels[a] != nodeLabels[b])
+			side = nodeLabels[a] ? 0 : 1;
+		if (side == m_drawnSides[edge])
+			continue;
+
+		if (m_drawnSides[edge] >= 0)
+			drawEdge(edge, -1, background, overlay, color);
+		m_drawnSides[edge] = side;
+		if (side >= 0)
+			drawEdge(edge, 1, background, overlay, color);
+	}
+	m_drawnLabels = nodeLabels;
+}
+
+void ContourOverlay::Reset()
+{
+	m_drawnLabels.assign(m_nodeCount, 0);
+	m_drawnSides.assign(m_edgeNodes.size(), -1);
+	m_visited.assign(m_edgeNodes.size(), 0);
+	m_counts = Mat::zeros(m_size, CV_8UC1);
+	m_updatedPixels = 0;
+}
+
+int ContourOverlay::GetUpdatedPixelCount() const
+{
+	return m_updatedPixels;
+}
+
+bool ContourOverlay::IsDrawn(const Point& pos) const
+{
+	return m_counts.at<uchar>(pos) > 0;
+}
+
+void ContourOverlay::buildBoundaries(const LabelMap& labels)
+{
+	m_size = labels.Size();
+	m_edgeNodes.clear();
+	m_edgePixels.clear();
+
+	unordered_map<uint64_t, int> edgeIndex;
+	auto addPair = [&](int a, Point posA, int b, Point posB)
+	{
+		if (a == b)
+			return;
+		if (a > b)
+		{
+			swap(a, b);
+			swap(posA, posB);
+		}
+		uint64_t key = static_cast<uint64_t>(a) << 32 | static_cast<uint32_t>(b);
+		auto it = edgeIndex.find(key);
+		if (it == edgeIndex.end())
+		{
+			it = edgeIndex.emplace(key, static_cast<int>(m_edgeNodes.size())).first;
+			m_edgeNodes.push_back(Vec2i(a - 1, b - 1));
+			m_edgePixels.push_back(vector<Point>());
+		}
+		m_edgePixels[it->second].push_back(posA);
+		m_edgePixels[it->second].push_back(posB);
+	};
+
+	// Every pixel is compared with its right and lower neighbor. Tile borders read the next tile directly.
+	vector<int> rowBuffer, nextBuffer;
+	for (int t = 0; t < labels.TileCount(); t++)
+	{
+		Rect tileRect = labels.TileRect(t);
+		rowBuffer.resize(tileRect.width);
+		nextBuffer.resize(tileRect.width);
+		for (int i = 0; i < tileRect.height; i++)
+		{
+			int y = tileRect.y + i;
+			const int* row = labels.TileRow(t, i, rowBuffer.data());
+			const int* next = i + 1 < tileRect.height ? labels.TileRow(t, i + 1, nextBuffer.data()) : nullptr;
+			for (int j = 0; j < tileRect.width; j++)
+			{
+				int x = tileRect.x + j;
+				if (x + 1 < m_size.width)
+				{
+					int right = j + 1 < tileRect.width ? row[j + 1] : labels.At(Point(x + 1, y));
+					addPair(row[j], Point(x, y), right, Point(x + 1, y));
+				}
+				if (y + 1 < m_size.height)
+				{
+					int below = next ? next[j] : labels.At(Point(x, y + 1));
+					addPair(row[j], Point(x, y), below, Point(x, y + 1));
+				}
+			}
+		}
+	}
+
+	// Index the adjacencies of every component.
+	m_nodeEdgeOffsets.assign(m_nodeCount + 1, 0);
+	for each(auto& nodes in m_edgeNodes)
+	{
+		m_nodeEdgeOffsets[nodes[0] + 1]++;
+		m_nodeEdgeOffsets[nodes[1] + 1]++;
+	}
+	for (int i = 0; i < m_nodeCount; i++)
+		m_nodeEdgeOffsets[i + 1] += m_nodeEdgeOffsets[i];
+	vector<int> position(m_nodeEdgeOffsets.begin(), m_nodeEdgeOffsets.end() - 1);
+	m_nodeEdges.resize(m_nodeEdgeOffsets[m_nodeCount]);
+	for (size_t e = 0; e < m_edgeNodes.size(); e++)
+	{
+		m_nodeEdges[position[m_edgeNodes[e][0]]++] = static_cast<int>(e);
+		m_nodeEdges[position[m_edgeNodes[e][1]]++] = static_cast<int>(e);
+	}
+}
+
+void ContourOverlay::drawEdge(int edge, int delta, const Mat& background, Mat& overlay, const Vec3b& color)
+{
+	const vector<Point>& pixels = m_edgePixels[edge];
+	for (size_t k = m_drawnSides[edge]; k < pixels.size(); k += 2)
+	{
+		const Point& pos = pixels[k];
+		uchar& count = m_counts.at<uchar>(pos);
+		count = static_cast<uchar>(count + delta);
+		if (delta > 0 && count == 1)
+			overlay.at<Vec3b>(pos) = color;
+		else if (delta < 0 && count == 0)
+			overlay.at<Vec3b>(pos) = background.at<Vec3b>(pos);
+		else
+			continue;
+		m_updatedPixels++;
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <memory>
+#include "LabelMap.h"
+
+/// <summary>
+/// Draw the segmentation contours on the super pixel graph. The boundary pixels between every
+/// pair of adjacent components are collected once, so an update only touches the boundaries
+/// of the components whose label changed.
+/// </summary>
+class ContourOverlay
+{
+public:
+	ContourOverlay(const cv::Mat& maskImage, int nodeCount);
+	ContourOverlay(std::shared_ptr<const LabelMap> labels, int nodeCount);
+	~ContourOverlay();
+
+public:
+	/// <summary>
+	/// Update the contours of the changed components on the overlay image.
+	/// The contour is drawn on the foreground side, pixels leaving the contour are restored from the background image.
+	/// </summary>
+	/// <param name="nodeLabels">The label of every component. 1 for foreground and 0 for background.</param>
+	/// <param name="background">The CV_8UC3 image without contours.</param>
+	/// <param name="overlay">The CV_8UC3 image with contours. It must equal the background image plus the contours drawn so far.</param>
+	/// <param name="color">The contour color.</param>
+	void Update(const std::vector<uchar>& nodeLabels, const cv::Mat& background, cv::Mat& overlay, const cv::Vec3b& color = cv::Vec3b(0, 255, 0));
+
+	/// <summary>
+	/// Forget the drawn contours, e.g. after the overlay image was reset to the background.
+	/// </summary>
+	void Reset();
+
+	/// <summary>
+	/// Get the number of pixels written by the last update.
+	/// </summary>
+	int GetUpdatedPixelCount() const;
+
+	/// <summary>
+	/// Check whether a contour is drawn at the pixel, so other drawing on the overlay can keep it.
+	/// </summary>
+	bool IsDrawn(const cv::Point& pos) const;
+
+private:
+	/// <summary>
+	/// Collect the boundary pixel pairs of every adjacency.
+	/// </summary>
+	void buildBoundaries(const LabelMap& labels);
+
+	/// <summary>
+	/// Add or remove the contour pixels of one adjacency.
+	/// </summary>
+	void drawEdge(int edge, int delta, const cv::Mat& background, cv::Mat& overlay, const cv::Vec3b& color);
+
+private:
+	int m_nodeCount;
+	cv::Size m_size;
+	std::vector<cv::Vec2i> m_edgeNodes;					// Components of every adjacency, a < b, 0-based.
+	std::vector<std::vector<cv::Point>> m_edgePixels;	// Pixel pairs of every adjacency, the pixel in a then the pixel in b.
+	std::vector<int> m_nodeEdgeOffsets;					// Adjacencies of every component in CSR layout.
+	std::vector<int> m_nodeEdges;
+
+	std::vector<uchar> m_drawnLabels;	// Labels the current contours are drawn for.
+	std::vector<char> m_drawnSides;		// Drawn side of every adjacency: -1 for none, 0 for a and 1 for b.
+	cv::Mat m_counts;					// Number of drawn cracks covering every pixel.
+	std::vector<uchar> m_visited;		// Scratch flags of the adjacencies collected by an update.
+	int m_updatedPixels;
+};
@@ -0,0 +1,184 @@
+#include "LabelMap.h"
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+void LabelMap::Read(const Rect& area, Mat& dst) const
+{
+	if ((area & Rect(Point(0, 0), Size())) != area)
+		throw new exception("Area out of image bound.");
+
+	dst.create(area.size(), CV_32SC1);
+	vector<int> buffer;
+	for (int t = 0; t < TileCount(); t++)
+	{
+		Rect tileRect = TileRect(t);
+		Rect overlap = tileRect & area;
+		if (overlap.empty())
+			continue;
+		buffer.resize(tileRect.width);
+		for (int i = overlap.y; i < overlap.y + overlap.height; i++)
+		{
+			const int* rowptr = TileRow(t, i - tileRect.y, buffer.data());
+			int* dstptr = dst.ptr<int>(i - area.y);
+			copy(rowptr + overlap.x - tileRect.x, rowptr + overlap.x - tileRect.x + overlap.width, dstptr + overlap.x - area.x);
+		}
+	}
+}
+
+TiledLabelMap::TiledLabelMap(shared_ptr<TiledImage> storage)
+	: m_storage(storage)
+{
+	if (m_storage->Type() != CV_32SC1)
+		throw new exception("Label storage type must be CV_32SC1");
+}
+
+const int* TiledLabelMap::TileRow(int index, int row, int* /* buffer */) const
+{
+	return m_storage->Tile(index).ptr<int>(row);
+}
+
+size_t TiledLabelMap::GetMemoryUsage() const
+{
+	return m_storage->IsMapped() ? 0 : static_cast<size_t>(m_storage->Size().area()) * sizeof(int);
+}
+
+CompactLabelMap::CompactLabelMap(const LabelMap& source, LabelCompression compression, int tileSize /* = 256 */)
+	: m_compression(compression), m_size(source.Size()), m_tileSize(tileSize)
+{
+	if (compression == LabelCompression::None)
+		throw new exception("Compact label map needs a compression");
+	if (tileSize < 16 || tileSize > 65535)
+		throw new exception("Invalid tile size");
+
+	m_tileRows = (m_size.height + tileSize - 1) / tileSize;
+	m_tileCols = (m_size.width + tileSize - 1) / tileSize;
+	m_tiles.resize(m_tileRows * m_tileCols);
+	Mat labels;
+	for (int t = 0; t < TileCount(); t++)
+	{
+		source.Read(TileRect(t), labels);
+		compressTile(labels, m_tiles[t]);
+	}
+}
+
+void CompactLabelMap::compressTile(const Mat& labels, CompactTile& tile) const
+{
+	if (m_compression == LabelCompression::Local16)
+	{
+		for (int i = 0; i < labels.rows; i++)
+		{
+			const int* labelptr = labels.ptr<int>(i);
+			tile.Palette.insert(tile.Palette.end(), labelptr, labelptr + labels.cols);
+		}
+		sort(tile.Palette.begin(), tile.Palette.end());
+		tile.Palette.erase(unique(tile.Palette.begin(), tile.Palette.end()), tile.Palette.end());
+		if (tile.Palette.size() > 65536)
+			throw new exception("Too many ids in one tile for 16-bit labels.");
+		tile.Palette.shrink_to_fit();
+
+		// Neighbor pixels mostly share the id, so the last lookup is reused.
+		tile.Indices.resize(labels.total());
+		ushort* indexptr = tile.Indices.data();
+		int lastLabel = tile.Palette[0];
+		ushort lastIndex = 0;
+		for (int i = 0; i < labels.rows; i++)
+		{
+			const int* labelptr = labels.ptr<int>(i);
+			for (int j = 0; j < labels.cols; j++)
+			{
+				if (labelptr[j] != lastLabel)
+				{
+					lastLabel = labelptr[j];
+					lastIndex = static_cast<ushort>(lower_bound(tile.Palette.begin(), tile.Palette.end(), lastLabel) - tile.Palette.begin());
+				}
+				*indexptr++ = lastIndex;
+			}
+		}
+	}
+	else
+	{
+		tile.RowOffsets.resize(labels.rows + 1);
+		for (int i = 0; i < labels.rows; i++)
+		{
+			const int* labelptr = labels.ptr<int>(i);
+			tile.RowOffsets[i] = static_cast<int>(tile.RunLabels.size());
+			for (int j = 0; j < labels.cols; j++)
+			{
+				if (j == 0 || labelptr[j] != labelptr[j - 1])
+				{
+					tile.RunLabels.push_back(labelptr[j]);
+					tile.RunEnds.push_back(static_cast<ushort>(j + 1));
+				}
+				else
+					tile.RunEnds.back() = static_cast<ushort>(j + 1);
+			}
+		}
+		tile.RowOffsets[labels.rows] = static_cast<int>(tile.RunLabels.size());
+		tile.RunLabels.shrink_to_fit();
+		tile.RunEnds.shrink_to_fit();
+	}
+}
+
+Rect CompactLabelMap::TileRect(int index) const
+{
+	if (index < 0 || index >= TileCount())
+		throw new exception("No such tile.");
+	int x = (index % m_tileCols) * m_tileSize;
+	int y = (index / m_tileCols) * m_tileSize;
+	return Rect(x, y, min(m_tileSize, m_size.width - x), min(m_tileSize, m_size.height - y));
+}
+
+const int* CompactLabelMap::TileRow(int index, int row, int* buffer) const
+{
+	const CompactTile& tile = m_tiles[index];
+	if (m_compression == LabelCompression::Local16)
+	{
+		int width = TileRect(index).width;
+		const ushort* indexptr = tile.Indices.data() + static_cast<size_t>(row) * width;
+		const int* palette = tile.Palette.data();
+		for (int j = 0; j < width; j++)
+			buffer[j] = palette[indexptr[j]];
+	}
+	else
+	{
+		int start = 0;
+		for (int r = tile.RowOffsets[row]; r < tile.RowOffsets[row + 1]; r++)
+		{
+			fill(buffer + start, buffer + tile.RunEnds[r], tile.RunLabels[r]);
+			start = tile.RunEnds[r];
+		}
+	}
+	return buffer;
+}
+
+int CompactLabelMap::At(const Point& pos) const
+{
+	if (pos.x < 0 || pos.x >= m_size.width || pos.y < 0 || pos.y >= m_size.height)
+		throw new exception("Point out out of image bound.");
+
+	int index = (pos.y / m_tileSize) * m_tileCols + pos.x / m_tileSize;
+	const CompactTile& tile = m_tiles[index];
+	int x = pos.x % m_tileSize;
+	int y = pos.y % m_tileSize;
+	if (m_compression == LabelCompression::Local16)
+		return tile.Palette[tile.Indices[static_cast<size_t>(y) * TileRect(index).width + x]];
+
+	// The run ends of a row are increasing.
+	auto first = tile.RunEnds.begin() + tile.RowOffsets[y];
+	auto last = tile.RunEnds.begin() + tile.RowOffsets[y + 1];
+	auto run = upper_bound(first, last, static_cast<ushort>(x));
+	return tile.RunLabels[run - tile.RunEnds.begin()];
+}
+
+size_t CompactLabelMap::GetMemoryUsage() const
+{
+	size_t bytes = 0;
+	for each(auto& tile in m_tiles)
+	{
+		bytes += tile.Palette.capacity() * sizeof(int) + tile.Indices.capacity() * sizeof(ushort)
+			+ tile.RowOffsets.capacity() * sizeof(int) + tile.RunLabels.capacity() * sizeof(int) + tile.RunEnds.capacity() * sizeof(ushort);
+	}
+	return bytes;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <memory>
+#include "TiledImage.h"
+
+/// <summary>
+/// Label map representation.
+/// None keeps 32-bit ids. Local16 stores 16-bit indices into a per tile id table.
+/// RowRle stores every tile row as runs of equal ids.
+/// </summary>
+enum class LabelCompression
+{
+	None,
+	Local16,
+	RowRle
+};
+
+/// <summary>
+/// Read only super pixel id map, accessed tile by tile and row by row.
+/// </summary>
+class LabelMap
+{
+public:
+	virtual ~LabelMap() {}
+
+public:
+	virtual cv::Size Size() const = 0;
+	virtual int TileCount() const = 0;
+	virtual cv::Rect TileRect(int index) const = 0;
+
+	/// <summary>
+	/// Decode one row of a tile.
+	/// </summary>
+	/// <param name="index">The tile index.</param>
+	/// <param name="row">The row inside the tile.</param>
+	/// <param name="buffer">Buffer with at least tile width elements, used if the row is not stored as 32-bit ids.</param>
+	/// <returns>The ids of the row, either pointing into the storage or into the buffer.</returns>
+	virtual const int* TileRow(int index, int row, int* buffer) const = 0;
+
+	/// <summary>
+	/// Get the id of one pixel.
+	/// </summary>
+	virtual int At(const cv::Point& pos) const = 0;
+
+	/// <summary>
+	/// Get the memory used by the labels in bytes. Mapped storage is not counted.
+	/// </summary>
+	virtual size_t GetMemoryUsage() const = 0;
+
+	/// <summary>
+	/// Decode an area of the map, which may span several tiles.
+	/// </summary>
+	void Read(const cv::Rect& area, cv::Mat& dst) const;
+};
+
+/// <summary>
+/// 32-bit id map kept in a tiled image.
+/// </summary>
+class TiledLabelMap : public LabelMap
+{
+public:
+	TiledLabelMap(std::shared_ptr<TiledImage> storage);
+
+public:
+	cv::Size Size() const override { return m_storage->Size(); }
+	int TileCount() const override { return m_storage->TileCount(); }
+	cv::Rect TileRect(int index) const override { return m_storage->TileRect(index); }
+	const int* TileRow(int index, int row, int* buffer) const override;
+	int At(const cv::Point& pos) const override { return m_storage->At<int>(pos); }
+	size_t GetMemoryUsage() const override;
+
+private:
+	std::shared_ptr<TiledImage> m_storage;
+};
+
+/// <summary>
+/// One tile of a compact label map.
+/// </summary>
+struct CompactTile
+{
+	std::vector<int> Palette;			// Local16: local index to id.
+	std::vector<ushort> Indices;		// Local16: local index of every pixel, row major.
+	std::vector<int> RowOffsets;		// RowRle: first run of every row, tile height + 1 elements.
+	std::vector<int> RunLabels;			// RowRle: id of every run.
+	std::vector<ushort> RunEnds;		// RowRle: exclusive end column of every run.
+};
+
+/// <summary>
+/// Compressed id map. Consecutive pixels mostly share one id and a tile has few distinct ids,
+/// so both representations are much smaller than 32-bit ids and cheap to decode row by row.
+/// </summary>
+class CompactLabelMap : public LabelMap
+{
+public:
+	/// <summary>
+	/// Compress a label map.
+	/// </summary>
+	/// <param name="source">The source label map.</param>
+	/// <param name="compression">Local16 or RowRle.</param>
+	/// <param name="tileSize">The tile width and height. A Local16 tile must have at most 65536 distinct ids.</param>
+	CompactLabelMap(const LabelMap& source, LabelCompression compression, int tileSize = 256);
+
+public:
+	cv::Size Size() const override { return m_size; }
+	int TileCount() const override { return m_tileRows * m_tileCols; }
+	cv::Rect TileRect(int index) const override;
+	const int* TileRow(int index, int row, int* buffer) const override;
+	int At(const cv::Point& pos) const override;
+	size_t GetMemoryUsage() const override;
+
+	LabelCompression GetCompression() const { return m_compression; }
+
+private:
+	/// <summary>
+	/// Compress the labels of one tile.
+	/// </summary>
+	void compressTile(const cv::Mat& labels, CompactTile& tile) const;
+
+private:
+	std::vector<CompactTile> m_tiles;
+	LabelCompression m_compression;
+	cv::Size m_size;
+	int m_tileSize;
+	int m_tileRows;
+	int m_tileCols;
+};
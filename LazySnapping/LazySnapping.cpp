@@ -1,52 +1,300 @@
 #include "LazySnapping.h"
+#include "ColorKmeans.h"
+#include "SnappingEnergy.h"
+#include "Trace.h"
 #include <opencv2/highgui.hpp>
 #include <iostream>
+#include <algorithm>
+#include <climits>
+#include <new>
+#include <future>
 
 using namespace std;
 using namespace cv;
 
+// Bits of the paint marks of a component.
+static const uchar ForeMark = 1;
+static const uchar BackMark = 2;
+static const uchar TouchedMark = 4;
+
+/// <summary>
+/// Add a component to or remove it from sorted component ids when its mark changes.
+/// </summary>
+/// <returns>True if the component is removed.</returns>
+static bool updateMarkSet(vector<int>& comps, int comp, bool wasMarked, bool isMarked, vector<int>& added)
+{
+	if (wasMarked == isMarked)
+		return false;
+	auto position = lower_bound(comps.begin(), comps.end(), comp);
+	if (!isMarked)
+	{
+		comps.erase(position);
+		return true;
+	}
+	comps.insert(position, comp);
+	added.push_back(comp);
+	return false;
+}
+
+/// <summary>
+/// Add the colors of components to their nearest clusters and move the cluster means.
+/// </summary>
+static void addToClusters(const vector<Vec3b>& nodeColors, const vector<int>& comps, vector<Vec3b>& colors, vector<Vec3d>& sums, vector<int>& counts)
+{
+	for each(auto& comp in comps)
+	{
+		Vec3d color = nodeColors[comp - 1];
+		size_t nearest = 0;
+		double nearestDistance = norm(color - Vec3d(colors[0]), NORM_L2SQR);
+		for (size_t k = 1; k < colors.size(); k++)
+		{
+			double distance = norm(color - Vec3d(colors[k]), NORM_L2SQR);
+			if (distance < nearestDistance)
+			{
+				nearest = k;
+				nearestDistance = distance;
+			}
+		}
+		sums[nearest] += color;
+		counts[nearest]++;
+		colors[nearest] = Vec3b(saturate_cast<uchar>(sums[nearest][0] / counts[nearest]), saturate_cast<uchar>(sums[nearest][1] / counts[nearest]),
+			saturate_cast<uchar>(sums[nearest][2] / counts[nearest]));
+	}
+}
+
 LazySnapping::LazySnapping(const cv::Mat& maskImage, const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections, int clusterNum /* = 64 */, float e2weight /* = 1000.0 */)
-	: m_maskImage(maskImage), m_nodeColors(nodeColors), m_connections(connections), m_clusterNum(clusterNum), m_e2weight(e2weight)
+	: m_clusterNum(clusterNum), m_e2weight(e2weight), m_e1LookupBits(0), m_statesSynced(false), m_persistencyFixing(false), m_solveDeadline(0), m_solveComplete(true), m_flowGap(0), m_priorWeight(0), m_roiMode(false), m_roiMargin(32), m_labelsValid(false), m_captureProblem(false), m_memoryBudget(0)
 {
-	if (m_maskImage.type() != CV_32SC1)
+	if (maskImage.type() != CV_32SC1)
 		throw new exception("Mask image type must be CV_32SC1");
-	if (m_clusterNum < 1 || m_clusterNum > 100)
-		throw new exception("ClusterNum must be in [1, 100].");
-	if(m_e2weight <= 0)
-		throw new exception("E2 weight must be a positive number.");
 
-	m_segImage.create(m_maskImage.size(), CV_8UC1);
+	m_model = make_shared<SnappingModel>(make_shared<TiledLabelMap>(make_shared<TiledImage>(maskImage)), nodeColors, connections);
+	m_segmentation = make_shared<TiledImage>(Mat(maskImage.size(), CV_8UC1));
+	initialize();
+}
 
-	int edgeCount = 0;
-	for each(auto& item in m_connections)
-		edgeCount += item.Edges.size();
+LazySnapping::LazySnapping(shared_ptr<TiledImage> labels, shared_ptr<TiledImage> segmentation, const vector<Vec3b>& nodeColors, const vector<Connection>& connections, int clusterNum /* = 64 */, float e2weight /* = 1000.0 */)
+	: m_model(make_shared<SnappingModel>(make_shared<TiledLabelMap>(labels), nodeColors, connections)), m_segmentation(segmentation), m_clusterNum(clusterNum), m_e2weight(e2weight), m_e1LookupBits(0), m_statesSynced(false), m_persistencyFixing(false), m_solveDeadline(0), m_solveComplete(true), m_flowGap(0), m_priorWeight(0), m_roiMode(false), m_roiMargin(32), m_labelsValid(false), m_captureProblem(false), m_memoryBudget(0)
+{
+	initialize();
+}
 
-	m_graph = make_unique<Graph<float, float, float>>(m_connections.size(), edgeCount * 2);
+LazySnapping::LazySnapping(shared_ptr<const LabelMap> labels, shared_ptr<TiledImage> segmentation, const vector<Vec3b>& nodeColors, const vector<Connection>& connections, int clusterNum /* = 64 */, float e2weight /* = 1000.0 */)
+	: m_model(make_shared<SnappingModel>(labels, nodeColors, connections)), m_segmentation(segmentation), m_clusterNum(clusterNum), m_e2weight(e2weight), m_e1LookupBits(0), m_statesSynced(false), m_persistencyFixing(false), m_solveDeadline(0), m_solveComplete(true), m_flowGap(0), m_priorWeight(0), m_roiMode(false), m_roiMargin(32), m_labelsValid(false), m_captureProblem(false), m_memoryBudget(0)
+{
+	initialize();
+}
+
+LazySnapping::LazySnapping(shared_ptr<const SnappingModel> model, shared_ptr<TiledImage> segmentation, int clusterNum /* = 64 */, float e2weight /* = 1000.0 */)
+	: m_model(model), m_segmentation(segmentation), m_clusterNum(clusterNum), m_e2weight(e2weight), m_e1LookupBits(0), m_statesSynced(false), m_persistencyFixing(false), m_solveDeadline(0), m_solveComplete(true), m_flowGap(0), m_priorWeight(0), m_roiMode(false), m_roiMargin(32), m_labelsValid(false), m_captureProblem(false), m_memoryBudget(0)
+{
+	if (!m_model)
+		throw new exception("Model must not be null");
+	initialize();
+}
+
+LazySnapping::LazySnapping(shared_ptr<const SnappingModel> model, int clusterNum /* = 64 */, float e2weight /* = 1000.0 */)
+	: m_model(model), m_clusterNum(clusterNum), m_e2weight(e2weight), m_e1LookupBits(0), m_statesSynced(false), m_persistencyFixing(false), m_solveDeadline(0), m_solveComplete(true), m_flowGap(0), m_priorWeight(0), m_roiMode(false), m_roiMargin(32), m_labelsValid(false), m_captureProblem(false), m_memoryBudget(0)
+{
+	if (!m_model)
+		throw new exception("Model must not be null");
+	m_segmentation = make_shared<TiledImage>(Mat(m_model->GetLabels()->Size(), CV_8UC1));
+	initialize();
 }
 
 LazySnapping::~LazySnapping()
 {
 }
 
+void LazySnapping::initialize()
+{
+	if (m_segmentation->Type() != CV_8UC1 || m_segmentation->Size() != m_model->GetLabels()->Size())
+		throw new exception("Segmentation storage must be CV_8UC1 with the label size");
+	if (m_segmentation->IsMapped())
+	{
+		if (m_segmentation->TileCount() != m_model->GetLabels()->TileCount())
+			throw new exception("Label and segmentation storages must have the same tile layout");
+		for (int t = 0; t < m_model->GetLabels()->TileCount(); t++)
+		{
+			if (m_model->GetLabels()->TileRect(t) != m_segmentation->TileRect(t))
+				throw new exception("Label and segmentation storages must have the same tile layout");
+		}
+	}
+	if (m_clusterNum < 1 || m_clusterNum > 100)
+		throw new exception("ClusterNum must be in [1, 100].");
+	if(m_e2weight <= 0)
+		throw new exception("E2 weight must be a positive number.");
+
+	// Each adjacency is stored once and becomes one add_edge call with two arcs.
+	m_graph = make_unique<Graph<float, float, float>>(m_model->GetNodeCount(), m_model->GetEdgeCount());
+	m_nodeLabels.assign(m_model->GetNodeCount(), 0);
+	m_adjWeights.resize(m_model->GetAdjNodes().size());
+}
 
 bool LazySnapping::Process(cv::Mat& paintImage, bool showSegmentation /* = false */)
 {
-	if (!setMarkPoints(paintImage))
+	TRACE_SCOPE("LazySnapping::Process");
+	m_paramWeights.clear();
+
+	// Only rescan the marks under the reported paint if the marks of the previous paint are known.
+	Rect region = m_paintRegion & Rect(Point(0, 0), paintImage.size());
+	m_paintRegion = Rect();
+	bool incremental = region.area() > 0 && m_nodeMarks.size() == m_model->GetNodeColors().size();
+	if (!setMarkPoints(paintImage, incremental ? region : Rect()))
 		return false;
-	runMaxFlow();
-	BuildSegmentation();
-	if (showSegmentation)
-		imshow(SegWindowName, m_segImage);
+	m_solveComplete = true;
+	m_flowGap = 0;
+
+	// Only re-solve around the new strokes if there is a previous labeling to keep outside.
+	Rect window;
+	if (m_roiMode && m_labelsValid && incremental)
+		window = Rect(region.tl() - Point(m_roiMargin, m_roiMargin), region.br() + Point(m_roiMargin, m_roiMargin)) & Rect(Point(0, 0), paintImage.size());
+
+	enforceMemoryBudget();
+	try
+	{
+		runMaxFlow(window);
+	}
+	catch (const bad_alloc&)
+	{
+		cancelSolve();
+		return false;
+	}
+	BuildSegmentation(m_solveRegion);
+	if (showSegmentation && !m_segmentation->IsMapped())
+		imshow(SegWindowName, m_segmentation->Tile(0));
+	return true;
+}
+
+bool LazySnapping::ProcessPropagated(const vector<Vec3b>& foreColors, const vector<Vec3b>& backColors, const vector<float>& foreProbability, float priorWeight, bool showSegmentation /* = false */)
+{
+	if (foreColors.empty() || backColors.empty())
+	{
+		cout << "Color models must not be empty." << endl;
+		return false;
+	}
+	if (foreProbability.size() != m_model->GetNodeColors().size())
+		throw new exception("Foreground probability must have one value per node.");
+	if (priorWeight < 0 || priorWeight > 1)
+	{
+		cout << "Prior weight must be in [0, 1]." << endl;
+		return false;
+	}
+
+	m_paramWeights.clear();
+	m_foreComps.clear();
+	m_backComps.clear();
+	m_nodeMarks.clear();
+	m_paintRegion = Rect();
+	m_foreColors = foreColors;
+	m_backColors = backColors;
+	m_foreSums.clear();
+	m_backSums.clear();
+	m_nodePrior = foreProbability;
+	m_priorWeight = priorWeight;
+
+	enforceMemoryBudget();
+	try
+	{
+		runMaxFlow();
+	}
+	catch (const bad_alloc&)
+	{
+		cancelSolve();
+		return false;
+	}
+	BuildSegmentation(Rect(Point(0, 0), m_model->GetLabels()->Size()));
+	if (showSegmentation && !m_segmentation->IsMapped())
+		imshow(SegWindowName, m_segmentation->Tile(0));
 	return true;
 }
 
+void LazySnapping::GetColorModels(vector<Vec3b>& foreColors, vector<Vec3b>& backColors) const
+{
+	foreColors = m_foreColors;
+	backColors = m_backColors;
+}
+
 Mat LazySnapping::GetSegmentation() const
 {
 	Mat res;
-	m_segImage.copyTo(res);
+	if (m_segmentation->IsMapped())
+		m_segmentation->Read(Rect(Point(0, 0), m_segmentation->Size()), res);
+	else
+		m_segmentation->Tile(0).copyTo(res);
 	return res;
 }
 
+shared_ptr<TiledImage> LazySnapping::GetSegmentationStorage() const
+{
+	return m_segmentation;
+}
+
+const vector<uchar>& LazySnapping::GetNodeLabels() const
+{
+	return m_nodeLabels;
+}
+
+void LazySnapping::GetMarks(vector<int>& foreComps, vector<int>& backComps) const
+{
+	foreComps = m_foreComps;
+	backComps = m_backComps;
+}
+
+void LazySnapping::RestoreResult(const vector<int>& foreComps, const vector<int>& backComps,
+	const vector<Vec3b>& foreColors, const vector<Vec3b>& backColors,
+	const vector<uchar>& nodeLabels, bool showSegmentation /* = false */)
+{
+	if (nodeLabels.size() != m_model->GetNodeColors().size())
+		throw new exception("Node label number not match.");
+
+	m_paramWeights.clear();
+	m_nodePrior.clear();
+	m_foreComps = foreComps;
+	m_backComps = backComps;
+	m_foreColors = foreColors;
+	m_backColors = backColors;
+	m_foreSums.clear();
+	m_backSums.clear();
+
+	// The restored marks belong to the restored paint, so later strokes still only rescan their own area.
+	m_nodeMarks.assign(nodeLabels.size(), 0);
+	for each(auto& comp in m_foreComps)
+		m_nodeMarks[comp - 1] |= ForeMark;
+	for each(auto& comp in m_backComps)
+		m_nodeMarks[comp - 1] |= BackMark;
+	m_paintRegion = Rect();
+
+	// Rebuild the segmentation over the components whose label changes.
+	const vector<Rect>& nodeBounds = m_model->GetNodeBounds();
+	Rect region;
+	for (size_t i = 0; i < nodeLabels.size(); i++)
+	{
+		if (nodeLabels[i] != m_nodeLabels[i] && nodeBounds[i].area() > 0)
+			region = region.area() > 0 ? (region | nodeBounds[i]) : nodeBounds[i];
+	}
+	m_nodeLabels = nodeLabels;
+	m_labelsValid = true;
+	m_statesSynced = false;
+	m_solveComplete = true;
+	m_flowGap = 0;
+	m_solveRegion = region;
+	if (region.area() > 0)
+		BuildSegmentation(region);
+	if (showSegmentation && !m_segmentation->IsMapped())
+		imshow(SegWindowName, m_segmentation->Tile(0));
+}
+
+shared_ptr<const LabelMap> LazySnapping::GetLabelMap() const
+{
+	return m_model->GetLabels();
+}
+
+shared_ptr<const SnappingModel> LazySnapping::GetModel() const
+{
+	return m_model;
+}
+
 void LazySnapping::SetClusterNum(int num)
 {
 	if (num < 1 || num > 100)
@@ -66,193 +314,862 @@ void LazySnapping::SetE2Weight(float weight)
 	}
 	m_e2weight = weight;
 }
+
+void LazySnapping::SetE1LookupBits(int bits)
+{
+	if (bits < 0 || bits > MaxE1LookupBits)
+	{
+		cout << "Lookup bits must be in [0, " << MaxE1LookupBits << "]." << endl;
+		return;
+	}
+	if (bits != m_e1LookupBits)
+		m_e1Table.clear();
+	m_e1LookupBits = bits;
+}
+
+void LazySnapping::SetRoiMode(bool enable, int margin /* = 32 */)
+{
+	if (margin < 0)
+	{
+		cout << "ROI margin must not be negative." << endl;
+		return;
+	}
+	m_roiMode = enable;
+	m_roiMargin = margin;
+}
+
+void LazySnapping::AddPaintRegion(const Rect& region)
+{
+	m_paintRegion = m_paintRegion.area() > 0 ? (m_paintRegion | region) : region;
+}
+
+void LazySnapping::ResetRoi()
+{
+	m_nodeMarks.clear();
+	m_paintRegion = Rect();
+	m_labelsValid = false;
+}
+
+Rect LazySnapping::GetSolveRegion() const
+{
+	return m_solveRegion;
+}
+
+void LazySnapping::SetPersistencyFixing(bool enable)
+{
+	m_persistencyFixing = enable;
+}
+
+int LazySnapping::GetSolvedNodeCount() const
+{
+	return m_graph->get_node_num();
+}
+
+void LazySnapping::SetLabelCompression(LabelCompression compression, int tileSize /* = 256 */)
+{
+	if (m_segmentation->IsMapped())
+		throw new exception("Compact labels need an in-memory segmentation storage");
+
+	shared_ptr<const LabelMap> labels;
+	if (compression == LabelCompression::None)
+	{
+		Mat maskImage;
+		m_model->GetLabels()->Read(Rect(Point(0, 0), m_model->GetLabels()->Size()), maskImage);
+		labels = make_shared<TiledLabelMap>(make_shared<TiledImage>(maskImage));
+	}
+	else
+		labels = make_shared<CompactLabelMap>(*m_model->GetLabels(), compression, tileSize);
+
+	// Other sessions may share the model, so switch to a copy with the new labels.
+	m_model = make_shared<SnappingModel>(*m_model, labels);
+}
 	
 // Todo: change cluster number.
-bool LazySnapping::setMarkPoints(cv::Mat& paintImage)
+bool LazySnapping::setMarkPoints(cv::Mat& paintImage, const Rect& region /* = Rect() */)
 {
-	if (paintImage.size() != m_maskImage.size())
+	TRACE_SCOPE("setMarkPoints");
+	m_nodePrior.clear();
+	if (paintImage.size() != m_model->GetLabels()->Size())
 		throw new exception("Image size not match.");
 	if (paintImage.type() != CV_8UC1)
 		throw new exception("Image type must be CV_8UC1");
 
 	// Get foreground and background components' ids.
-	m_foreComps.clear();
-	m_backComps.clear();
-	for (int i = 0; i < m_maskImage.rows; i++)
-	{
-		int* maskptr = m_maskImage.ptr<int>(i);
-		uchar* paintptr = paintImage.ptr<uchar>(i);
-		for (int j = 0; j < m_maskImage.cols; j++)
-		{
-			if(paintptr[j] == 1)		// Foreground.
-				m_foreComps.push_back(maskptr[j]);
-			else if(paintptr[j] == 2)	// Background.
-				m_backComps.push_back(maskptr[j]);
-		}
-	}
+	vector<int> addedFore, addedBack;
+	bool removed = false;
+	if (region.area() > 0)
+		removed = updateNodeMarks(paintImage, region, addedFore, addedBack);
+	else
+		scanNodeMarks(paintImage);
 
 	if (m_foreComps.size() == 0 || m_backComps.size() == 0)
 		return false;
 
-	// Remove redundant ids.
-	sort(m_foreComps.begin(), m_foreComps.end());
-	auto end_unique = unique(m_foreComps.begin(), m_foreComps.end());
-	m_foreComps.erase(end_unique, m_foreComps.end());
-	sort(m_backComps.begin(), m_backComps.end());
-	end_unique = unique(m_backComps.begin(), m_backComps.end());
-	m_backComps.erase(end_unique, m_backComps.end());
+	// Strokes that only add marks to full color models move the nearest cluster means instead of clustering again.
+	size_t clusterNum = static_cast<size_t>(m_clusterNum);
+	if (region.area() > 0 && !removed && m_foreSums.size() == clusterNum && m_backSums.size() == clusterNum)
+	{
+		addToClusters(m_model->GetNodeColors(), addedFore, m_foreColors, m_foreSums, m_foreCounts);
+		addToClusters(m_model->GetNodeColors(), addedBack, m_backColors, m_backSums, m_backCounts);
+		return true;
+	}
 
 	// Use kmeans method to get cluster colors.
-	// Must use float data type to do kmeans.
-	vector<Vec3f> foreColors;
-	vector<Vec3f> backColors;
-	for each(auto& colorComp in m_foreComps)
-		foreColors.push_back(m_nodeColors[colorComp - 1]);
-	for each(auto& colorComp in m_backComps)
-		backColors.push_back(m_nodeColors[colorComp - 1]);
+	// Foreground and background are independent, so the background is clustered on another thread.
+	ColorKmeans foreKmeans(m_clusterNum);
+	ColorKmeans backKmeans(m_clusterNum);
+	{
+		TRACE_SCOPE("kmeans");
+		// The future passes an exception of the background clustering on to the caller.
+		future<void> backDone = async(launch::async, [this, &backKmeans]() { backKmeans.Process(m_model->GetNodeColors(), m_backComps); });
+		foreKmeans.Process(m_model->GetNodeColors(), m_foreComps);
+		backDone.get();
+	}
+	m_foreColors = foreKmeans.GetColors();
+	m_backColors = backKmeans.GetColors();
+	m_foreSums = foreKmeans.GetSums();
+	m_foreCounts = foreKmeans.GetCounts();
+	m_backSums = backKmeans.GetSums();
+	m_backCounts = backKmeans.GetCounts();
+	return true;
+}
+
+void LazySnapping::scanNodeMarks(const Mat& paintImage)
+{
+	m_nodeMarks.assign(m_model->GetNodeCount(), 0);
+	vector<int> buffer;
+	for (int t = 0; t < m_model->GetLabels()->TileCount(); t++)
+	{
+		Rect tileRect = m_model->GetLabels()->TileRect(t);
+		Mat paint = paintImage(tileRect);
+		buffer.resize(tileRect.width);
+		for (int i = 0; i < tileRect.height; i++)
+		{
+			const int* maskptr = m_model->GetLabels()->TileRow(t, i, buffer.data());
+			const uchar* paintptr = paint.ptr<uchar>(i);
+			for (int j = 0; j < tileRect.width; j++)
+			{
+				if(paintptr[j] == 1)		// Foreground.
+					m_nodeMarks[maskptr[j] - 1] |= ForeMark;
+				else if(paintptr[j] == 2)	// Background.
+					m_nodeMarks[maskptr[j] - 1] |= BackMark;
+			}
+		}
+	}
 
-	vector<int> foreLabels;
-	vector<int> backLabels;
-	int foreClusterNum = min(static_cast<int>(m_foreComps.size()), m_clusterNum);
-	int backClusterNum = min(static_cast<int>(m_backComps.size()), m_clusterNum);
-	// Todo: adjust kmeans parameters.
-	kmeans(foreColors, foreClusterNum, foreLabels, TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 10, 1.0), 3, KMEANS_PP_CENTERS);
-	kmeans(backColors, backClusterNum, backLabels, TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 10, 1.0), 3, KMEANS_PP_CENTERS);
+	// Collecting in node order leaves the ids sorted and unique.
+	m_foreComps.clear();
+	m_backComps.clear();
+	for (size_t i = 0; i < m_nodeMarks.size(); i++)
+	{
+		if (m_nodeMarks[i] & ForeMark)
+			m_foreComps.push_back(static_cast<int>(i) + 1);
+		if (m_nodeMarks[i] & BackMark)
+			m_backComps.push_back(static_cast<int>(i) + 1);
+	}
+}
 
-	vector<Vec3i> tempForeColors(foreClusterNum, Vec3i(0, 0, 0));
-	vector<Vec3i> tempBackColors(backClusterNum, Vec3i(0, 0, 0));
-	m_foreColors.resize(foreClusterNum, Vec3b(0, 0, 0));
-	m_backColors.resize(backClusterNum, Vec3b(0, 0, 0));
-	vector<int> counter(foreClusterNum, 0);
-	for (size_t i = 0; i < foreLabels.size(); i++)
+bool LazySnapping::updateNodeMarks(const Mat& paintImage, const Rect& region, vector<int>& addedFore, vector<int>& addedBack)
+{
+	// Find the components under the changed paint.
+	const vector<Rect>& nodeBounds = m_model->GetNodeBounds();
+	Mat labels;
+	m_model->GetLabels()->Read(region, labels);
+	vector<int> touched;
+	vector<uchar> oldMarks;
+	Rect area;
+	for (int i = 0; i < labels.rows; i++)
 	{
-		tempForeColors[foreLabels[i]] += foreColors[i];
-		counter[foreLabels[i]]++;
+		const int* labelptr = labels.ptr<int>(i);
+		for (int j = 0; j < labels.cols; j++)
+		{
+			int node = labelptr[j] - 1;
+			if (m_nodeMarks[node] & TouchedMark)
+				continue;
+			touched.push_back(node);
+			oldMarks.push_back(m_nodeMarks[node]);
+			m_nodeMarks[node] = TouchedMark;
+			area = area.area() > 0 ? (area | nodeBounds[node]) : nodeBounds[node];
+		}
 	}
-	for(int i = 0; i < foreClusterNum; i++)
+
+	// A component may be marked outside the changed paint too, so recount its marks over its whole area.
+	m_model->GetLabels()->Read(area, labels);
+	Mat paint = paintImage(area);
+	for (int i = 0; i < labels.rows; i++)
 	{
-		if (counter[i] == 0)
-			throw new exception("Cluster has no element.");
-		m_foreColors[i] = tempForeColors[i] / counter[i];
+		const int* labelptr = labels.ptr<int>(i);
+		const uchar* paintptr = paint.ptr<uchar>(i);
+		for (int j = 0; j < labels.cols; j++)
+		{
+			uchar& marks = m_nodeMarks[labelptr[j] - 1];
+			if (!(marks & TouchedMark))
+				continue;
+			if (paintptr[j] == 1)
+				marks |= ForeMark;
+			else if (paintptr[j] == 2)
+				marks |= BackMark;
+		}
 	}
-	counter.resize(backClusterNum, 0);
-	for (size_t i = 0; i < backLabels.size(); i++)
+
+	bool removed = false;
+	for (size_t k = 0; k < touched.size(); k++)
 	{
-		tempBackColors[backLabels[i]] += backColors[i];
-		counter[backLabels[i]]++;
+		int node = touched[k];
+		m_nodeMarks[node] &= static_cast<uchar>(~TouchedMark);
+		removed |= updateMarkSet(m_foreComps, node + 1, (oldMarks[k] & ForeMark) != 0, (m_nodeMarks[node] & ForeMark) != 0, addedFore);
+		removed |= updateMarkSet(m_backComps, node + 1, (oldMarks[k] & BackMark) != 0, (m_nodeMarks[node] & BackMark) != 0, addedBack);
 	}
-	for (int i = 0; i < backClusterNum; i++)
+	return removed;
+}
+
+void LazySnapping::updateE1Table()
+{
+	if (m_e1LookupBits == 0)
 	{
-		if (counter[i] == 0)
-			throw new exception("Cluster has no element.");
-		m_backColors[i] = tempBackColors[i] / counter[i];
+		m_e1Table.clear();
+		return;
 	}
+	// Undo, redo and strokes that keep the clusters leave the color models, and so the table, unchanged.
+	if (!m_e1Table.empty() && m_e1TableForeColors == m_foreColors && m_e1TableBackColors == m_backColors)
+		return;
+	m_e1TableForeColors = m_foreColors;
+	m_e1TableBackColors = m_backColors;
 
-	return true;
+	// Evaluate every bin at its center color. Blue planes are built in parallel.
+	TRACE_SCOPE("e1 table");
+	int bins = 1 << m_e1LookupBits;
+	int shift = 8 - m_e1LookupBits;
+	int half = (1 << shift) / 2;
+	m_e1Table.resize(static_cast<size_t>(bins) * bins * bins);
+	parallel_for_(Range(0, bins), [&](const Range& range)
+	{
+		for (int b = range.start; b < range.end; b++)
+		{
+			float* tableptr = m_e1Table.data() + static_cast<size_t>(b) * bins * bins;
+			for (int g = 0; g < bins; g++)
+			{
+				for (int r = 0; r < bins; r++)
+				{
+					Vec3b color(static_cast<uchar>((b << shift) + half), static_cast<uchar>((g << shift) + half), static_cast<uchar>((r << shift) + half));
+					float df = MinColorDistance(color, m_foreColors);
+					float db = MinColorDistance(color, m_backColors);
+					*tableptr++ = (df + db > 0) ? df / (df + db) : 0.5f;
+				}
+			}
+		}
+	});
 }
 
 // Todo: analyze max flow graph build process.
-void LazySnapping::runMaxFlow()
+void LazySnapping::runMaxFlow(const Rect& window /* = Rect() */)
 {
-	m_graph->reset();
-	// Add nodes.
-	for (size_t i = 0; i < m_nodeColors.size(); i++)
+	buildReducedGraph(1.0f, 1.0f, m_persistencyFixing, window);
+	if (m_solveDeadline > 0)
+	{
+		int64 start = getTickCount();
+		{
+			TRACE_SCOPE("maxflow first slice");
+			m_solveComplete = m_graph->maxflow_limited(GrowthSlice);
+		}
+		continueMaxFlow(start);
+	}
+	else
+	{
+		TRACE_SCOPE("maxflow");
+		m_graph->maxflow();
+		m_solveComplete = true;
+		m_flowGap = 0;
+	}
+	readNodeLabels();
+}
+
+void LazySnapping::continueMaxFlow(int64 start)
+{
+	TRACE_SCOPE("maxflow resume");
+	double tickToMs = 1000.0 / getTickFrequency();
+	while (!m_solveComplete && (getTickCount() - start) * tickToMs < m_solveDeadline)
+		m_solveComplete = m_graph->maxflow_resume(GrowthSlice);
+	m_flowGap = m_solveComplete ? 0 : calFlowGap();
+}
+
+void LazySnapping::cancelSolve()
+{
+	cout << "Not enough memory for the graph, process is cancelled." << endl;
+	m_labelsValid = false;
+	m_statesSynced = false;
+	m_solveComplete = true;
+	m_flowGap = 0;
+}
+
+float LazySnapping::calFlowGap()
+{
+	typedef Graph<float, float, float> GraphType;
+
+	// The capacity of any cut equals the flow plus the residual capacity across it.
+	float gap = 0;
+	for (int i = 0; i < m_graph->get_node_num(); i++)
 	{
-		m_graph->add_node();
-		Point2f e1 = calE1(i + 1);
-		m_graph->add_tweights(i, e1.x, e1.y);
+		float trcap = m_graph->get_trcap(i);
+		if (m_graph->what_segment(i) == GraphType::SOURCE)
+			gap += max(-trcap, 0.0f);
+		else
+			gap += max(trcap, 0.0f);
 	}
-	// Add edges.
-	int startId, endId;
-	for each(auto& connection in m_connections)
+	GraphType::arc_id arc = m_graph->get_first_arc();
+	for (int k = 0; k < m_graph->get_arc_num(); k++, arc = m_graph->get_next_arc(arc))
 	{
-		startId = connection.Id;
-		for each(auto& item in connection.Edges)
+		int from, to;
+		m_graph->get_arc_ends(arc, from, to);
+		if (m_graph->what_segment(from) == GraphType::SOURCE && m_graph->what_segment(to) == GraphType::SINK)
+			gap += m_graph->get_rcap(arc);
+	}
+	return gap;
+}
+
+bool LazySnapping::ResumeSolve(bool showSegmentation /* = false */)
+{
+	if (m_solveComplete)
+		return true;
+
+	int64 start = getTickCount();
+	try
+	{
+		if (m_solveDeadline > 0)
+		{
+			continueMaxFlow(start);
+		}
+		else
 		{
-			endId = item.Id;
-			float e2 = calE2(startId, endId);
-			m_graph->add_edge(startId - 1, endId - 1, e2, e2);
+			TRACE_SCOPE("maxflow resume");
+			m_solveComplete = m_graph->maxflow_resume(0);
+			m_flowGap = 0;
 		}
 	}
+	catch (const bad_alloc&)
+	{
+		cancelSolve();
+		return false;
+	}
+	readNodeLabels();
+	BuildSegmentation(m_solveRegion);
+	if (showSegmentation && !m_segmentation->IsMapped())
+		imshow(SegWindowName, m_segmentation->Tile(0));
+	return m_solveComplete;
+}
 
-	m_graph->maxflow();
+void LazySnapping::SetSolveDeadline(double milliseconds)
+{
+	if (milliseconds < 0)
+	{
+		cout << "Solve deadline must not be negative." << endl;
+		return;
+	}
+	m_solveDeadline = milliseconds;
+}
+
+bool LazySnapping::IsSolveComplete() const
+{
+	return m_solveComplete;
+}
+
+float LazySnapping::GetFlowGap() const
+{
+	return m_flowGap;
+}
+
+void LazySnapping::SetProblemCapture(bool enable)
+{
+	m_captureProblem = enable;
+	if (!enable)
+		m_lastProblem = CutProblem();
+}
+
+const CutProblem& LazySnapping::GetLastProblem() const
+{
+	return m_lastProblem;
+}
+
+void LazySnapping::GetMemoryReport(MemoryReport& report) const
+{
+	m_model->GetMemoryReport(report);
+	report.Add("segmentation", m_segmentation->IsMapped() ? 0 : static_cast<size_t>(m_segmentation->Size().area()));
+	report.Add("edge weights", VectorBytes(m_adjWeights));
+	report.Add("node state", VectorBytes(m_nodeStates) + VectorBytes(m_solveNodes) + VectorBytes(m_graphNodes) + VectorBytes(m_e1) + VectorBytes(m_tlinks)
+		+ VectorBytes(m_freeWeights) + VectorBytes(m_nodeLabels) + VectorBytes(m_nodePrior));
+	report.Add("graph", m_graph->get_memory_usage());
+	report.Add("color models", VectorBytes(m_foreComps) + VectorBytes(m_backComps) + VectorBytes(m_foreColors) + VectorBytes(m_backColors) + VectorBytes(m_e1Table)
+		+ VectorBytes(m_e1TableForeColors) + VectorBytes(m_e1TableBackColors) + VectorBytes(m_foreSums) + VectorBytes(m_foreCounts) + VectorBytes(m_backSums) + VectorBytes(m_backCounts));
+	report.Add("parametric", VectorBytes(m_paramWeights) + VectorBytes(m_paramLabels) + VectorBytes(m_switchWeights));
+	report.Add("marks", VectorBytes(m_nodeMarks));
+	report.Add("captured problem", VectorBytes(m_lastProblem.TerminalCaps) + VectorBytes(m_lastProblem.Edges) + VectorBytes(m_lastProblem.EdgeCaps));
+}
+
+size_t LazySnapping::GetMemoryUsage() const
+{
+	MemoryReport report;
+	GetMemoryReport(report);
+	return report.Total();
+}
+
+void LazySnapping::SetMemoryBudget(size_t bytes)
+{
+	m_memoryBudget = bytes;
+	enforceMemoryBudget();
 }
 
-void LazySnapping::BuildSegmentation()
+void LazySnapping::enforceMemoryBudget()
 {
-	m_segImage = Scalar::all(0);
-	for (int i = 0; i < m_segImage.rows; i++)
+	if (m_memoryBudget == 0)
 	{
-		int* maskptr = m_maskImage.ptr<int>(i);
-		uchar* segptr = m_segImage.ptr<uchar>(i);
-		for (int j = 0; j < m_segImage.cols; j++)
+		m_graph->set_memory_limit(0);
+		return;
+	}
+
+	// A model shared with other sessions is left alone, as a compressed copy would add to the memory.
+	size_t usage = GetMemoryUsage();
+	if (usage > m_memoryBudget && !m_segmentation->IsMapped() && m_model.use_count() == 1
+		&& !dynamic_cast<const CompactLabelMap*>(m_model->GetLabels().get()))
+	{
+		SetLabelCompression(LabelCompression::RowRle);
+		usage = GetMemoryUsage();
+	}
+	// The graph is allocated for all nodes; a reduced graph usually needs much less. An incomplete solve still needs its graph.
+	if (usage > m_memoryBudget && m_solveComplete)
+	{
+		auto graph = make_unique<Graph<float, float, float>>(m_graph->get_node_num(), m_graph->get_arc_num() / 2);
+		if (graph->get_memory_usage() < m_graph->get_memory_usage())
 		{
-			if (m_graph->what_segment(maskptr[j] - 1) == Graph<float, float, float>::SINK)
-				segptr[j] = 255;
+			m_graph = move(graph);
+			usage = GetMemoryUsage();
 		}
 	}
+
+	size_t graphBytes = m_graph->get_memory_usage();
+	size_t otherBytes = usage - graphBytes;
+	m_graph->set_memory_limit(otherBytes < m_memoryBudget ? m_memoryBudget - otherBytes : 1);
 }
 
-Point2f LazySnapping::calE1(int compId)
+void LazySnapping::buildReducedGraph(float e1Scale, float e2Scale, bool fixPersistent, const Rect& window /* = Rect() */)
 {
-	if (compId < 1 || compId > static_cast<int>(m_nodeColors.size()))
-		throw new exception("No such component id.");
+	TRACE_SCOPE("graph build");
+	int nodeCount = m_model->GetNodeCount();
+	const vector<int>& adjOffsets = m_model->GetAdjOffsets();
+	const vector<int>& adjNodes = m_model->GetAdjNodes();
+	const vector<Rect>& nodeBounds = m_model->GetNodeBounds();
+
+	// Nodes outside the solve window keep their previous label, which freezes the ring around it.
+	// Only the nodes under the window are visited, the states of the others already hold their labels.
+	if (window.area() > 0)
+	{
+		if (!m_statesSynced)
+		{
+			m_nodeStates.resize(nodeCount);
+			m_solveNodes.resize(nodeCount);
+			for (int i = 0; i < nodeCount; i++)
+				m_solveNodes[i] = i;
+		}
+		for each(auto& i in m_solveNodes)
+			m_nodeStates[i] = m_nodeLabels[i] ? NodeState::Fore : NodeState::Back;
 
+		Mat labels;
+		m_model->GetLabels()->Read(window, labels);
+		m_solveNodes.clear();
+		m_solveRegion = Rect();
+		for (int y = 0; y < labels.rows; y++)
+		{
+			const int* labelptr = labels.ptr<int>(y);
+			for (int x = 0; x < labels.cols; x++)
+			{
+				int i = labelptr[x] - 1;
+				if (m_nodeStates[i] == NodeState::Free)
+					continue;
+				m_nodeStates[i] = NodeState::Free;
+				m_solveNodes.push_back(i);
+				m_solveRegion = m_solveRegion.area() > 0 ? (m_solveRegion | nodeBounds[i]) : nodeBounds[i];
+			}
+		}
+	}
+	else
+	{
+		m_nodeStates.assign(nodeCount, NodeState::Free);
+		m_solveNodes.resize(nodeCount);
+		for (int i = 0; i < nodeCount; i++)
+			m_solveNodes[i] = i;
+		m_solveRegion = Rect(Point(0, 0), m_model->GetLabels()->Size());
+	}
+	m_statesSynced = true;
+
+	// Marked nodes are hard constraints. A node marked both ways is foreground, as in calE1.
+	// Marked nodes outside the window already hold the labels of their marks.
 	for each(auto& comp in m_foreComps)
 	{
-		// In the foreground.
-		if (compId == comp)
-			return Point2f(0, Infinite);
+		if (m_nodeStates[comp - 1] == NodeState::Free)
+			m_nodeStates[comp - 1] = NodeState::Fore;
 	}
 	for each(auto& comp in m_backComps)
 	{
-		// In the background.
-		if (compId == comp)
-			return Point2f(Infinite, 0);
+		if (m_nodeStates[comp - 1] == NodeState::Free)
+			m_nodeStates[comp - 1] = NodeState::Back;
+	}
+
+	// A free node pays its edge weight to a foreground neighbor when it stays background (source side),
+	// and to a background neighbor when it becomes foreground (sink side).
+	// The per node buffers are only written and read at free nodes, so they are not cleared.
+	updateE1Table();
+	m_e1.resize(nodeCount);
+	m_tlinks.resize(nodeCount);
+	m_graphNodes.resize(nodeCount);
+	for each(auto& i in m_solveNodes)
+	{
+		// Only the edges of free nodes are read.
+		if (m_nodeStates[i] != NodeState::Free)
+			continue;
+		for (int k = adjOffsets[i]; k < adjOffsets[i + 1]; k++)
+			m_adjWeights[k] = e2Scale * calE2(i + 1, adjNodes[k] + 1);
+
+		m_e1[i] = calE1(i + 1);
+		m_tlinks[i] = m_e1[i] * e1Scale;
+		for (int k = adjOffsets[i]; k < adjOffsets[i + 1]; k++)
+		{
+			NodeState adjacentState = m_nodeStates[adjNodes[k]];
+			if (adjacentState == NodeState::Fore)
+				m_tlinks[i].y += m_adjWeights[k];
+			else if (adjacentState == NodeState::Back)
+				m_tlinks[i].x += m_adjWeights[k];
+		}
+	}
+	if (fixPersistent)
+		fixPersistentNodes(m_tlinks);
+
+	// Add free nodes.
+	m_graph->reset();
+	for each(auto& i in m_solveNodes)
+	{
+		if (m_nodeStates[i] != NodeState::Free)
+			continue;
+		m_graphNodes[i] = m_graph->add_node();
+		m_graph->add_tweights(m_graphNodes[i], m_tlinks[i].x, m_tlinks[i].y);
+	}
+	// Add edges between free nodes.
+	for each(auto& i in m_solveNodes)
+	{
+		if (m_nodeStates[i] != NodeState::Free)
+			continue;
+		for (int k = adjOffsets[i]; k < adjOffsets[i + 1]; k++)
+		{
+			int j = adjNodes[k];
+			if (j > i && m_nodeStates[j] == NodeState::Free)
+				m_graph->add_edge(m_graphNodes[i], m_graphNodes[j], m_adjWeights[k], m_adjWeights[k]);
+		}
 	}
 
-	Vec3b currentColor = m_nodeColors[compId - 1];
-	float df = minDistance(currentColor, m_foreColors);
-	float db = minDistance(currentColor, m_backColors);
-	return Point2f(df / (df + db), db / (df + db));
+	if (m_captureProblem)
+	{
+		// Same node and edge order as the graph.
+		m_lastProblem = CutProblem();
+		for each(auto& i in m_solveNodes)
+		{
+			if (m_nodeStates[i] != NodeState::Free)
+				continue;
+			m_lastProblem.TerminalCaps.push_back(Vec2f(m_tlinks[i].x, m_tlinks[i].y));
+			for (int k = adjOffsets[i]; k < adjOffsets[i + 1]; k++)
+			{
+				int j = adjNodes[k];
+				if (j > i && m_nodeStates[j] == NodeState::Free)
+				{
+					m_lastProblem.Edges.push_back(Vec2i(m_graphNodes[i], m_graphNodes[j]));
+					m_lastProblem.EdgeCaps.push_back(Vec2f(m_adjWeights[k], m_adjWeights[k]));
+				}
+			}
+		}
+		m_lastProblem.NodeCount = static_cast<int>(m_lastProblem.TerminalCaps.size());
+	}
 }
 
-// Todo: adjust E2 calculation method.
-float LazySnapping::calE2(int compA, int compB)
+void LazySnapping::readNodeLabels()
 {
-	Vec3b colorA = m_nodeColors[compA - 1];
-	Vec3b colorB = m_nodeColors[compB - 1];
+	m_labelsValid = true;
+	for each(auto& i in m_solveNodes)
+	{
+		if (m_nodeStates[i] == NodeState::Free)
+			m_nodeLabels[i] = m_graph->what_segment(m_graphNodes[i]) == Graph<float, float, float>::SINK ? 1 : 0;
+		else
+			m_nodeLabels[i] = m_nodeStates[i] == NodeState::Fore ? 1 : 0;
+	}
+}
 
-	Vec3i diff = static_cast<Vec3i>(colorA) - static_cast<Vec3i>(colorB);
-	int distance = diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2];
-	float epsilon = 1.0f;	// 0.01
+bool LazySnapping::ProcessParametric(Mat& paintImage, float minWeight, float maxWeight, int steps /* = 32 */, bool showSegmentation /* = false */)
+{
+	if (minWeight <= 0 || maxWeight < minWeight)
+	{
+		cout << "Parametric weight range must be positive and ordered." << endl;
+		return false;
+	}
+	if (steps < 2 || steps > MaxParametricSteps)
+	{
+		cout << "Parametric steps must be in [2, " << MaxParametricSteps << "]." << endl;
+		return false;
+	}
+	m_paramWeights.clear();
+	m_paintRegion = Rect();
+	if (!setMarkPoints(paintImage))
+		return false;
+	m_solveComplete = true;
+	m_flowGap = 0;
+
+	// Dividing the energy by the weight leaves the edges fixed and scales the likelihood t-links by 1 / weight.
+	// Sweeping the weight downward only increases t-link capacities, so the residual flow and search trees
+	// stay valid and every step is an incremental solve.
+	vector<float> weights(steps);
+	for (int k = 0; k < steps; k++)
+		weights[k] = maxWeight * pow(minWeight / maxWeight, static_cast<float>(k) / (steps - 1));
+
+	enforceMemoryBudget();
+	m_paramLabels.assign(m_model->GetNodeColors().size(), 0);
+	try
+	{
+		buildReducedGraph(1.0f / weights[0], 1.0f / m_e2weight, false);
+		for (int k = 0; k < steps; k++)
+		{
+			TRACE_SCOPE("parametric step");
+			if (k == 0)
+			{
+				m_graph->maxflow();
+			}
+			else
+			{
+				float delta = 1.0f / weights[k] - 1.0f / weights[k - 1];
+				for each(auto& i in m_solveNodes)
+				{
+					if (m_nodeStates[i] != NodeState::Free)
+						continue;
+					m_graph->add_tweights(m_graphNodes[i], delta * m_e1[i].x, delta * m_e1[i].y);
+					m_graph->mark_node(m_graphNodes[i]);
+				}
+				m_graph->maxflow(true);
+			}
+
+			readNodeLabels();
+			for (size_t i = 0; i < m_nodeLabels.size(); i++)
+			{
+				if (m_nodeLabels[i])
+					m_paramLabels[i] |= 1ull << (steps - 1 - k);
+			}
+		}
+	}
+	catch (const bad_alloc&)
+	{
+		cancelSolve();
+		return false;
+	}
+
+	// Store the weights in increasing order to match the label bits.
+	reverse(weights.begin(), weights.end());
+	m_paramWeights = weights;
+
+	m_switchWeights.assign(m_model->GetNodeColors().size(), Infinite);
+	for (size_t i = 0; i < m_paramLabels.size(); i++)
+	{
+		uint64_t first = m_paramLabels[i] & 1;
+		for (int k = 1; k < steps; k++)
+		{
+			if ((m_paramLabels[i] >> k & 1) != first)
+			{
+				m_switchWeights[i] = weights[k];
+				break;
+			}
+		}
+	}
 
-	return m_e2weight / (epsilon + distance);
+	if (!SelectE2Weight(min(max(m_e2weight, minWeight), maxWeight)))
+		return false;
+	if (showSegmentation && !m_segmentation->IsMapped())
+		imshow(SegWindowName, m_segmentation->Tile(0));
+	return true;
 }
 
-int LazySnapping::transPointToCompId(const Point& pos)
+bool LazySnapping::SelectE2Weight(float weight)
 {
-	if (pos.x < 0 || pos.x >= m_maskImage.cols || pos.y < 0 || pos.y >= m_maskImage.rows)
-		throw new exception("Point out out of image bound.");
+	if (m_paramWeights.empty())
+	{
+		cout << "No parametric result. Call ProcessParametric first." << endl;
+		return false;
+	}
+	if (weight < m_paramWeights.front() || weight > m_paramWeights.back())
+	{
+		cout << "E2 weight is out of the parametric range." << endl;
+		return false;
+	}
+
+	// The grid is geometric, so pick the nearest step in log space.
+	int index = 0;
+	float bestDistance = Infinite;
+	for (size_t k = 0; k < m_paramWeights.size(); k++)
+	{
+		float distance = abs(log(weight / m_paramWeights[k]));
+		if (distance < bestDistance)
+		{
+			bestDistance = distance;
+			index = static_cast<int>(k);
+		}
+	}
+
+	for (size_t i = 0; i < m_nodeLabels.size(); i++)
+		m_nodeLabels[i] = m_paramLabels[i] >> index & 1;
+	m_statesSynced = false;
+	m_e2weight = m_paramWeights[index];
+	BuildSegmentation(Rect(Point(0, 0), m_model->GetLabels()->Size()));
+	return true;
+}
+
+const vector<float>& LazySnapping::GetSwitchWeights() const
+{
+	return m_switchWeights;
+}
+
+Mat LazySnapping::GetSwitchWeightMap() const
+{
+	Mat res(m_model->GetLabels()->Size(), CV_32FC1);
+	for (int t = 0; t < m_model->GetLabels()->TileCount(); t++)
+	{
+		Rect rect = m_model->GetLabels()->TileRect(t);
+		vector<int> row(rect.width);
+		for (int i = 0; i < rect.height; i++)
+		{
+			const int* labelptr = m_model->GetLabels()->TileRow(t, i, row.data());
+			float* resptr = res.ptr<float>(rect.y + i) + rect.x;
+			for (int j = 0; j < rect.width; j++)
+				resptr[j] = m_switchWeights.empty() ? Infinite : m_switchWeights[labelptr[j] - 1];
+		}
+	}
+	return res;
+}
+
+void LazySnapping::fixPersistentNodes(vector<Point2f>& tlinks)
+{
+	const vector<int>& adjOffsets = m_model->GetAdjOffsets();
+	const vector<int>& adjNodes = m_model->GetAdjNodes();
+	vector<float>& freeWeights = m_freeWeights;
+	freeWeights.resize(m_model->GetNodeCount());
+	vector<int> candidates;
+	for each(auto& i in m_solveNodes)
+	{
+		if (m_nodeStates[i] != NodeState::Free)
+			continue;
+		freeWeights[i] = 0;
+		for (int k = adjOffsets[i]; k < adjOffsets[i + 1]; k++)
+		{
+			if (m_nodeStates[adjNodes[k]] == NodeState::Free)
+				freeWeights[i] += m_adjWeights[k];
+		}
+		candidates.push_back(i);
+	}
+
+	while (!candidates.empty())
+	{
+		int i = candidates.back();
+		candidates.pop_back();
+		if (m_nodeStates[i] != NodeState::Free)
+			continue;
+
+		// Source side is background, sink side is foreground.
+		float difference = tlinks[i].x - tlinks[i].y;
+		if (difference >= freeWeights[i])
+			m_nodeStates[i] = NodeState::Back;
+		else if (-difference >= freeWeights[i])
+			m_nodeStates[i] = NodeState::Fore;
+		else
+			continue;
 
-	return m_maskImage.at<int>(pos);
+		for (int k = adjOffsets[i]; k < adjOffsets[i + 1]; k++)
+		{
+			int j = adjNodes[k];
+			if (m_nodeStates[j] != NodeState::Free)
+				continue;
+			freeWeights[j] -= m_adjWeights[k];
+			if (m_nodeStates[i] == NodeState::Fore)
+				tlinks[j].y += m_adjWeights[k];
+			else
+				tlinks[j].x += m_adjWeights[k];
+			candidates.push_back(j);
+		}
+	}
 }
 
-float LazySnapping::colorDistance(const Vec3b& colorA, const Vec3b& colorB) const
+void LazySnapping::BuildSegmentation(const Rect& region)
 {
-	Vec3i diff = static_cast<Vec3i>(colorA) - static_cast<Vec3i>(colorB);
-	return static_cast<float>(sqrt(diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2]));
+	TRACE_SCOPE("BuildSegmentation");
+	vector<int> buffer;
+	for (int t = 0; t < m_model->GetLabels()->TileCount(); t++)
+	{
+		Rect tileRect = m_model->GetLabels()->TileRect(t);
+		Rect area = tileRect & region;
+		if (area.area() == 0)
+			continue;
+
+		// Rows of the label tile are decoded whole, the segmentation is only written inside the region.
+		Mat segmentation = segmentationTile(t);
+		buffer.resize(tileRect.width);
+		for (int i = area.y - tileRect.y; i < area.br().y - tileRect.y; i++)
+		{
+			const int* maskptr = m_model->GetLabels()->TileRow(t, i, buffer.data());
+			uchar* segptr = segmentation.ptr<uchar>(i);
+			for (int j = area.x - tileRect.x; j < area.br().x - tileRect.x; j++)
+				segptr[j] = m_nodeLabels[maskptr[j] - 1] ? 255 : 0;
+		}
+	}
 }
 
-float LazySnapping::minDistance(const cv::Vec3b& color, const std::vector<cv::Vec3b>& collection) const
+Point2f LazySnapping::calE1(int compId)
 {
-	float res = Infinite;
-	float temp = 0;
-	for each(auto& element in collection)
+	if (compId < 1 || compId > static_cast<int>(m_model->GetNodeColors().size()))
+		throw new exception("No such component id.");
+
+	// Marked component ids are sorted by setMarkPoints.
+	if (binary_search(m_foreComps.begin(), m_foreComps.end(), compId))
+		return Point2f(0, Infinite);	// In the foreground.
+	if (binary_search(m_backComps.begin(), m_backComps.end(), compId))
+		return Point2f(Infinite, 0);	// In the background.
+
+	Vec3b currentColor = m_model->GetNodeColors()[compId - 1];
+	Point2f res;
+	if (!m_e1Table.empty())
 	{
-		temp = colorDistance(color, element);
-		if (temp < res)
-			res = temp;
+		int shift = 8 - m_e1LookupBits;
+		size_t index = ((static_cast<size_t>(currentColor[0] >> shift) << m_e1LookupBits | (currentColor[1] >> shift)) << m_e1LookupBits) | (currentColor[2] >> shift);
+		float fore = m_e1Table[index];
+		res = Point2f(fore, 1 - fore);
+	}
+	else
+		res = LikelihoodEnergy(currentColor, m_foreColors, m_backColors);
+
+	// Blend with the foreground probability propagated from a previous frame.
+	if (!m_nodePrior.empty())
+	{
+		float p = m_nodePrior[compId - 1];
+		res = res * (1 - m_priorWeight) + Point2f(1 - p, p) * m_priorWeight;
 	}
 	return res;
 }
+
+float LazySnapping::calE2(int compA, int compB)
+{
+	return PriorEnergy(m_model->GetNodeColors()[compA - 1], m_model->GetNodeColors()[compB - 1], m_e2weight);
+}
+
+int LazySnapping::transPointToCompId(const Point& pos)
+{
+	if (pos.x < 0 || pos.x >= m_model->GetLabels()->Size().width || pos.y < 0 || pos.y >= m_model->GetLabels()->Size().height)
+		throw new exception("Point out out of image bound.");
+
+	return m_model->GetLabels()->At(pos);
+}
+
+Mat LazySnapping::segmentationTile(int index) const
+{
+	// A mapped segmentation storage shares the label tile layout, an in-memory one is a single tile.
+	if (m_segmentation->IsMapped())
+		return m_segmentation->Tile(index);
+	return m_segmentation->Tile(0)(m_model->GetLabels()->TileRect(index));
+}
@@ -4,16 +4,60 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <cstdint>
 #include "WatershedHelper.h"
+#include "TiledImage.h"
+#include "LabelMap.h"
+#include "SnappingModel.h"
 #include "graph.h"
+#include "ProblemIO.h"
+#include "MemoryReport.h"
+
+/// <summary>
+/// Node state during graph reduction. Fore and Back nodes are merged into the terminals.
+/// </summary>
+enum class NodeState : uchar
+{
+	Free,
+	Fore,
+	Back
+};
 
 /// <summary>
 /// Use lazy snapping algorithm to do image cut.
+/// The per image state is kept in a SnappingModel, which sessions on the same image may share.
+/// Everything else belongs to the session, so different sessions may process in parallel threads.
+/// One session must not be used from several threads at once.
 /// </summary>
 class LazySnapping
 {
 public:
 	LazySnapping(const cv::Mat& maskImage, const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections, int clusterNum = 64, float e2weight = 1000.0);
+
+	/// <summary>
+	/// Create with tiled label and segmentation storages, which are streamed tile by tile.
+	/// Both storages must have the same size. A mapped segmentation storage must have the label tile layout.
+	/// </summary>
+	/// <param name="labels">The CV_32SC1 label storage, e.g. filled by WatershedHelper::ProcessTiled.</param>
+	/// <param name="segmentation">The CV_8UC1 segmentation storage.</param>
+	LazySnapping(std::shared_ptr<TiledImage> labels, std::shared_ptr<TiledImage> segmentation, const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections, int clusterNum = 64, float e2weight = 1000.0);
+
+	/// <summary>
+	/// Create with any label map representation, e.g. a CompactLabelMap.
+	/// </summary>
+	LazySnapping(std::shared_ptr<const LabelMap> labels, std::shared_ptr<TiledImage> segmentation, const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections, int clusterNum = 64, float e2weight = 1000.0);
+
+	/// <summary>
+	/// Create a session on a shared model.
+	/// </summary>
+	/// <param name="model">The model of the image.</param>
+	/// <param name="segmentation">The CV_8UC1 segmentation storage of this session.</param>
+	LazySnapping(std::shared_ptr<const SnappingModel> model, std::shared_ptr<TiledImage> segmentation, int clusterNum = 64, float e2weight = 1000.0);
+
+	/// <summary>
+	/// Create a session on a shared model with an in-memory segmentation.
+	/// </summary>
+	LazySnapping(std::shared_ptr<const SnappingModel> model, int clusterNum = 64, float e2weight = 1000.0);
 	~LazySnapping();
 
 public:
@@ -21,16 +65,106 @@ public:
 	/// Do lazy snapping base on foreground points and background points.
 	/// </summary>
 	/// <param name="paintImage">The paint image. 1 for foreground mark, 2 for background mark.</param>
-	/// <param name="showSegmentation">Set to true to show the final segmentation result.</param>
+	/// <param name="showSegmentation">Set to true to show the final segmentation result. Ignored for mapped storage.</param>
 	/// <returns>True for successful operation.</returns>
 	bool Process(cv::Mat& paintImage, bool showSegmentation = false);
 
+	/// <summary>
+	/// Solve the segmentation for a geometric grid of prior energy weights in one pass.
+	/// The solves share one graph and reuse the residual flow, so the sweep costs roughly one solve.
+	/// Afterwards the segmentation of any weight in the range is selected by SelectE2Weight.
+	/// Persistency fixing is not applied in this mode as it depends on the weight.
+	/// </summary>
+	/// <param name="paintImage">The paint image. 1 for foreground mark, 2 for background mark.</param>
+	/// <param name="minWeight">The minimum prior energy weight.</param>
+	/// <param name="maxWeight">The maximum prior energy weight.</param>
+	/// <param name="steps">The number of weights in the grid, at most 64.</param>
+	/// <param name="showSegmentation">Set to true to show the segmentation of the current e2 weight.</param>
+	/// <returns>True for successful operation.</returns>
+	bool ProcessParametric(cv::Mat& paintImage, float minWeight, float maxWeight, int steps = 32, bool showSegmentation = false);
+
+	/// <summary>
+	/// Build the segmentation of the nearest grid weight from the last parametric solve without solving again.
+	/// The e2 weight is set to the selected grid weight.
+	/// </summary>
+	/// <returns>False if there is no parametric result or the weight is out of its range.</returns>
+	bool SelectE2Weight(float weight);
+
+	/// <summary>
+	/// Get the smallest grid weight at which every component takes a label different from its label at the minimum weight.
+	/// Components that never switch get a very large value.
+	/// </summary>
+	const std::vector<float>& GetSwitchWeights() const;
+
+	/// <summary>
+	/// Get the switch weight of every pixel as a CV_32FC1 image.
+	/// </summary>
+	cv::Mat GetSwitchWeightMap() const;
+
+	/// <summary>
+	/// Do lazy snapping without marks, based on given color models and the foreground probability
+	/// of every component, e.g. propagated from the previous video frame.
+	/// </summary>
+	/// <param name="foreColors">The foreground cluster colors.</param>
+	/// <param name="backColors">The background cluster colors.</param>
+	/// <param name="foreProbability">The foreground probability of every component.</param>
+	/// <param name="priorWeight">The weight of the probability in the likelihood energy, in [0, 1].</param>
+	/// <param name="showSegmentation">Set to true to show the final segmentation result.</param>
+	/// <returns>True for successful operation.</returns>
+	bool ProcessPropagated(const std::vector<cv::Vec3b>& foreColors, const std::vector<cv::Vec3b>& backColors,
+		const std::vector<float>& foreProbability, float priorWeight, bool showSegmentation = false);
+
+	/// <summary>
+	/// Get the cluster colors of the last process.
+	/// </summary>
+	void GetColorModels(std::vector<cv::Vec3b>& foreColors, std::vector<cv::Vec3b>& backColors) const;
+
 	/// <summary>
 	/// Get the final segmentation image. 255 for foreground and 0 for background.
+	/// For mapped storage the whole image is assembled in memory.
 	/// </summary>
 	/// <returns></returns>
 	cv::Mat GetSegmentation() const;
 
+	/// <summary>
+	/// Get the segmentation storage to stream the result tile by tile.
+	/// </summary>
+	std::shared_ptr<TiledImage> GetSegmentationStorage() const;
+
+	/// <summary>
+	/// Get the label of every component from the last solve. 1 for foreground and 0 for background.
+	/// </summary>
+	const std::vector<uchar>& GetNodeLabels() const;
+
+	/// <summary>
+	/// Get the marked component ids of the last process, sorted.
+	/// </summary>
+	void GetMarks(std::vector<int>& foreComps, std::vector<int>& backComps) const;
+
+	/// <summary>
+	/// Restore a previous result without solving, e.g. for undo. Only the segmentation of the
+	/// components whose label changes is rebuilt.
+	/// </summary>
+	/// <param name="foreComps">The sorted foreground component ids.</param>
+	/// <param name="backComps">The sorted background component ids.</param>
+	/// <param name="foreColors">The foreground cluster colors.</param>
+	/// <param name="backColors">The background cluster colors.</param>
+	/// <param name="nodeLabels">The label of every component.</param>
+	/// <param name="showSegmentation">Set to true to show the segmentation result.</param>
+	void RestoreResult(const std::vector<int>& foreComps, const std::vector<int>& backComps,
+		const std::vector<cv::Vec3b>& foreColors, const std::vector<cv::Vec3b>& backColors,
+		const std::vector<uchar>& nodeLabels, bool showSegmentation = false);
+
+	/// <summary>
+	/// Get the label map.
+	/// </summary>
+	std::shared_ptr<const LabelMap> GetLabelMap() const;
+
+	/// <summary>
+	/// Get the model, e.g. to open more sessions on the same image.
+	/// </summary>
+	std::shared_ptr<const SnappingModel> GetModel() const;
+
 	/// <summary>
 	/// Set kmeans cluster number.
 	/// </summary>
@@ -41,69 +175,287 @@ public:
 	/// </summary>
 	void SetE2Weight(float weight);
 
+	/// <summary>
+	/// Convert the label map to the specified representation. Compact labels cut the label memory
+	/// and the bandwidth of the full frame scans. The session switches to its own copy of the model.
+	/// </summary>
+	/// <param name="compression">The label representation.</param>
+	/// <param name="tileSize">The tile size of compact labels.</param>
+	void SetLabelCompression(LabelCompression compression, int tileSize = 256);
+
+	/// <summary>
+	/// Bake the likelihood energy into a quantized RGB lookup table after clustering, so the energy
+	/// of one node is a single table read independent of the cluster number.
+	/// It pays off when the node number exceeds the table size. The table is rebuilt only when the color models change.
+	/// </summary>
+	/// <param name="bits">Bits per channel of the table, 32^3 bins for 5 and at most 6. Set to 0 to disable.</param>
+	void SetE1LookupBits(int bits);
+
+	/// <summary>
+	/// Enable solving only the components around the paint areas reported since the last process.
+	/// Components outside the window keep their previous label and act as hard constraints,
+	/// and the segmentation is only rebuilt over the solved components.
+	/// Without reported areas, e.g. after a parameter change, the whole image is solved.
+	/// </summary>
+	/// <param name="enable">Set to true to enable.</param>
+	/// <param name="margin">The margin in pixels added around the reported areas.</param>
+	void SetRoiMode(bool enable, int margin = 32);
+
+	/// <summary>
+	/// Report a paint area changed since the last process, e.g. the bounding box of a stroke.
+	/// The next process only rescans the marks of the components under the reported areas, so they
+	/// must cover every paint change. Without reports the whole paint is scanned.
+	/// </summary>
+	void AddPaintRegion(const cv::Rect& region);
+
+	/// <summary>
+	/// Forget the marks and labels of the last process, so the next one scans the whole paint and solves the whole image.
+	/// Call it when the paint changes without being reported, e.g. when the marks are cleared.
+	/// </summary>
+	void ResetRoi();
+
+	/// <summary>
+	/// Get the image region rebuilt by the last solve.
+	/// </summary>
+	cv::Rect GetSolveRegion() const;
+
+	/// <summary>
+	/// Enable fixing free nodes whose likelihood energy difference dominates the sum of their
+	/// prior energies before the solve. Such nodes keep their label in an optimal cut.
+	/// </summary>
+	void SetPersistencyFixing(bool enable);
+
+	/// <summary>
+	/// Set the time budget of the maximum flow. When it expires, Process returns the cut of the
+	/// current search trees, which is valid but may be suboptimal.
+	/// </summary>
+	/// <param name="milliseconds">The time budget. Set to 0 to always solve to completion.</param>
+	void SetSolveDeadline(double milliseconds);
+
+	/// <summary>
+	/// Check whether the last solve reached the maximum flow.
+	/// </summary>
+	bool IsSolveComplete() const;
+
+	/// <summary>
+	/// Get the energy of the last cut minus the flow found so far, which bounds its distance to the optimum.
+	/// It is 0 for a complete solve.
+	/// </summary>
+	float GetFlowGap() const;
+
+	/// <summary>
+	/// Continue an incomplete solve from its saved state within another deadline, then rebuild the segmentation.
+	/// The marks must not change in between.
+	/// </summary>
+	/// <param name="showSegmentation">Set to true to show the segmentation result.</param>
+	/// <returns>True if the solve is complete, false if it is still incomplete or runs out of memory.</returns>
+	bool ResumeSolve(bool showSegmentation = false);
+
+	/// <summary>
+	/// Get the number of nodes in the last solved graph, after graph reduction.
+	/// </summary>
+	int GetSolvedNodeCount() const;
+
+	/// <summary>
+	/// Keep a copy of every min cut problem built, so it can be exported with SaveProblem and solved offline.
+	/// For a parametric process the problem of the largest weight is kept.
+	/// </summary>
+	void SetProblemCapture(bool enable);
+
+	/// <summary>
+	/// Get the last min cut problem built, in graph node order. Empty unless problem capture is enabled.
+	/// </summary>
+	const CutProblem& GetLastProblem() const;
+
+	/// <summary>
+	/// Add the memory of every component to a report: labels, segmentation, node data, adjacency, graph and solver state.
+	/// </summary>
+	void GetMemoryReport(MemoryReport& report) const;
+
+	/// <summary>
+	/// Get the total memory reported by GetMemoryReport in bytes.
+	/// </summary>
+	size_t GetMemoryUsage() const;
+
+	/// <summary>
+	/// Set a memory budget in bytes. While the usage exceeds it, cheaper representations are chosen in order:
+	/// labels of a model not shared with other sessions are compressed to row runs and the graph is shrunk to the last solved size.
+	/// The graph may only grow up to the budget left; a process that needs more fails with a message instead of allocating.
+	/// </summary>
+	/// <param name="bytes">The budget. Set to 0 to disable.</param>
+	void SetMemoryBudget(size_t bytes);
+
 private:
 	/// <summary>
-	/// Set the foreground and background mark points.
+	/// Validate parameters and create the graph.
+	/// </summary>
+	void initialize();
+
+	/// <summary>
+	/// Get the segmentation area covered by the specified label tile.
+	/// </summary>
+	cv::Mat segmentationTile(int index) const;
+
+	/// <summary>
+	/// Set the foreground and background mark points and cluster their colors.
 	/// </summary>
 	/// <param name="paintImage">The paint image. 1 for foreground mark, 2 for background mark.</param>
+	/// <param name="region">The paint changed since the marks of the last process. Empty to scan the whole paint.</param>
 	/// <returns>True for successful operation.</returns>
-	bool setMarkPoints(cv::Mat& paintImage);
+	bool setMarkPoints(cv::Mat& paintImage, const cv::Rect& region = cv::Rect());
 
 	/// <summary>
-	/// Run the maximum flow algorithm.
+	/// Scan the marks of every component from the whole paint.
 	/// </summary>
-	void runMaxFlow();
+	void scanNodeMarks(const cv::Mat& paintImage);
 
 	/// <summary>
-	/// Build the segmentation image.
+	/// Recount the marks of the components under the changed paint and update the marked component ids.
 	/// </summary>
-	void BuildSegmentation();
+	/// <param name="region">The changed paint area inside the image.</param>
+	/// <param name="addedFore">The newly marked foreground components.</param>
+	/// <param name="addedBack">The newly marked background components.</param>
+	/// <returns>True if any component lost a mark.</returns>
+	bool updateNodeMarks(const cv::Mat& paintImage, const cv::Rect& region, std::vector<int>& addedFore, std::vector<int>& addedBack);
 
 	/// <summary>
-	/// Calculate the likelihood energy specific component.
-	/// In the result, x stores the foreground energy and y stores the background energy.
+	/// Build the likelihood lookup table from the current cluster colors, unless it was built from the same colors.
 	/// </summary>
-	cv::Point2f calE1(int compId);
+	void updateE1Table();
 
 	/// <summary>
-	/// Calculate prior energy between two components.
+	/// Run the maximum flow algorithm. Marked nodes are merged into the terminals and their
+	/// edges folded into the neighbors' t-links, so only free nodes are solved.
 	/// </summary>
-	float calE2(int compA, int compB);
+	void runMaxFlow(const cv::Rect& window = cv::Rect());
 
 	/// <summary>
-	/// Transform the point position to component id according to the mask image.
+	/// Continue the maximum flow in slices until it completes or the deadline expires.
 	/// </summary>
-	int transPointToCompId(const cv::Point& pos);
+	/// <param name="start">The tick count when the deadline started.</param>
+	void continueMaxFlow(int64 start);
 
 	/// <summary>
-	/// Calculate the Euclid distance.
+	/// Drop a solve that ran out of memory. The graph is left in the middle of the solve, so it cannot be resumed.
 	/// </summary>
-	/// <returns></returns>
-	float colorDistance(const cv::Vec3b& colorA, const cv::Vec3b& colorB) const;
+	void cancelSolve();
+
+	/// <summary>
+	/// Calculate the residual capacity across the current cut.
+	/// </summary>
+	float calFlowGap();
+
+	/// <summary>
+	/// Set up the reduced graph of the free nodes.
+	/// </summary>
+	/// <param name="e1Scale">The scale of the likelihood energy.</param>
+	/// <param name="e2Scale">The scale of the prior energy.</param>
+	/// <param name="fixPersistent">Set to true to fix persistent nodes.</param>
+	/// <param name="window">The solve window. Only the components under it are visited, the others keep their label. Empty for the whole image.</param>
+	void buildReducedGraph(float e1Scale, float e2Scale, bool fixPersistent, const cv::Rect& window = cv::Rect());
+
+	/// <summary>
+	/// Read the label of every solve node from the graph and the node states.
+	/// </summary>
+	void readNodeLabels();
+
+	/// <summary>
+	/// Fix free nodes whose t-link difference dominates the prior energy to the other free nodes.
+	/// Fixed nodes are folded into their neighbors, which may allow fixing them too.
+	/// </summary>
+	/// <param name="tlinks">The t-links of every free node. x is the source capacity and y the sink capacity.</param>
+	void fixPersistentNodes(std::vector<cv::Point2f>& tlinks);
+
+	/// <summary>
+	/// Build the segmentation image inside the specified region.
+	/// </summary>
+	void BuildSegmentation(const cv::Rect& region);
+
+	/// <summary>
+	/// Choose cheaper representations until the memory budget is met and limit the graph to the rest.
+	/// </summary>
+	void enforceMemoryBudget();
+
+	/// <summary>
+	/// Calculate the likelihood energy specific component.
+	/// In the result, x stores the foreground energy and y stores the background energy.
+	/// </summary>
+	cv::Point2f calE1(int compId);
 
 	/// <summary>
-	/// Calculate the minimum distance to a color collection.
+	/// Calculate prior energy between two components, see PriorEnergy.
 	/// </summary>
-	/// <param name="color">The color value.</param>
-	/// <param name="collection">The color collection.</param>
-	float minDistance(const cv::Vec3b& color, const std::vector<cv::Vec3b>& collection) const;
+	float calE2(int compA, int compB);
+
+	/// <summary>
+	/// Transform the point position to component id according to the label storage.
+	/// </summary>
+	int transPointToCompId(const cv::Point& pos);
 
 private:
 	std::vector<int> m_foreComps;
 	std::vector<int> m_backComps;
 	std::vector<cv::Vec3b> m_foreColors;
 	std::vector<cv::Vec3b> m_backColors;
+	std::vector<uchar> m_nodeMarks;		// Paint marks of every component, empty if unknown.
+	cv::Rect m_paintRegion;				// Paint changes reported since the last process.
 
-	cv::Mat m_maskImage;
-	std::vector<cv::Vec3b> m_nodeColors;
-	std::vector<Connection> m_connections;	
+	// Cluster sums of the color models, so strokes that only add marks update the means in place.
+	std::vector<cv::Vec3d> m_foreSums;
+	std::vector<int> m_foreCounts;
+	std::vector<cv::Vec3d> m_backSums;
+	std::vector<int> m_backCounts;
+
+	std::shared_ptr<const SnappingModel> m_model;
 	std::unique_ptr<Graph<float, float, float>> m_graph;
 
-	cv::Mat m_segImage;
+	std::shared_ptr<TiledImage> m_segmentation;
+
+	std::vector<float> m_adjWeights;	// Prior energy of every model adjacency entry, valid for free nodes.
+
+	std::vector<NodeState> m_nodeStates;
+	std::vector<int> m_solveNodes;		// Nodes under the window of the last graph, all nodes for the whole image.
+	bool m_statesSynced;				// Whether the states outside m_solveNodes match the labels.
+	std::vector<int> m_graphNodes;		// Graph node id of every free node.
+	std::vector<cv::Point2f> m_e1;		// Unscaled likelihood energy of every free node.
+	std::vector<cv::Point2f> m_tlinks;	// T-links of every free node.
+	std::vector<float> m_freeWeights;	// Prior energy to the free neighbors, used by persistency fixing.
+	std::vector<uchar> m_nodeLabels;	// 1 for foreground and 0 for background.
+	bool m_persistencyFixing;
+
+	double m_solveDeadline;
+	bool m_solveComplete;
+	float m_flowGap;
+	const long GrowthSlice = 4096;		// Growth steps between two deadline checks.
+
+	std::vector<float> m_nodePrior;		// Foreground probability of every component, empty if not used.
+	float m_priorWeight;
+
+	bool m_roiMode;
+	int m_roiMargin;
+	bool m_labelsValid;				// Whether m_nodeLabels holds a solved labeling.
+	cv::Rect m_solveRegion;
+
+	// Parametric result. Bit k of a node label is its label at the k-th weight in increasing order.
+	std::vector<float> m_paramWeights;
+	std::vector<uint64_t> m_paramLabels;
+	std::vector<float> m_switchWeights;
+	const int MaxParametricSteps = 64;
+
+	bool m_captureProblem;
+	CutProblem m_lastProblem;
+
+	size_t m_memoryBudget;
 	const float Infinite = 1e10;
 	const std::string SegWindowName = "Segmentation";
 
 	int m_clusterNum;
 	float m_e2weight;
+
+	int m_e1LookupBits;
+	std::vector<float> m_e1Table;		// Foreground energy of every quantized color.
+	std::vector<cv::Vec3b> m_e1TableForeColors;	// The color models the table is built from.
+	std::vector<cv::Vec3b> m_e1TableBackColors;
+	const int MaxE1LookupBits = 6;		// 64^3 bins, 1 MB of table.
 };
 
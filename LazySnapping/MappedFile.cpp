@@ -0,0 +1,152 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: m_fileHandle(INVALID_HANDLE_VALUE), m_mappingHandle(NULL), m_data(nullptr), m_size(0)
+{
+}
+
+bool MappedFile::Open(const string& path, bool writable /* = false */, bool copyOnWrite /* = false */)
+{
+	Close();
+	DWORD access = writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+	m_fileHandle = CreateFileA(path.c_str(), access, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_fileHandle, &size) || size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	return map(writable, copyOnWrite && !writable);
+}
+
+bool MappedFile::Create(const string& path, size_t size)
+{
+	Close();
+	m_fileHandle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_fileHandle == INVALID_HANDLE_VALUE || size == 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = size;
+	return map(true);
+}
+
+bool MappedFile::map(bool writable, bool copyOnWrite /* = false */)
+{
+	LARGE_INTEGER size;
+	size.QuadPart = static_cast<LONGLONG>(m_size);
+	DWORD protection = writable ? PAGE_READWRITE : copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY;
+	m_mappingHandle = CreateFileMappingA(m_fileHandle, NULL, protection, size.HighPart, size.LowPart, NULL);
+	if (m_mappingHandle == NULL)
+	{
+		Close();
+		return false;
+	}
+	DWORD access = writable ? FILE_MAP_WRITE : copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ;
+	m_data = static_cast<unsigned char*>(MapViewOfFile(m_mappingHandle, access, 0, 0, m_size));
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mappingHandle != NULL)
+		CloseHandle(m_mappingHandle);
+	if (m_fileHandle != INVALID_HANDLE_VALUE)
+		CloseHandle(m_fileHandle);
+	m_fileHandle = INVALID_HANDLE_VALUE;
+	m_mappingHandle = NULL;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: m_fileHandle(-1), m_data(nullptr), m_size(0)
+{
+}
+
+bool MappedFile::Open(const string& path, bool writable /* = false */, bool copyOnWrite /* = false */)
+{
+	Close();
+	m_fileHandle = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+	if (m_fileHandle < 0)
+		return false;
+	struct stat info;
+	if (fstat(m_fileHandle, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(info.st_size);
+	return map(writable, copyOnWrite && !writable);
+}
+
+bool MappedFile::Create(const string& path, size_t size)
+{
+	Close();
+	m_fileHandle = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_fileHandle < 0 || size == 0 || ftruncate(m_fileHandle, static_cast<off_t>(size)) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = size;
+	return map(true);
+}
+
+bool MappedFile::map(bool writable, bool copyOnWrite /* = false */)
+{
+	int protection = (writable || copyOnWrite) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void* data = mmap(nullptr, m_size, protection, copyOnWrite ? MAP_PRIVATE : MAP_SHARED, m_fileHandle, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_data = static_cast<unsigned char*>(data);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+		munmap(m_data, m_size);
+	if (m_fileHandle >= 0)
+		close(m_fileHandle);
+	m_fileHandle = -1;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
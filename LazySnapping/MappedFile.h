@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+/// <summary>
+/// Read only, read write or copy on write memory mapping of a whole file.
+/// Pages are loaded by the operating system on first access.
+/// </summary>
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+	/// <summary>
+	/// Map an existing file.
+	/// </summary>
+	/// <param name="path">The file path.</param>
+	/// <param name="writable">Set to true to map the file writable.</param>
+	/// <param name="copyOnWrite">Set to true to map a read only file writable in memory. Written pages are
+	/// copied privately and never reach the file.</param>
+	/// <returns>True for successful operation.</returns>
+	bool Open(const std::string& path, bool writable = false, bool copyOnWrite = false);
+
+	/// <summary>
+	/// Create or truncate a file with the specified size and map it writable.
+	/// </summary>
+	/// <param name="path">The file path.</param>
+	/// <param name="size">The file size in bytes.</param>
+	/// <returns>True for successful operation.</returns>
+	bool Create(const std::string& path, size_t size);
+
+	/// <summary>
+	/// Unmap and close the file.
+	/// </summary>
+	void Close();
+
+	unsigned char* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+	bool IsOpen() const { return m_data != nullptr; }
+
+private:
+	/// <summary>
+	/// Map the opened file handle.
+	/// </summary>
+	bool map(bool writable, bool copyOnWrite = false);
+
+private:
+#ifdef _WIN32
+	void* m_fileHandle;
+	void* m_mappingHandle;
+#else
+	int m_fileHandle;
+#endif
+	unsigned char* m_data;
+	size_t m_size;
+};
@@ -0,0 +1,314 @@
+#include "MaskEncoding.h"
+#include <opencv2/imgproc.hpp>
+#include <fstream>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+void ForEachMaskRow(const LabelMap& labels, const vector<uchar>& nodeLabels, const function<void(const uchar*)>& rowCallback)
+{
+	// Group the tiles into tile rows, ordered from left to right.
+	map<int, vector<int>> tileRows;
+	for (int t = 0; t < labels.TileCount(); t++)
+		tileRows[labels.TileRect(t).y].push_back(t);
+
+	vector<uchar> row(labels.Size().width);
+	vector<int> buffer;
+	for each(auto& tileRow in tileRows)
+	{
+		vector<int> tiles = tileRow.second;
+		sort(tiles.begin(), tiles.end(), [&labels](int a, int b) { return labels.TileRect(a).x < labels.TileRect(b).x; });
+		int height = labels.TileRect(tiles.front()).height;
+		for (int i = 0; i < height; i++)
+		{
+			for each(auto& t in tiles)
+			{
+				Rect tileRect = labels.TileRect(t);
+				buffer.resize(tileRect.width);
+				const int* maskptr = labels.TileRow(t, i, buffer.data());
+				uchar* rowptr = row.data() + tileRect.x;
+				for (int j = 0; j < tileRect.width; j++)
+					rowptr[j] = nodeLabels[maskptr[j] - 1];
+			}
+			rowCallback(row.data());
+		}
+	}
+}
+
+RleWriter::RleWriter(ostream& stream, const Size& size, bool compressed /* = true */)
+	: m_stream(stream), m_size(size), m_compressed(compressed), m_closed(false), m_value(0), m_count(0), m_runCount(0)
+{
+	m_history[0] = m_history[1] = 0;
+	m_stream << "{\"size\":[" << size.height << "," << size.width << "],\"order\":\"row\",\"counts\":" << (m_compressed ? "\"" : "[");
+}
+
+RleWriter::~RleWriter()
+{
+	Close();
+}
+
+void RleWriter::AddRow(const uchar* row)
+{
+	// Runs continue across row ends.
+	for (int j = 0; j < m_size.width; j++)
+	{
+		uchar value = row[j] ? 1 : 0;
+		if (value == m_value)
+		{
+			m_count++;
+			continue;
+		}
+		writeCount(m_count);
+		m_value = value;
+		m_count = 1;
+	}
+}
+
+void RleWriter::Close()
+{
+	if (m_closed)
+		return;
+	writeCount(m_count);
+	m_stream << (m_compressed ? "\"" : "]") << "}" << "\n";
+	m_closed = true;
+}
+
+int64_t RleWriter::GetRunCount() const
+{
+	return m_runCount;
+}
+
+void RleWriter::writeCount(uint64_t count)
+{
+	if (m_compressed)
+	{
+		// COCO string: the difference to the count two runs back, from the fourth count on,
+		// in 5-bit groups with a continuation bit, offset to printable characters.
+		int64_t value = static_cast<int64_t>(count);
+		if (m_runCount > 2)
+			value -= m_history[0];
+		bool more = true;
+		while (more)
+		{
+			int group = static_cast<int>(value & 0x1f);
+			value >>= 5;
+			more = (group & 0x10) ? value != -1 : value != 0;
+			if (more)
+				group |= 0x20;
+			m_stream.put(static_cast<char>(group + 48));
+		}
+	}
+	else
+		m_stream << (m_runCount > 0 ? "," : "") << count;
+
+	m_history[0] = m_history[1];
+	m_history[1] = static_cast<int64_t>(count);
+	m_runCount++;
+}
+
+PolygonTracer::PolygonTracer(int width, double epsilon, const PolygonCallback& callback)
+	: m_width(width), m_epsilon(epsilon), m_callback(callback), m_y(0), m_above(width, 0), m_slots(width + 1), m_nextChain(0)
+{
+}
+
+PolygonTracer::~PolygonTracer()
+{
+}
+
+void PolygonTracer::AddRow(const uchar* row)
+{
+	traceVertexRow(m_above.data(), row);
+	m_above.assign(row, row + m_width);
+	m_y++;
+}
+
+void PolygonTracer::Finish()
+{
+	vector<uchar> outside(m_width, 0);
+	traceVertexRow(m_above.data(), outside.data());
+	m_above = outside;
+	m_y++;
+}
+
+void PolygonTracer::traceVertexRow(const uchar* above, const uchar* below)
+{
+	// Pixel corner (x, m_y) touches the pixels a (above left), b (above right), c (below left) and d (below right).
+	// A crack between two of them is on the boundary if they differ.
+	m_carry = ChainEnd();
+	for (int x = 0; x <= m_width; x++)
+	{
+		bool a = x > 0 && above[x - 1];
+		bool b = x < m_width && above[x];
+		bool c = x > 0 && below[x - 1];
+		bool d = x < m_width && below[x];
+		bool up = a != b, down = c != d, left = a != c, right = b != d;
+		if (!up && !down && !left && !right)
+			continue;
+
+		Point point(x, m_y);
+		ChainEnd upEnd = m_slots[x], leftEnd = m_carry;
+		m_slots[x] = ChainEnd();
+		m_carry = ChainEnd();
+		if (up && down && left && right)
+		{
+			// Foreground pixels touching at a corner only are kept apart.
+			if (a)
+			{
+				join(upEnd, leftEnd, point);
+				upEnd = leftEnd = ChainEnd();
+			}
+			else
+			{
+				addPoint(upEnd, point);
+				moveEnd(upEnd, -1);
+				addPoint(leftEnd, point);
+				moveEnd(leftEnd, x);
+				continue;
+			}
+		}
+		else if (left && right)
+		{
+			m_carry = leftEnd;
+			continue;
+		}
+		else if (up && down)
+		{
+			m_slots[x] = upEnd;
+			continue;
+		}
+		else if (up && left)
+		{
+			join(upEnd, leftEnd, point);
+			continue;
+		}
+		else if (up && right)
+		{
+			addPoint(upEnd, point);
+			moveEnd(upEnd, -1);
+			continue;
+		}
+		else if (down && left)
+		{
+			addPoint(leftEnd, point);
+			moveEnd(leftEnd, x);
+			continue;
+		}
+
+		// Down and right: a new chain starts at a top left corner.
+		int id = m_nextChain++;
+		Chain& chain = m_chains[id];
+		chain.Points.push_back(point);
+		chain.Origin = point;
+		chain.OriginFore = d;
+		moveEnd(ChainEnd(id, false), x);
+		moveEnd(ChainEnd(id, true), -1);
+	}
+}
+
+void PolygonTracer::addPoint(const ChainEnd& end, const Point& point)
+{
+	Chain& chain = m_chains[end.Id];
+	if (end.Back)
+		chain.Points.push_back(point);
+	else
+		chain.Points.push_front(point);
+}
+
+void PolygonTracer::moveEnd(const ChainEnd& end, int where)
+{
+	m_chains[end.Id].Where[end.Back ? 1 : 0] = where;
+	if (where >= 0)
+		m_slots[where] = end;
+	else
+		m_carry = end;
+}
+
+void PolygonTracer::join(ChainEnd first, ChainEnd second, const Point& point)
+{
+	if (first.Id == second.Id)
+	{
+		Chain& chain = m_chains[first.Id];
+		addPoint(first, point);
+		vector<Point> ring(chain.Points.begin(), chain.Points.end());
+		bool hole = !chain.OriginFore;
+		m_chains.erase(first.Id);
+
+		vector<Point> polygon;
+		if (m_epsilon > 0)
+			approxPolyDP(ring, polygon, m_epsilon, true);
+		m_callback(polygon.size() >= 3 ? polygon : ring, hole);
+		return;
+	}
+
+	// Append the shorter chain, walking from its meeting end to its other end.
+	if (m_chains[first.Id].Points.size() < m_chains[second.Id].Points.size())
+		swap(first, second);
+	Chain& target = m_chains[first.Id];
+	Chain& source = m_chains[second.Id];
+	addPoint(first, point);
+	if (second.Back)
+	{
+		for (auto it = source.Points.rbegin(); it != source.Points.rend(); ++it)
+		{
+			if (first.Back)
+				target.Points.push_back(*it);
+			else
+				target.Points.push_front(*it);
+		}
+	}
+	else
+	{
+		for (auto it = source.Points.begin(); it != source.Points.end(); ++it)
+		{
+			if (first.Back)
+				target.Points.push_back(*it);
+			else
+				target.Points.push_front(*it);
+		}
+	}
+	if (source.Origin.y < target.Origin.y || (source.Origin.y == target.Origin.y && source.Origin.x < target.Origin.x))
+	{
+		target.Origin = source.Origin;
+		target.OriginFore = source.OriginFore;
+	}
+	int where = source.Where[second.Back ? 0 : 1];
+	m_chains.erase(second.Id);
+	moveEnd(first, where);
+}
+
+bool WriteMaskRle(const string& path, const LabelMap& labels, const vector<uchar>& nodeLabels, bool compressed /* = true */)
+{
+	ofstream file(path, ios::out | ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	RleWriter writer(file, labels.Size(), compressed);
+	ForEachMaskRow(labels, nodeLabels, [&writer](const uchar* row) { writer.AddRow(row); });
+	writer.Close();
+	return static_cast<bool>(file.flush());
+}
+
+bool WriteMaskPolygons(const string& path, const LabelMap& labels, const vector<uchar>& nodeLabels, double epsilon /* = 1.0 */)
+{
+	ofstream file(path, ios::out | ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	Size size = labels.Size();
+	file << "{\"size\":[" << size.height << "," << size.width << "],\"polygons\":[";
+	bool first = true;
+	PolygonTracer tracer(size.width, epsilon, [&file, &first](const vector<Point>& polygon, bool hole)
+	{
+		file << (first ? "" : ",") << "\n{\"hole\":" << (hole ? "true" : "false") << ",\"points\":[";
+		for (size_t k = 0; k < polygon.size(); k++)
+			file << (k > 0 ? "," : "") << polygon[k].x << "," << polygon[k].y;
+		file << "]}";
+		first = false;
+	});
+	ForEachMaskRow(labels, nodeLabels, [&tracer](const uchar* row) { tracer.AddRow(row); });
+	tracer.Finish();
+	file << "\n]}" << "\n";
+	return static_cast<bool>(file.flush());
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include "LabelMap.h"
+
+/// <summary>
+/// Decode a segmentation row by row from the super pixel labels and the label of every component,
+/// without building the full mask. Only one image row is kept.
+/// </summary>
+/// <param name="labels">The label map.</param>
+/// <param name="nodeLabels">The label of every component. 1 for foreground and 0 for background.</param>
+/// <param name="rowCallback">Called for every row from top to bottom with 1 for foreground and 0 for background.</param>
+void ForEachMaskRow(const LabelMap& labels, const std::vector<uchar>& nodeLabels, const std::function<void(const uchar*)>& rowCallback);
+
+/// <summary>
+/// Write a binary mask fed row by row as COCO style run length encoding, in JSON:
+/// {"size":[height,width],"order":"row","counts":...}. The counts alternate between background and
+/// foreground runs, starting with a possibly empty background run. Unlike COCO the pixels are in row
+/// major order, so COCO tools decode the counts as the transposed mask of size [width,height].
+/// Compressed counts use the COCO string encoding. Runs are written as soon as they end.
+/// </summary>
+class RleWriter
+{
+public:
+	RleWriter(std::ostream& stream, const cv::Size& size, bool compressed = true);
+	~RleWriter();
+
+public:
+	/// <summary>
+	/// Add the next row. Non zero values are foreground.
+	/// </summary>
+	void AddRow(const uchar* row);
+
+	/// <summary>
+	/// Write the last run and close the JSON object. Called by the destructor if needed.
+	/// </summary>
+	void Close();
+
+	/// <summary>
+	/// Get the number of runs written.
+	/// </summary>
+	int64_t GetRunCount() const;
+
+private:
+	void writeCount(uint64_t count);
+
+private:
+	std::ostream& m_stream;
+	cv::Size m_size;
+	bool m_compressed;
+	bool m_closed;
+	uchar m_value;			// Value of the current run.
+	uint64_t m_count;		// Length of the current run.
+	int64_t m_runCount;
+	int64_t m_history[2];	// The last two counts, the compressed encoding stores differences to them.
+};
+
+/// <summary>
+/// Trace the boundaries of the foreground of a binary mask fed row by row. Boundaries run along
+/// the pixel cracks, which for a segmentation are super pixel boundaries, and only their corners
+/// are kept. Every closed ring is simplified and reported as soon as its last row is added,
+/// so only the open rings are in memory.
+/// </summary>
+class PolygonTracer
+{
+public:
+	/// <summary>
+	/// Called for every closed ring with its vertices in pixel corner coordinates and whether it is a hole.
+	/// </summary>
+	typedef std::function<void(const std::vector<cv::Point>&, bool)> PolygonCallback;
+
+	/// <summary>
+	/// Create a tracer.
+	/// </summary>
+	/// <param name="width">The mask width.</param>
+	/// <param name="epsilon">The Douglas-Peucker tolerance in pixels. Set to 0 to keep every corner.</param>
+	/// <param name="callback">The ring callback.</param>
+	PolygonTracer(int width, double epsilon, const PolygonCallback& callback);
+	~PolygonTracer();
+
+public:
+	/// <summary>
+	/// Add the next row. Non zero values are foreground.
+	/// </summary>
+	void AddRow(const uchar* row);
+
+	/// <summary>
+	/// Close the rings along the bottom border.
+	/// </summary>
+	void Finish();
+
+private:
+	/// <summary>
+	/// An open end of a chain: the chain id and whether it is the back end.
+	/// </summary>
+	struct ChainEnd
+	{
+		ChainEnd() {}
+		ChainEnd(int id, bool back) : Id(id), Back(back) {}
+
+		int Id = -1;
+		bool Back = false;
+	};
+
+	struct Chain
+	{
+		std::deque<cv::Point> Points;
+		int Where[2];		// Slot column of the front and back ends, -1 for the end carried along the row.
+		cv::Point Origin;	// First vertex in row major order. A ring is a hole if the pixel right below its origin is background.
+		bool OriginFore;
+	};
+
+	/// <summary>
+	/// Link the cracks around the vertices of one row of pixel corners.
+	/// </summary>
+	void traceVertexRow(const uchar* above, const uchar* below);
+
+	void addPoint(const ChainEnd& end, const cv::Point& point);
+	void moveEnd(const ChainEnd& end, int where);
+
+	/// <summary>
+	/// Join two ends meeting at a vertex. A chain meeting itself is a closed ring and is reported.
+	/// </summary>
+	void join(ChainEnd first, ChainEnd second, const cv::Point& point);
+
+private:
+	int m_width;
+	double m_epsilon;
+	PolygonCallback m_callback;
+	int m_y;								// The vertex row traced next.
+	std::vector<uchar> m_above;				// The last row added.
+	std::vector<ChainEnd> m_slots;			// Chain end on the vertical crack at every column.
+	ChainEnd m_carry;						// Chain end on the horizontal crack left of the current vertex.
+	std::unordered_map<int, Chain> m_chains;
+	int m_nextChain;
+};
+
+/// <summary>
+/// Stream a segmentation from labels and node labels into a run length encoded JSON file, see RleWriter.
+/// </summary>
+/// <returns>True for successful operation.</returns>
+bool WriteMaskRle(const std::string& path, const LabelMap& labels, const std::vector<uchar>& nodeLabels, bool compressed = true);
+
+/// <summary>
+/// Stream a segmentation from labels and node labels into a polygon JSON file:
+/// {"size":[height,width],"polygons":[{"hole":false,"points":[x0,y0,x1,y1,...]},...]}.
+/// Vertices are pixel corners, so a single foreground pixel at (x, y) spans (x, y) to (x + 1, y + 1).
+/// </summary>
+/// <param name="epsilon">The simplification tolerance in pixels, see PolygonTracer.</param>
+/// <returns>True for successful operation.</returns>
+bool WriteMaskPolygons(const std::string& path, const LabelMap& labels, const std::vector<uchar>& nodeLabels, double epsilon = 1.0);
@@ -0,0 +1,26 @@
+#include "MemoryReport.h"
+#include <iomanip>
+
+using namespace std;
+
+void MemoryReport::Add(const string& name, size_t bytes)
+{
+	Items.push_back(make_pair(name, bytes));
+}
+
+size_t MemoryReport::Total() const
+{
+	size_t total = 0;
+	for each(auto& item in Items)
+		total += item.second;
+	return total;
+}
+
+void MemoryReport::Print(ostream& stream) const
+{
+	const double toMb = 1.0 / (1 << 20);
+	stream << fixed << setprecision(2);
+	for each(auto& item in Items)
+		stream << left << setw(24) << item.first << item.second * toMb << " MB" << endl;
+	stream << left << setw(24) << "total" << Total() * toMb << " MB" << endl;
+}
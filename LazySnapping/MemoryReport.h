@@ -0,0 +1,34 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <string>
+#include <utility>
+#include <ostream>
+
+/// <summary>
+/// Memory used by the components of a pipeline, in bytes. Vectors count their capacity.
+/// Storage shared between components, e.g. a mask wrapped without copy, is counted by each of them.
+/// </summary>
+struct MemoryReport
+{
+	std::vector<std::pair<std::string, size_t>> Items;
+
+	void Add(const std::string& name, size_t bytes);
+	size_t Total() const;
+
+	/// <summary>
+	/// Print one line per component and the total in megabytes.
+	/// </summary>
+	void Print(std::ostream& stream) const;
+};
+
+template<typename T> size_t VectorBytes(const std::vector<T>& items)
+{
+	return items.capacity() * sizeof(T);
+}
+
+inline size_t MatBytes(const cv::Mat& image)
+{
+	return image.empty() ? 0 : image.total() * image.elemSize();
+}
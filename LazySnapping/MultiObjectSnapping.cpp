@@ -0,0 +1,399 @@
+#include "MultiObjectSnapping.h"
+#include "ColorKmeans.h"
+#include "SnappingEnergy.h"
+#include "Trace.h"
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+CutTopology::CutTopology(const vector<Vec3b>& nodeColors, const vector<Connection>& connections, float e2weight)
+	: NodeCount(static_cast<int>(nodeColors.size()))
+{
+	if (e2weight <= 0)
+		throw new exception("E2 weight must be a positive number.");
+
+	Offsets.assign(NodeCount + 1, 0);
+	for each(auto& connection in connections)
+	{
+		for each(auto& edge in connection.Edges)
+		{
+			Offsets[connection.Id]++;
+			Offsets[edge.Id]++;
+		}
+	}
+	for (int i = 0; i < NodeCount; i++)
+		Offsets[i + 1] += Offsets[i];
+
+	vector<int> position(Offsets.begin(), Offsets.end() - 1);
+	Heads.resize(Offsets[NodeCount]);
+	Sisters.resize(Offsets[NodeCount]);
+	Capacities.resize(Offsets[NodeCount]);
+	for each(auto& connection in connections)
+	{
+		for each(auto& edge in connection.Edges)
+		{
+			int forward = position[connection.Id - 1]++;
+			int backward = position[edge.Id - 1]++;
+			Heads[forward] = edge.Id - 1;
+			Heads[backward] = connection.Id - 1;
+			Sisters[forward] = backward;
+			Sisters[backward] = forward;
+
+			Capacities[forward] = Capacities[backward] = PriorEnergy(nodeColors[connection.Id - 1], nodeColors[edge.Id - 1], e2weight);
+		}
+	}
+}
+
+MultiObjectSnapping::MultiObjectSnapping(const Mat& maskImage, const vector<Vec3b>& nodeColors, const vector<Connection>& connections, int clusterNum /* = 64 */, float e2weight /* = 1000.0 */)
+	: m_nodeColors(nodeColors), m_clusterNum(clusterNum)
+{
+	if (maskImage.type() != CV_32SC1)
+		throw new exception("Mask image type must be CV_32SC1");
+	if (m_clusterNum < 1 || m_clusterNum > 100)
+		throw new exception("ClusterNum must be in [1, 100].");
+
+	m_labels = make_shared<TiledLabelMap>(make_shared<TiledImage>(maskImage));
+	m_topology = make_shared<CutTopology>(nodeColors, connections, e2weight);
+}
+
+MultiObjectSnapping::MultiObjectSnapping(shared_ptr<const LabelMap> labels, shared_ptr<const CutTopology> topology, const vector<Vec3b>& nodeColors, int clusterNum /* = 64 */)
+	: m_labels(labels), m_topology(topology), m_nodeColors(nodeColors), m_clusterNum(clusterNum)
+{
+	if (m_topology->NodeCount != static_cast<int>(m_nodeColors.size()))
+		throw new exception("Topology does not match the node colors.");
+	if (m_clusterNum < 1 || m_clusterNum > 100)
+		throw new exception("ClusterNum must be in [1, 100].");
+}
+
+MultiObjectSnapping::~MultiObjectSnapping()
+{
+}
+
+bool MultiObjectSnapping::Process(const Mat& paintImage)
+{
+	if (paintImage.size() != m_labels->Size())
+		throw new exception("Image size not match.");
+	if (paintImage.type() != CV_8UC1)
+		throw new exception("Image type must be CV_8UC1");
+
+	// Get the marked components of every object and the background.
+	vector<vector<int>> objectComps;
+	vector<int> backComps;
+	vector<int> buffer;
+	for (int t = 0; t < m_labels->TileCount(); t++)
+	{
+		Rect tileRect = m_labels->TileRect(t);
+		Mat paint = paintImage(tileRect);
+		buffer.resize(tileRect.width);
+		for (int i = 0; i < tileRect.height; i++)
+		{
+			const int* maskptr = m_labels->TileRow(t, i, buffer.data());
+			const uchar* paintptr = paint.ptr<uchar>(i);
+			for (int j = 0; j < tileRect.width; j++)
+			{
+				if (paintptr[j] == 255)
+				{
+					backComps.push_back(maskptr[j]);
+				}
+				else if (paintptr[j] > 0)
+				{
+					if (static_cast<int>(objectComps.size()) < paintptr[j])
+						objectComps.resize(paintptr[j]);
+					objectComps[paintptr[j] - 1].push_back(maskptr[j]);
+				}
+			}
+		}
+	}
+	if (objectComps.empty())
+		return false;
+	if (backComps.empty() && objectComps.size() == 1)
+		return false;
+
+	// Remove redundant ids.
+	for each(auto& comps in objectComps)
+	{
+		sort(comps.begin(), comps.end());
+		comps.erase(unique(comps.begin(), comps.end()), comps.end());
+	}
+	sort(backComps.begin(), backComps.end());
+	backComps.erase(unique(backComps.begin(), backComps.end()), backComps.end());
+
+	// Every object is cut against the background marks and the seeds of the other objects.
+	int objectCount = static_cast<int>(objectComps.size());
+	m_objects.assign(objectCount, ObjectCut());
+	for (int k = 0; k < objectCount; k++)
+	{
+		ObjectCut& cut = m_objects[k];
+		cut.ForeComps = objectComps[k];
+		cut.BackComps = backComps;
+		for (int other = 0; other < objectCount; other++)
+		{
+			if (other != k)
+				cut.BackComps.insert(cut.BackComps.end(), objectComps[other].begin(), objectComps[other].end());
+		}
+		sort(cut.BackComps.begin(), cut.BackComps.end());
+		cut.BackComps.erase(unique(cut.BackComps.begin(), cut.BackComps.end()), cut.BackComps.end());
+	}
+
+	parallel_for_(Range(0, objectCount), [this](const Range& range)
+	{
+		for (int k = range.start; k < range.end; k++)
+		{
+			ObjectCut& cut = m_objects[k];
+			if (cut.ForeComps.empty() || cut.BackComps.empty())
+			{
+				// An object index without seeds.
+				cut.Labels.assign(m_topology->NodeCount, 0);
+				cut.Flow = 0;
+				continue;
+			}
+			clusterColors(cut);
+			setTerminals(cut);
+			solveCut(cut);
+		}
+	});
+	return true;
+}
+
+int MultiObjectSnapping::GetObjectCount() const
+{
+	return static_cast<int>(m_objects.size());
+}
+
+Mat MultiObjectSnapping::GetSegmentation(int object) const
+{
+	if (object < 1 || object > GetObjectCount())
+		throw new exception("No such object.");
+
+	const vector<uchar>& labels = m_objects[object - 1].Labels;
+	Mat res(m_labels->Size(), CV_8UC1);
+	for (int t = 0; t < m_labels->TileCount(); t++)
+	{
+		Rect rect = m_labels->TileRect(t);
+		vector<int> row(rect.width);
+		for (int i = 0; i < rect.height; i++)
+		{
+			const int* maskptr = m_labels->TileRow(t, i, row.data());
+			uchar* resptr = res.ptr<uchar>(rect.y + i) + rect.x;
+			for (int j = 0; j < rect.width; j++)
+				resptr[j] = labels[maskptr[j] - 1] ? 255 : 0;
+		}
+	}
+	return res;
+}
+
+Mat MultiObjectSnapping::GetObjectMap() const
+{
+	// Resolve the object of every node first, so the pixels need a single lookup.
+	vector<uchar> nodeObjects(m_topology->NodeCount, 0);
+	for (int k = GetObjectCount() - 1; k >= 0; k--)
+	{
+		for (int i = 0; i < m_topology->NodeCount; i++)
+		{
+			if (m_objects[k].Labels[i])
+				nodeObjects[i] = static_cast<uchar>(k + 1);
+		}
+	}
+
+	Mat res(m_labels->Size(), CV_8UC1);
+	for (int t = 0; t < m_labels->TileCount(); t++)
+	{
+		Rect rect = m_labels->TileRect(t);
+		vector<int> row(rect.width);
+		for (int i = 0; i < rect.height; i++)
+		{
+			const int* maskptr = m_labels->TileRow(t, i, row.data());
+			uchar* resptr = res.ptr<uchar>(rect.y + i) + rect.x;
+			for (int j = 0; j < rect.width; j++)
+				resptr[j] = nodeObjects[maskptr[j] - 1];
+		}
+	}
+	return res;
+}
+
+shared_ptr<const CutTopology> MultiObjectSnapping::GetTopology() const
+{
+	return m_topology;
+}
+
+void MultiObjectSnapping::SetClusterNum(int num)
+{
+	if (num < 1 || num > 100)
+	{
+		cout << "ClusterNum must be in [1, 100]." << endl;
+		return;
+	}
+	m_clusterNum = num;
+}
+
+void MultiObjectSnapping::clusterColors(ObjectCut& cut) const
+{
+	TRACE_SCOPE("object kmeans");
+	cut.ForeColors = clusterComps(cut.ForeComps);
+	cut.BackColors = clusterComps(cut.BackComps);
+}
+
+vector<Vec3b> MultiObjectSnapping::clusterComps(const vector<int>& comps) const
+{
+	ColorKmeans kmeans(m_clusterNum);
+	kmeans.Process(m_nodeColors, comps);
+	return kmeans.GetColors();
+}
+
+void MultiObjectSnapping::setTerminals(ObjectCut& cut) const
+{
+	// Source side is the rest and sink side is the object, as in LazySnapping.
+	int nodeCount = m_topology->NodeCount;
+	cut.TerminalCaps.resize(nodeCount);
+	cut.Flow = 0;
+	for (int i = 0; i < nodeCount; i++)
+	{
+		float source, sink;
+		if (binary_search(cut.ForeComps.begin(), cut.ForeComps.end(), i + 1))
+		{
+			source = 0;
+			sink = Infinite;
+		}
+		else if (binary_search(cut.BackComps.begin(), cut.BackComps.end(), i + 1))
+		{
+			source = Infinite;
+			sink = 0;
+		}
+		else
+		{
+			Point2f e1 = LikelihoodEnergy(m_nodeColors[i], cut.ForeColors, cut.BackColors);
+			source = e1.x;
+			sink = e1.y;
+		}
+		// Push the direct source to sink flow right away.
+		cut.Flow += min(source, sink);
+		cut.TerminalCaps[i] = source - sink;
+	}
+	cut.ResidualCaps = m_topology->Capacities;
+}
+
+void MultiObjectSnapping::solveCut(ObjectCut& cut) const
+{
+	TRACE_SCOPE("object maxflow");
+	const CutTopology& topology = *m_topology;
+	int nodeCount = topology.NodeCount;
+	vector<float>& terminal = cut.TerminalCaps;
+	vector<float>& residual = cut.ResidualCaps;
+
+	vector<int> level(nodeCount);
+	vector<int> current(nodeCount);
+	vector<int> queue(nodeCount);
+	vector<int> pathArcs;
+	vector<int> pathNodes;
+	while (true)
+	{
+		// Build the level graph from the nodes with residual source capacity.
+		fill(level.begin(), level.end(), -1);
+		int head = 0, tail = 0;
+		bool reached = false;
+		for (int i = 0; i < nodeCount; i++)
+		{
+			if (terminal[i] > 0)
+			{
+				level[i] = 0;
+				queue[tail++] = i;
+			}
+		}
+		while (head < tail)
+		{
+			int u = queue[head++];
+			if (terminal[u] < 0)
+			{
+				// Paths end at the nodes with residual sink capacity.
+				reached = true;
+				continue;
+			}
+			for (int a = topology.Offsets[u]; a < topology.Offsets[u + 1]; a++)
+			{
+				int v = topology.Heads[a];
+				if (residual[a] > 0 && level[v] < 0)
+				{
+					level[v] = level[u] + 1;
+					queue[tail++] = v;
+				}
+			}
+		}
+		if (!reached)
+			break;
+
+		// Find a blocking flow with depth first search.
+		copy(topology.Offsets.begin(), topology.Offsets.end() - 1, current.begin());
+		for (int s = 0; s < nodeCount; s++)
+		{
+			while (level[s] == 0 && terminal[s] > 0)
+			{
+				pathArcs.clear();
+				pathNodes.assign(1, s);
+				int u = s;
+				while (terminal[u] >= 0)
+				{
+					int& a = current[u];
+					while (a < topology.Offsets[u + 1] && (residual[a] <= 0 || level[topology.Heads[a]] != level[u] + 1))
+						a++;
+					if (a < topology.Offsets[u + 1])
+					{
+						pathArcs.push_back(a);
+						u = topology.Heads[a];
+						pathNodes.push_back(u);
+						continue;
+					}
+
+					// Dead end, retreat.
+					level[u] = -1;
+					if (pathArcs.empty())
+						break;
+					pathArcs.pop_back();
+					pathNodes.pop_back();
+					u = pathNodes.back();
+				}
+				if (level[s] != 0)
+					break;
+
+				// Augment along the path.
+				float bottleneck = min(terminal[s], -terminal[u]);
+				for each(auto& a in pathArcs)
+					bottleneck = min(bottleneck, residual[a]);
+				terminal[s] -= bottleneck;
+				terminal[u] += bottleneck;
+				for each(auto& a in pathArcs)
+				{
+					residual[a] -= bottleneck;
+					residual[topology.Sisters[a]] += bottleneck;
+				}
+				cut.Flow += bottleneck;
+			}
+		}
+	}
+
+	// Nodes that can still reach the sink belong to the object, the others stay on the source side.
+	cut.Labels.assign(nodeCount, 0);
+	int head = 0, tail = 0;
+	for (int i = 0; i < nodeCount; i++)
+	{
+		if (terminal[i] < 0)
+		{
+			cut.Labels[i] = 1;
+			queue[tail++] = i;
+		}
+	}
+	while (head < tail)
+	{
+		int u = queue[head++];
+		for (int a = topology.Offsets[u]; a < topology.Offsets[u + 1]; a++)
+		{
+			int v = topology.Heads[a];
+			if (!cut.Labels[v] && residual[topology.Sisters[a]] > 0)
+			{
+				cut.Labels[v] = 1;
+				queue[tail++] = v;
+			}
+		}
+	}
+}
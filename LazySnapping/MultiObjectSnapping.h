@@ -0,0 +1,120 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <memory>
+#include "WatershedHelper.h"
+#include "LabelMap.h"
+
+/// <summary>
+/// Immutable superpixel adjacency in CSR layout with the prior energy of every arc.
+/// Each adjacency becomes two arcs, one per direction, linked by their sister index.
+/// </summary>
+struct CutTopology
+{
+	CutTopology(const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections, float e2weight);
+
+	int NodeCount;
+	std::vector<int> Offsets;		// Arc range of every node, NodeCount + 1.
+	std::vector<int> Heads;			// Head node of every arc.
+	std::vector<int> Sisters;		// Reverse arc of every arc.
+	std::vector<float> Capacities;	// Prior energy of every arc.
+};
+
+/// <summary>
+/// Residual state of one object query on a shared topology.
+/// </summary>
+struct ObjectCut
+{
+	std::vector<int> ForeComps;
+	std::vector<int> BackComps;
+	std::vector<cv::Vec3b> ForeColors;
+	std::vector<cv::Vec3b> BackColors;
+	std::vector<float> TerminalCaps;	// Source capacity minus sink capacity of every node.
+	std::vector<float> ResidualCaps;	// Residual capacity of every arc.
+	std::vector<uchar> Labels;			// 1 for the object and 0 for the rest.
+	float Flow;
+};
+
+/// <summary>
+/// Segment several objects at once. Every object is an independent binary cut of its own seeds
+/// against everything else, solved in parallel on one shared superpixel topology.
+/// An extra object only costs its terminal and residual capacities.
+/// </summary>
+class MultiObjectSnapping
+{
+public:
+	MultiObjectSnapping(const cv::Mat& maskImage, const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections, int clusterNum = 64, float e2weight = 1000.0);
+
+	/// <summary>
+	/// Create on an existing topology, e.g. one shared with another instance of the same image.
+	/// </summary>
+	MultiObjectSnapping(std::shared_ptr<const LabelMap> labels, std::shared_ptr<const CutTopology> topology, const std::vector<cv::Vec3b>& nodeColors, int clusterNum = 64);
+	~MultiObjectSnapping();
+
+public:
+	/// <summary>
+	/// Segment all objects marked in the paint image.
+	/// </summary>
+	/// <param name="paintImage">The paint image. 1 to 254 for the seeds of each object, 255 for background mark.</param>
+	/// <returns>True for successful operation.</returns>
+	bool Process(const cv::Mat& paintImage);
+
+	/// <summary>
+	/// Get the number of objects of the last process, which is the largest object index marked.
+	/// </summary>
+	int GetObjectCount() const;
+
+	/// <summary>
+	/// Get the segmentation image of one object. 255 for the object and 0 for the rest.
+	/// </summary>
+	/// <param name="object">The object index, from 1 to GetObjectCount.</param>
+	cv::Mat GetSegmentation(int object) const;
+
+	/// <summary>
+	/// Get the object index of every pixel as a CV_8UC1 image, 0 for background.
+	/// As the cuts are independent, overlapping pixels take the smallest object index.
+	/// </summary>
+	cv::Mat GetObjectMap() const;
+
+	/// <summary>
+	/// Get the shared topology.
+	/// </summary>
+	std::shared_ptr<const CutTopology> GetTopology() const;
+
+	/// <summary>
+	/// Set kmeans cluster number.
+	/// </summary>
+	void SetClusterNum(int num);
+
+private:
+	/// <summary>
+	/// Cluster the seed colors of an object and its background.
+	/// </summary>
+	void clusterColors(ObjectCut& cut) const;
+
+	/// <summary>
+	/// Cluster the colors of the specified components.
+	/// </summary>
+	std::vector<cv::Vec3b> clusterComps(const std::vector<int>& comps) const;
+
+	/// <summary>
+	/// Set the terminal capacities from the likelihood energy and reset the residual capacities.
+	/// </summary>
+	void setTerminals(ObjectCut& cut) const;
+
+	/// <summary>
+	/// Solve the maximum flow of one object with Dinic's algorithm on the shared topology,
+	/// then label the nodes that can still reach the sink as the object.
+	/// </summary>
+	void solveCut(ObjectCut& cut) const;
+
+private:
+	std::shared_ptr<const LabelMap> m_labels;
+	std::shared_ptr<const CutTopology> m_topology;
+	std::vector<cv::Vec3b> m_nodeColors;
+	std::vector<ObjectCut> m_objects;
+
+	int m_clusterNum;
+	const float Infinite = 1e10;
+};
@@ -0,0 +1,295 @@
+#include "ProblemIO.h"
+#include "MappedFile.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+static const char ProblemMagic[8] = { 'L', 'S', 'C', 'U', 'T', '0', '1', '\0' };
+
+/// <summary>
+/// Header of the binary format. The terminal capacities, edges and edge capacities follow in this order.
+/// </summary>
+struct CutProblemHeader
+{
+	char Magic[8];
+	int32_t NodeCount;
+	int32_t Reserved;
+	int64_t EdgeCount;
+};
+
+static bool isDimacsPath(const string& path)
+{
+	auto endsWith = [&path](const string& suffix)
+	{
+		return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+	};
+	return endsWith(".max") || endsWith(".dimacs");
+}
+
+/// <summary>
+/// Parse a decimal integer and check that it is in [minValue, maxValue] before narrowing it.
+/// </summary>
+static bool parseInt(const char* text, char** end, long minValue, long maxValue, int& value)
+{
+	errno = 0;
+	long parsed = strtol(text, end, 10);
+	if (*end == text || errno == ERANGE || parsed < minValue || parsed > maxValue)
+		return false;
+	value = static_cast<int>(parsed);
+	return true;
+}
+
+/// <summary>
+/// Check that a capacity is a finite non negative number, which the solver requires.
+/// </summary>
+static bool isValidCapacity(float cap)
+{
+	return isfinite(cap) && cap >= 0;
+}
+
+void BuildGraph(const CutProblem& problem, Graph<float, float, float>& graph)
+{
+	graph.add_node(problem.NodeCount);
+	for (int i = 0; i < problem.NodeCount; i++)
+		graph.add_tweights(i, problem.TerminalCaps[i][0], problem.TerminalCaps[i][1]);
+	for (size_t k = 0; k < problem.Edges.size(); k++)
+		graph.add_edge(problem.Edges[k][0], problem.Edges[k][1], problem.EdgeCaps[k][0], problem.EdgeCaps[k][1]);
+}
+
+bool SaveDimacs(const string& path, const CutProblem& problem)
+{
+	ofstream file(path, ios::out | ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	int source = problem.NodeCount + 1, sink = problem.NodeCount + 2;
+	size_t arcCount = problem.Edges.size() * 2;
+	for each(auto& caps in problem.TerminalCaps)
+		arcCount += (caps[0] != 0) + (caps[1] != 0);
+
+	// 9 significant digits round trip every float.
+	file.precision(9);
+	file << "c LazySnapping cut problem" << "\n";
+	file << "p max " << problem.NodeCount + 2 << " " << arcCount << "\n";
+	file << "n " << source << " s" << "\n";
+	file << "n " << sink << " t" << "\n";
+	for (int i = 0; i < problem.NodeCount; i++)
+	{
+		if (problem.TerminalCaps[i][0] != 0)
+			file << "a " << source << " " << i + 1 << " " << problem.TerminalCaps[i][0] << "\n";
+		if (problem.TerminalCaps[i][1] != 0)
+			file << "a " << i + 1 << " " << sink << " " << problem.TerminalCaps[i][1] << "\n";
+	}
+	for (size_t k = 0; k < problem.Edges.size(); k++)
+	{
+		file << "a " << problem.Edges[k][0] + 1 << " " << problem.Edges[k][1] + 1 << " " << problem.EdgeCaps[k][0] << "\n";
+		file << "a " << problem.Edges[k][1] + 1 << " " << problem.Edges[k][0] + 1 << " " << problem.EdgeCaps[k][1] << "\n";
+	}
+	return static_cast<bool>(file.flush());
+}
+
+bool LoadDimacs(const string& path, CutProblem& problem)
+{
+	ifstream file(path);
+	if (!file.is_open())
+		return false;
+	file.seekg(0, ios::end);
+	long long fileSize = static_cast<long long>(file.tellg());
+	file.seekg(0, ios::beg);
+
+	problem = CutProblem();
+	int nodeNum = 0, source = 0, sink = 0;
+	vector<int> nodeIndex;		// File node id to problem node, -1 for the terminals.
+	bool lastOpen = false;		// Whether the last edge still waits for its reverse arc.
+	string line;
+	while (getline(file, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.empty() || line[0] == 'c')
+			continue;
+
+		const char* text = line.c_str() + 1;
+		char* end = nullptr;
+		if (line[0] == 'p')
+		{
+			// p max <nodes> <arcs>
+			while (*text == ' ' || *text == '\t')
+				text++;
+			if (strncmp(text, "max", 3) != 0)
+			{
+				cout << "Not a max flow problem: " << path << endl;
+				return false;
+			}
+			if (!parseInt(text + 3, &end, 0, INT_MAX - 1, nodeNum))
+			{
+				cout << "Bad DIMACS header: " << path << endl;
+				return false;
+			}
+		}
+		else if (line[0] == 'n')
+		{
+			// n <id> s|t
+			int id = 0;
+			if (!parseInt(text, &end, 1, INT_MAX, id))
+			{
+				cout << "Bad DIMACS node: " << line << endl;
+				return false;
+			}
+			while (*end == ' ' || *end == '\t')
+				end++;
+			if (*end == 's')
+				source = id;
+			else if (*end == 't')
+				sink = id;
+		}
+		else if (line[0] == 'a')
+		{
+			if (nodeIndex.empty())
+			{
+				// Nodes without arcs take no line, but a header with more nodes than the file has bytes is corrupt
+				// and would allocate far more than the file.
+				if (nodeNum < 2 || nodeNum > fileSize + 2 || source < 1 || sink < 1 || source > nodeNum || sink > nodeNum || source == sink)
+				{
+					cout << "Bad DIMACS header: " << path << endl;
+					return false;
+				}
+				// Number the non terminal nodes in id order.
+				nodeIndex.assign(nodeNum + 1, -1);
+				for (int id = 1; id <= nodeNum; id++)
+				{
+					if (id != source && id != sink)
+						nodeIndex[id] = problem.NodeCount++;
+				}
+				problem.TerminalCaps.assign(problem.NodeCount, Vec2f(0, 0));
+			}
+
+			// a <from> <to> <capacity>
+			int from = 0, to = 0;
+			bool valid = parseInt(text, &end, 1, nodeNum, from) && parseInt(end, &end, 1, nodeNum, to);
+			const char* capText = end;
+			float cap = valid ? strtof(capText, &end) : 0;
+			// Self loops, terminal ones included, have no place in the graph.
+			if (!valid || end == capText || !isValidCapacity(cap) || from == to)
+			{
+				cout << "Bad DIMACS arc: " << line << endl;
+				return false;
+			}
+
+			// Arcs into the source or out of the sink never carry flow.
+			if (from == source && to != sink)
+				problem.TerminalCaps[nodeIndex[to]][0] += cap;
+			else if (to == sink && from != source)
+				problem.TerminalCaps[nodeIndex[from]][1] += cap;
+			else if (from != sink && to != source && from != source)
+			{
+				int a = nodeIndex[from], b = nodeIndex[to];
+				if (lastOpen && problem.Edges.back() == Vec2i(b, a))
+				{
+					problem.EdgeCaps.back()[1] = cap;
+					lastOpen = false;
+					continue;
+				}
+				problem.Edges.push_back(Vec2i(a, b));
+				problem.EdgeCaps.push_back(Vec2f(cap, 0));
+				lastOpen = true;
+				continue;
+			}
+			else if (from == source && to == sink)
+				cout << "Skip source to sink arc, the flow value will be lower by " << cap << endl;
+		}
+		lastOpen = false;
+	}
+	return !nodeIndex.empty();
+}
+
+bool SaveBinary(const string& path, const CutProblem& problem)
+{
+	CutProblemHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, ProblemMagic, sizeof(ProblemMagic));
+	header.NodeCount = problem.NodeCount;
+	header.EdgeCount = static_cast<int64_t>(problem.Edges.size());
+
+	ofstream file(path, ios::binary | ios::trunc);
+	if (!file)
+		return false;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!problem.TerminalCaps.empty())
+		file.write(reinterpret_cast<const char*>(problem.TerminalCaps.data()), problem.TerminalCaps.size() * sizeof(Vec2f));
+	if (!problem.Edges.empty())
+	{
+		file.write(reinterpret_cast<const char*>(problem.Edges.data()), problem.Edges.size() * sizeof(Vec2i));
+		file.write(reinterpret_cast<const char*>(problem.EdgeCaps.data()), problem.EdgeCaps.size() * sizeof(Vec2f));
+	}
+	return static_cast<bool>(file.flush());
+}
+
+bool LoadBinary(const string& path, CutProblem& problem)
+{
+	MappedFile file;
+	if (!file.Open(path) || file.Size() < sizeof(CutProblemHeader))
+		return false;
+
+	// Validate the header before trusting any size. Each count is bounded by the file size first, so the total cannot overflow.
+	const CutProblemHeader* header = reinterpret_cast<const CutProblemHeader*>(file.Data());
+	size_t edgeBytes = sizeof(Vec2i) + sizeof(Vec2f);
+	if (memcmp(header->Magic, ProblemMagic, sizeof(ProblemMagic)) != 0 || header->NodeCount < 0 || header->EdgeCount < 0
+		|| static_cast<uint64_t>(header->NodeCount) > file.Size() / sizeof(Vec2f) || static_cast<uint64_t>(header->EdgeCount) > file.Size() / edgeBytes
+		|| file.Size() != sizeof(CutProblemHeader) + static_cast<size_t>(header->NodeCount) * sizeof(Vec2f) + static_cast<size_t>(header->EdgeCount) * edgeBytes)
+	{
+		cout << "Not a cut problem file: " << path << endl;
+		return false;
+	}
+
+	const Vec2f* terminalCaps = reinterpret_cast<const Vec2f*>(file.Data() + sizeof(CutProblemHeader));
+	const Vec2i* edges = reinterpret_cast<const Vec2i*>(terminalCaps + header->NodeCount);
+	const Vec2f* edgeCaps = reinterpret_cast<const Vec2f*>(edges + header->EdgeCount);
+	problem.NodeCount = header->NodeCount;
+	problem.TerminalCaps.assign(terminalCaps, terminalCaps + header->NodeCount);
+	problem.Edges.assign(edges, edges + header->EdgeCount);
+	problem.EdgeCaps.assign(edgeCaps, edgeCaps + header->EdgeCount);
+	for each(auto& edge in problem.Edges)
+	{
+		if (edge[0] < 0 || edge[1] < 0 || edge[0] >= problem.NodeCount || edge[1] >= problem.NodeCount || edge[0] == edge[1])
+		{
+			cout << "Bad edge in cut problem file: " << path << endl;
+			return false;
+		}
+	}
+	for each(auto& caps in problem.TerminalCaps)
+	{
+		if (!isValidCapacity(caps[0]) || !isValidCapacity(caps[1]))
+		{
+			cout << "Bad terminal capacity in cut problem file: " << path << endl;
+			return false;
+		}
+	}
+	for each(auto& caps in problem.EdgeCaps)
+	{
+		if (!isValidCapacity(caps[0]) || !isValidCapacity(caps[1]))
+		{
+			cout << "Bad edge capacity in cut problem file: " << path << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LoadProblem(const string& path, CutProblem& problem)
+{
+	return isDimacsPath(path) ? LoadDimacs(path, problem) : LoadBinary(path, problem);
+}
+
+bool SaveProblem(const string& path, const CutProblem& problem)
+{
+	return isDimacsPath(path) ? SaveDimacs(path, problem) : SaveBinary(path, problem);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <string>
+#include "graph.h"
+
+/// <summary>
+/// A binary min cut problem stored independent of any solver.
+/// </summary>
+struct CutProblem
+{
+	int NodeCount = 0;
+	std::vector<cv::Vec2f> TerminalCaps;	// Source and sink capacity of every node.
+	std::vector<cv::Vec2i> Edges;			// Node pairs, 0-based.
+	std::vector<cv::Vec2f> EdgeCaps;		// Capacity and reverse capacity of every edge.
+};
+
+/// <summary>
+/// Add the nodes and edges of a cut problem to an empty graph.
+/// </summary>
+void BuildGraph(const CutProblem& problem, Graph<float, float, float>& graph);
+
+/// <summary>
+/// Write a cut problem in DIMACS max flow format. Nodes are numbered from 1, the source is node count + 1
+/// and the sink is node count + 2. Every edge is written as its two arcs, one after the other.
+/// </summary>
+/// <param name="path">The file path.</param>
+/// <param name="problem">The cut problem.</param>
+/// <returns>True for successful operation.</returns>
+bool SaveDimacs(const std::string& path, const CutProblem& problem);
+
+/// <summary>
+/// Read a DIMACS max flow file. Arcs from the source and to the sink become terminal capacities,
+/// and an arc directly following its reverse arc is merged into one edge. Self loops, ids out of range
+/// and capacities that are negative or not finite are rejected.
+/// </summary>
+/// <param name="path">The file path.</param>
+/// <param name="problem">The cut problem.</param>
+/// <returns>True for successful operation.</returns>
+bool LoadDimacs(const std::string& path, CutProblem& problem);
+
+/// <summary>
+/// Write a cut problem in binary format: a fixed header followed by the raw arrays.
+/// </summary>
+/// <param name="path">The file path.</param>
+/// <param name="problem">The cut problem.</param>
+/// <returns>True for successful operation.</returns>
+bool SaveBinary(const std::string& path, const CutProblem& problem);
+
+/// <summary>
+/// Read a binary cut problem. The file is memory mapped and validated before use. Self loops and
+/// capacities that are negative or not finite are rejected.
+/// </summary>
+/// <param name="path">The file path.</param>
+/// <param name="problem">The cut problem.</param>
+/// <returns>True for successful operation.</returns>
+bool LoadBinary(const std::string& path, CutProblem& problem);
+
+/// <summary>
+/// Read a cut problem in DIMACS format if the path ends with ".max" or ".dimacs", and in binary format otherwise.
+/// </summary>
+bool LoadProblem(const std::string& path, CutProblem& problem);
+
+/// <summary>
+/// Write a cut problem in DIMACS format if the path ends with ".max" or ".dimacs", and in binary format otherwise.
+/// </summary>
+bool SaveProblem(const std::string& path, const CutProblem& problem);
@@ -0,0 +1,196 @@
+#include "SessionHistory.h"
+#include <iostream>
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+using namespace cv;
+
+size_t Checkpoint::GetMemoryUsage() const
+{
+	return sizeof(Checkpoint)
+		+ PaintIndices.size() * (sizeof(int) + 2 * sizeof(uchar))
+		+ (ChangedNodes.size() + ForeAdded.size() + ForeRemoved.size() + BackAdded.size() + BackRemoved.size()) * sizeof(int)
+		+ (ForeColorsBefore.size() + ForeColorsAfter.size() + BackColorsBefore.size() + BackColorsAfter.size()) * sizeof(Vec3b);
+}
+
+SessionHistory::SessionHistory(const Size& imageSize, int nodeCount, size_t memoryBudget /* = 64 << 20 */)
+	: m_memoryBudget(memoryBudget), m_memoryUsage(0)
+{
+	m_paint = Mat::zeros(imageSize, CV_8UC1);
+	m_nodeLabels.assign(nodeCount, 0);
+}
+
+SessionHistory::~SessionHistory()
+{
+}
+
+void SessionHistory::Commit(const Mat& paintImage, const LazySnapping& snapping)
+{
+	if (paintImage.size() != m_paint.size() || paintImage.type() != CV_8UC1)
+		throw new exception("Paint image must be CV_8UC1 with the history size.");
+	const vector<uchar>& nodeLabels = snapping.GetNodeLabels();
+	if (nodeLabels.size() != m_nodeLabels.size())
+		throw new exception("Node label number not match.");
+
+	Checkpoint checkpoint;
+	for (int i = 0; i < paintImage.rows; i++)
+	{
+		const uchar* paintptr = paintImage.ptr<uchar>(i);
+		uchar* oldptr = m_paint.ptr<uchar>(i);
+		for (int j = 0; j < paintImage.cols; j++)
+		{
+			if (paintptr[j] == oldptr[j])
+				continue;
+			checkpoint.PaintIndices.push_back(i * paintImage.cols + j);
+			checkpoint.PaintBefore.push_back(oldptr[j]);
+			checkpoint.PaintAfter.push_back(paintptr[j]);
+			oldptr[j] = paintptr[j];
+		}
+	}
+	for (size_t i = 0; i < nodeLabels.size(); i++)
+	{
+		if (nodeLabels[i] != m_nodeLabels[i])
+			checkpoint.ChangedNodes.push_back(static_cast<int>(i));
+	}
+	m_nodeLabels = nodeLabels;
+
+	vector<int> foreComps, backComps;
+	snapping.GetMarks(foreComps, backComps);
+	checkpoint.ForeAdded = difference(foreComps, m_foreComps);
+	checkpoint.ForeRemoved = difference(m_foreComps, foreComps);
+	checkpoint.BackAdded = difference(backComps, m_backComps);
+	checkpoint.BackRemoved = difference(m_backComps, backComps);
+	m_foreComps.swap(foreComps);
+	m_backComps.swap(backComps);
+
+	vector<Vec3b> foreColors, backColors;
+	snapping.GetColorModels(foreColors, backColors);
+	checkpoint.ForeColorsBefore.swap(m_foreColors);
+	checkpoint.BackColorsBefore.swap(m_backColors);
+	checkpoint.ForeColorsAfter = foreColors;
+	checkpoint.BackColorsAfter = backColors;
+	m_foreColors.swap(foreColors);
+	m_backColors.swap(backColors);
+
+	for each(auto& item in m_redoStack)
+		m_memoryUsage -= item.GetMemoryUsage();
+	m_redoStack.clear();
+	m_memoryUsage += checkpoint.GetMemoryUsage();
+	m_undoStack.push_back(move(checkpoint));
+	enforceBudget();
+}
+
+bool SessionHistory::Undo(Mat& paintImage, LazySnapping& snapping)
+{
+	if (m_undoStack.empty())
+		return false;
+
+	apply(m_undoStack.back(), false, paintImage, snapping);
+	m_redoStack.push_back(move(m_undoStack.back()));
+	m_undoStack.pop_back();
+	return true;
+}
+
+bool SessionHistory::Redo(Mat& paintImage, LazySnapping& snapping)
+{
+	if (m_redoStack.empty())
+		return false;
+
+	apply(m_redoStack.back(), true, paintImage, snapping);
+	m_undoStack.push_back(move(m_redoStack.back()));
+	m_redoStack.pop_back();
+	return true;
+}
+
+void SessionHistory::Clear()
+{
+	m_undoStack.clear();
+	m_redoStack.clear();
+	m_restoredPixels.clear();
+	m_memoryUsage = 0;
+
+	m_paint = Scalar::all(0);
+	fill(m_nodeLabels.begin(), m_nodeLabels.end(), 0);
+	m_foreComps.clear();
+	m_backComps.clear();
+	m_foreColors.clear();
+	m_backColors.clear();
+}
+
+const vector<int>& SessionHistory::GetRestoredPixels() const
+{
+	return m_restoredPixels;
+}
+
+void SessionHistory::SetMemoryBudget(size_t bytes)
+{
+	m_memoryBudget = bytes;
+	enforceBudget();
+}
+
+size_t SessionHistory::GetMemoryUsage() const
+{
+	return m_memoryUsage;
+}
+
+bool SessionHistory::CanUndo() const
+{
+	return !m_undoStack.empty();
+}
+
+bool SessionHistory::CanRedo() const
+{
+	return !m_redoStack.empty();
+}
+
+void SessionHistory::apply(const Checkpoint& checkpoint, bool forward, Mat& paintImage, LazySnapping& snapping)
+{
+	if (paintImage.size() != m_paint.size() || paintImage.type() != CV_8UC1 || !paintImage.isContinuous())
+		throw new exception("Paint image must be continuous CV_8UC1 with the history size.");
+
+	// Paint pixels.
+	const vector<uchar>& values = forward ? checkpoint.PaintAfter : checkpoint.PaintBefore;
+	uchar* paintptr = paintImage.ptr<uchar>(0);
+	uchar* currentptr = m_paint.ptr<uchar>(0);
+	for (size_t k = 0; k < checkpoint.PaintIndices.size(); k++)
+		paintptr[checkpoint.PaintIndices[k]] = currentptr[checkpoint.PaintIndices[k]] = values[k];
+	m_restoredPixels = checkpoint.PaintIndices;
+
+	// Labels are binary, so a changed node just flips.
+	for each(auto& node in checkpoint.ChangedNodes)
+		m_nodeLabels[node] = !m_nodeLabels[node];
+
+	// Marks.
+	const vector<int>& foreAdded = forward ? checkpoint.ForeAdded : checkpoint.ForeRemoved;
+	const vector<int>& foreRemoved = forward ? checkpoint.ForeRemoved : checkpoint.ForeAdded;
+	const vector<int>& backAdded = forward ? checkpoint.BackAdded : checkpoint.BackRemoved;
+	const vector<int>& backRemoved = forward ? checkpoint.BackRemoved : checkpoint.BackAdded;
+	vector<int> temp;
+	set_union(m_foreComps.begin(), m_foreComps.end(), foreAdded.begin(), foreAdded.end(), back_inserter(temp));
+	m_foreComps = difference(temp, foreRemoved);
+	temp.clear();
+	set_union(m_backComps.begin(), m_backComps.end(), backAdded.begin(), backAdded.end(), back_inserter(temp));
+	m_backComps = difference(temp, backRemoved);
+
+	m_foreColors = forward ? checkpoint.ForeColorsAfter : checkpoint.ForeColorsBefore;
+	m_backColors = forward ? checkpoint.BackColorsAfter : checkpoint.BackColorsBefore;
+
+	snapping.RestoreResult(m_foreComps, m_backComps, m_foreColors, m_backColors, m_nodeLabels);
+}
+
+void SessionHistory::enforceBudget()
+{
+	while (m_memoryUsage > m_memoryBudget && !m_undoStack.empty())
+	{
+		m_memoryUsage -= m_undoStack.front().GetMemoryUsage();
+		m_undoStack.pop_front();
+	}
+}
+
+vector<int> SessionHistory::difference(const vector<int>& a, const vector<int>& b)
+{
+	vector<int> res;
+	set_difference(a.begin(), a.end(), b.begin(), b.end(), back_inserter(res));
+	return res;
+}
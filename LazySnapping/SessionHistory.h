@@ -0,0 +1,118 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <deque>
+#include "LazySnapping.h"
+
+/// <summary>
+/// Difference between two consecutive results of an interactive session.
+/// </summary>
+struct Checkpoint
+{
+	std::vector<int> PaintIndices;		// Changed paint pixels in row major order.
+	std::vector<uchar> PaintBefore;
+	std::vector<uchar> PaintAfter;
+	std::vector<int> ChangedNodes;		// Components whose label flips.
+	std::vector<int> ForeAdded;
+	std::vector<int> ForeRemoved;
+	std::vector<int> BackAdded;
+	std::vector<int> BackRemoved;
+	std::vector<cv::Vec3b> ForeColorsBefore;
+	std::vector<cv::Vec3b> ForeColorsAfter;
+	std::vector<cv::Vec3b> BackColorsBefore;
+	std::vector<cv::Vec3b> BackColorsAfter;
+
+	/// <summary>
+	/// Get the memory used by the checkpoint in bytes.
+	/// </summary>
+	size_t GetMemoryUsage() const;
+};
+
+/// <summary>
+/// Undo and redo stack of lazy snapping results. Every checkpoint only stores the changes to the
+/// previous result, so undo and redo take time proportional to the change instead of a new solve.
+/// The oldest checkpoints are dropped when the memory budget is exceeded.
+/// </summary>
+class SessionHistory
+{
+public:
+	SessionHistory(const cv::Size& imageSize, int nodeCount, size_t memoryBudget = 64 << 20);
+	~SessionHistory();
+
+public:
+	/// <summary>
+	/// Record the result of a successful process. The redo stack is cleared.
+	/// </summary>
+	/// <param name="paintImage">The paint image used by the process.</param>
+	/// <param name="snapping">The lazy snapping instance after the process.</param>
+	void Commit(const cv::Mat& paintImage, const LazySnapping& snapping);
+
+	/// <summary>
+	/// Go back to the previous result.
+	/// </summary>
+	/// <param name="paintImage">The paint image, restored in place.</param>
+	/// <param name="snapping">The lazy snapping instance, restored without solving.</param>
+	/// <returns>False if there is nothing to undo.</returns>
+	bool Undo(cv::Mat& paintImage, LazySnapping& snapping);
+
+	/// <summary>
+	/// Go forward to the next result.
+	/// </summary>
+	/// <returns>False if there is nothing to redo.</returns>
+	bool Redo(cv::Mat& paintImage, LazySnapping& snapping);
+
+	/// <summary>
+	/// Drop all checkpoints and start from an empty paint image and an empty result.
+	/// </summary>
+	void Clear();
+
+	/// <summary>
+	/// Get the paint pixels changed by the last undo or redo in row major order.
+	/// </summary>
+	const std::vector<int>& GetRestoredPixels() const;
+
+	/// <summary>
+	/// Set the memory budget of the checkpoints in bytes.
+	/// </summary>
+	void SetMemoryBudget(size_t bytes);
+
+	/// <summary>
+	/// Get the memory used by the checkpoints in bytes.
+	/// </summary>
+	size_t GetMemoryUsage() const;
+
+	bool CanUndo() const;
+	bool CanRedo() const;
+
+private:
+	/// <summary>
+	/// Apply a checkpoint forward or backward to the current state and restore it.
+	/// </summary>
+	void apply(const Checkpoint& checkpoint, bool forward, cv::Mat& paintImage, LazySnapping& snapping);
+
+	/// <summary>
+	/// Drop the oldest checkpoints until the memory budget is met.
+	/// </summary>
+	void enforceBudget();
+
+	/// <summary>
+	/// Get a - b for sorted id sets.
+	/// </summary>
+	static std::vector<int> difference(const std::vector<int>& a, const std::vector<int>& b);
+
+private:
+	std::deque<Checkpoint> m_undoStack;
+	std::vector<Checkpoint> m_redoStack;
+	std::vector<int> m_restoredPixels;
+	size_t m_memoryBudget;
+	size_t m_memoryUsage;
+
+	// The current result.
+	cv::Mat m_paint;
+	std::vector<uchar> m_nodeLabels;
+	std::vector<int> m_foreComps;
+	std::vector<int> m_backComps;
+	std::vector<cv::Vec3b> m_foreColors;
+	std::vector<cv::Vec3b> m_backColors;
+};
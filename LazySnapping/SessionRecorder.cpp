@@ -0,0 +1,295 @@
+#include "SessionRecorder.h"
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace cv;
+
+static const string SessionHeader = "# LazySnapping session v1";
+
+/// <summary>
+/// Read one line without the carriage return of files checked out with Windows line endings.
+/// </summary>
+static bool readLine(istream& stream, string& line)
+{
+	if (!getline(stream, line))
+		return false;
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+	return true;
+}
+
+SessionRecorder::SessionRecorder()
+	: m_mode(0)
+{
+}
+
+SessionRecorder::~SessionRecorder()
+{
+	Close();
+}
+
+bool SessionRecorder::Open(const string& path, const string& imagePath)
+{
+	Close();
+	m_file.open(path, ios::out | ios::trunc);
+	if (!m_file.is_open())
+		return false;
+	m_file << SessionHeader << endl;
+	m_file << "image " << imagePath << endl;
+	return true;
+}
+
+void SessionRecorder::Close()
+{
+	if (m_file.is_open())
+		m_file.close();
+	m_points.clear();
+}
+
+bool SessionRecorder::IsOpen() const
+{
+	return m_file.is_open();
+}
+
+void SessionRecorder::BeginStroke(int mode, const Point& pos)
+{
+	m_mode = mode;
+	m_points.assign(1, pos);
+}
+
+void SessionRecorder::AddPoint(const Point& pos)
+{
+	m_points.push_back(pos);
+}
+
+void SessionRecorder::EndStroke()
+{
+	if (!IsOpen() || m_points.size() < 2)
+		return;
+
+	// stroke <mode> <count> x0 y0 x1 y1 ...
+	m_file << "stroke " << m_mode << " " << m_points.size();
+	for each(auto& pos in m_points)
+		m_file << " " << pos.x << " " << pos.y;
+	m_file << endl;
+	m_points.clear();
+}
+
+void SessionRecorder::RecordClusterNum(int num)
+{
+	if (IsOpen())
+		m_file << "cluster " << num << endl;
+}
+
+void SessionRecorder::RecordE2Weight(float weight)
+{
+	if (IsOpen())
+		m_file << "e2weight " << weight << endl;
+}
+
+void SessionRecorder::RecordReset()
+{
+	if (IsOpen())
+		m_file << "reset" << endl;
+}
+
+void SessionRecorder::RecordUndo()
+{
+	if (IsOpen())
+		m_file << "undo" << endl;
+}
+
+void SessionRecorder::RecordRedo()
+{
+	if (IsOpen())
+		m_file << "redo" << endl;
+}
+
+void SessionRecorder::RecordRoiMode(bool enable)
+{
+	if (IsOpen())
+		m_file << "roi " << (enable ? 1 : 0) << endl;
+}
+
+void SessionRecorder::RecordParametric(float minWeight, float maxWeight)
+{
+	if (IsOpen())
+		m_file << "parametric " << minWeight << " " << maxWeight << endl;
+}
+
+void SessionRecorder::RecordLookupBits(int bits)
+{
+	if (IsOpen())
+		m_file << "lookup " << bits << endl;
+}
+
+void SessionRecorder::RecordDeadline(double milliseconds)
+{
+	if (IsOpen())
+		m_file << "deadline " << milliseconds << endl;
+}
+
+void SessionRecorder::RecordResume()
+{
+	if (IsOpen())
+		m_file << "resume" << endl;
+}
+
+bool SessionRecorder::ParseEvent(const string& line, SessionEvent& event)
+{
+	istringstream stream(line);
+	string type;
+	stream >> type;
+
+	event.Mode = 0;
+	event.Value = 0;
+	event.MaxValue = 0;
+	event.Points.clear();
+	if (type == "stroke")
+	{
+		size_t count = 0;
+		event.EventType = SessionEvent::Type::Stroke;
+		stream >> event.Mode >> count;
+		for (size_t k = 0; k < count && stream; k++)
+		{
+			Point pos;
+			stream >> pos.x >> pos.y;
+			event.Points.push_back(pos);
+		}
+	}
+	else if (type == "cluster")
+	{
+		event.EventType = SessionEvent::Type::ClusterNum;
+		stream >> event.Value;
+	}
+	else if (type == "e2weight")
+	{
+		event.EventType = SessionEvent::Type::E2Weight;
+		stream >> event.Value;
+	}
+	else if (type == "reset")
+	{
+		event.EventType = SessionEvent::Type::Reset;
+	}
+	else if (type == "undo")
+	{
+		event.EventType = SessionEvent::Type::Undo;
+	}
+	else if (type == "redo")
+	{
+		event.EventType = SessionEvent::Type::Redo;
+	}
+	else if (type == "roi")
+	{
+		event.EventType = SessionEvent::Type::RoiMode;
+		stream >> event.Value;
+	}
+	else if (type == "parametric")
+	{
+		event.EventType = SessionEvent::Type::Parametric;
+		stream >> event.Value >> event.MaxValue;
+	}
+	else if (type == "lookup")
+	{
+		event.EventType = SessionEvent::Type::LookupBits;
+		stream >> event.Value;
+	}
+	else if (type == "deadline")
+	{
+		event.EventType = SessionEvent::Type::Deadline;
+		stream >> event.Value;
+	}
+	else if (type == "resume")
+	{
+		event.EventType = SessionEvent::Type::Resume;
+	}
+	else
+	{
+		cout << "Unknown session event: " << line << endl;
+		return false;
+	}
+	if (stream.fail())
+	{
+		cout << "Bad session event: " << line << endl;
+		return false;
+	}
+	return true;
+}
+
+string SessionRecorder::FormatEvent(const SessionEvent& event)
+{
+	ostringstream stream;
+	switch (event.EventType)
+	{
+	case SessionEvent::Type::Stroke:
+		// stroke <mode> <count> x0 y0 x1 y1 ...
+		stream << "stroke " << event.Mode << " " << event.Points.size();
+		for each(auto& pos in event.Points)
+			stream << " " << pos.x << " " << pos.y;
+		break;
+	case SessionEvent::Type::ClusterNum:
+		stream << "cluster " << static_cast<int>(event.Value);
+		break;
+	case SessionEvent::Type::E2Weight:
+		stream << "e2weight " << event.Value;
+		break;
+	case SessionEvent::Type::Reset:
+		stream << "reset";
+		break;
+	case SessionEvent::Type::Undo:
+		stream << "undo";
+		break;
+	case SessionEvent::Type::Redo:
+		stream << "redo";
+		break;
+	case SessionEvent::Type::RoiMode:
+		stream << "roi " << (event.Value != 0 ? 1 : 0);
+		break;
+	case SessionEvent::Type::Parametric:
+		stream << "parametric " << event.Value << " " << event.MaxValue;
+		break;
+	case SessionEvent::Type::LookupBits:
+		stream << "lookup " << static_cast<int>(event.Value);
+		break;
+	case SessionEvent::Type::Deadline:
+		stream << "deadline " << event.Value;
+		break;
+	case SessionEvent::Type::Resume:
+		stream << "resume";
+		break;
+	}
+	return stream.str();
+}
+
+bool SessionRecorder::Load(const string& path, string& imagePath, vector<SessionEvent>& events)
+{
+	ifstream file(path);
+	if (!file.is_open())
+		return false;
+
+	string line;
+	if (!readLine(file, line) || line != SessionHeader)
+	{
+		cout << "Not a session file: " << path << endl;
+		return false;
+	}
+
+	imagePath.clear();
+	events.clear();
+	while (readLine(file, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (line.compare(0, 6, "image ") == 0)
+		{
+			imagePath = line.substr(6);
+			continue;
+		}
+		SessionEvent event;
+		if (!ParseEvent(line, event))
+			return false;
+		events.push_back(event);
+	}
+	return !imagePath.empty();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+
+/// <summary>
+/// One user action of an interactive session.
+/// </summary>
+struct SessionEvent
+{
+	enum class Type
+	{
+		Stroke,		// Paint a polyline and process.
+		ClusterNum,	// Set kmeans cluster number and process.
+		E2Weight,	// Set prior energy weight and process, or select it from the parametric result.
+		Reset,		// Clear the paint image.
+		Undo,		// Go back to the previous result.
+		Redo,		// Go forward to the next result.
+		RoiMode,	// Enable or disable solving around new strokes.
+		Parametric,	// Solve for a range of prior energy weights.
+		LookupBits,	// Set likelihood energy lookup bits and process.
+		Deadline,	// Set the solve deadline in milliseconds.
+		Resume		// Continue an incomplete solve.
+	};
+
+	Type EventType;
+	int Mode;						// Stroke mode. 0 for foreground and 1 for background.
+	std::vector<cv::Point> Points;	// Stroke polyline.
+	float Value;					// Parameter value.
+	float MaxValue;					// Upper end of the parametric weight range.
+};
+
+/// <summary>
+/// Record the strokes and parameter changes of an interactive session to a text file, one event per line.
+/// </summary>
+class SessionRecorder
+{
+public:
+	SessionRecorder();
+	~SessionRecorder();
+
+public:
+	/// <summary>
+	/// Start a new session file.
+	/// </summary>
+	/// <param name="path">The session file path.</param>
+	/// <param name="imagePath">The image the session works on.</param>
+	/// <returns>True for successful operation.</returns>
+	bool Open(const std::string& path, const std::string& imagePath);
+	void Close();
+	bool IsOpen() const;
+
+	void BeginStroke(int mode, const cv::Point& pos);
+	void AddPoint(const cv::Point& pos);
+
+	/// <summary>
+	/// Write the current stroke. Called when the stroke is processed.
+	/// </summary>
+	void EndStroke();
+
+	void RecordClusterNum(int num);
+	void RecordE2Weight(float weight);
+	void RecordReset();
+	void RecordUndo();
+	void RecordRedo();
+	void RecordRoiMode(bool enable);
+	void RecordParametric(float minWeight, float maxWeight);
+	void RecordLookupBits(int bits);
+	void RecordDeadline(double milliseconds);
+	void RecordResume();
+
+	/// <summary>
+	/// Read a session file.
+	/// </summary>
+	/// <param name="path">The session file path.</param>
+	/// <param name="imagePath">The image the session works on.</param>
+	/// <param name="events">The events in order.</param>
+	/// <returns>True for successful operation.</returns>
+	static bool Load(const std::string& path, std::string& imagePath, std::vector<SessionEvent>& events);
+
+	/// <summary>
+	/// Parse one event line of a session file.
+	/// </summary>
+	/// <returns>True for successful operation.</returns>
+	static bool ParseEvent(const std::string& line, SessionEvent& event);
+
+	/// <summary>
+	/// Format an event as one line of a session file, without the line break.
+	/// </summary>
+	static std::string FormatEvent(const SessionEvent& event);
+
+private:
+	std::ofstream m_file;
+	int m_mode;
+	std::vector<cv::Point> m_points;
+};
@@ -0,0 +1,107 @@
+#include "SessionReplay.h"
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+
+SessionReplay::SessionReplay(LazySnapping& snapping)
+	: m_snapping(snapping), m_history(snapping.GetLabelMap()->Size(), static_cast<int>(snapping.GetNodeLabels().size())),
+	m_parametricSolved(false), m_hasResult(false)
+{
+	m_paint = Mat::zeros(snapping.GetLabelMap()->Size(), CV_8UC1);
+}
+
+SessionReplay::~SessionReplay()
+{
+}
+
+bool SessionReplay::Apply(const SessionEvent& event)
+{
+	bool solved = false;
+	switch (event.EventType)
+	{
+	case SessionEvent::Type::Stroke:
+		for (size_t k = 1; k < event.Points.size(); k++)
+			line(m_paint, event.Points[k - 1], event.Points[k], Scalar(event.Mode + 1), 2);
+		if (!event.Points.empty())
+		{
+			// Report the changed paint around the 2 pixel thick lines.
+			Rect bounds = boundingRect(event.Points);
+			m_snapping.AddPaintRegion(Rect(bounds.tl() - Point(2, 2), bounds.br() + Point(2, 2)));
+		}
+		solved = process();
+		break;
+	case SessionEvent::Type::ClusterNum:
+		m_snapping.SetClusterNum(static_cast<int>(event.Value));
+		solved = process();
+		break;
+	case SessionEvent::Type::E2Weight:
+		// Reuse the parametric result when the weight is inside its range.
+		if (m_parametricSolved && m_snapping.SelectE2Weight(event.Value))
+		{
+			solved = true;
+			break;
+		}
+		m_snapping.SetE2Weight(event.Value);
+		solved = process();
+		break;
+	case SessionEvent::Type::Reset:
+		m_paint = Scalar::all(0);
+		m_snapping.ResetRoi();
+		m_history.Clear();
+		m_parametricSolved = false;
+		m_hasResult = false;
+		return false;
+	case SessionEvent::Type::Undo:
+		if (!m_history.Undo(m_paint, m_snapping))
+			return false;
+		m_hasResult = true;
+		return true;
+	case SessionEvent::Type::Redo:
+		if (!m_history.Redo(m_paint, m_snapping))
+			return false;
+		m_hasResult = true;
+		return true;
+	case SessionEvent::Type::RoiMode:
+		m_snapping.SetRoiMode(event.Value != 0);
+		return false;
+	case SessionEvent::Type::Parametric:
+		m_parametricSolved = solved = m_snapping.ProcessParametric(m_paint, event.Value, event.MaxValue);
+		break;
+	case SessionEvent::Type::LookupBits:
+		m_snapping.SetE1LookupBits(static_cast<int>(event.Value));
+		solved = process();
+		break;
+	case SessionEvent::Type::Deadline:
+		m_snapping.SetSolveDeadline(event.Value);
+		return false;
+	case SessionEvent::Type::Resume:
+		if (m_snapping.IsSolveComplete())
+			return false;
+		m_snapping.ResumeSolve();
+		solved = true;
+		break;
+	}
+
+	if (!solved)
+		return false;
+	m_history.Commit(m_paint, m_snapping);
+	m_hasResult = true;
+	return true;
+}
+
+bool SessionReplay::HasResult() const
+{
+	return m_hasResult;
+}
+
+const Mat& SessionReplay::GetPaint() const
+{
+	return m_paint;
+}
+
+bool SessionReplay::process()
+{
+	m_parametricSolved = false;
+	return m_snapping.Process(m_paint);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include "LazySnapping.h"
+#include "SessionHistory.h"
+#include "SessionRecorder.h"
+
+/// <summary>
+/// Apply session events to lazy snapping the same way the interactive loop does. It owns the paint
+/// image and the undo history, so undo, redo and the parametric weight selection replay faithfully.
+/// </summary>
+class SessionReplay
+{
+public:
+	SessionReplay(LazySnapping& snapping);
+	~SessionReplay();
+
+public:
+	/// <summary>
+	/// Apply one event.
+	/// </summary>
+	/// <returns>True if the event produced a new segmentation, by a solve or by undo and redo.</returns>
+	bool Apply(const SessionEvent& event);
+
+	/// <summary>
+	/// Check whether the current marks have a segmentation. It is false after a reset until the next successful solve.
+	/// </summary>
+	bool HasResult() const;
+
+	const cv::Mat& GetPaint() const;
+
+private:
+	/// <summary>
+	/// Process the current paint as the interactive loop does, dropping the parametric result.
+	/// </summary>
+	bool process();
+
+private:
+	LazySnapping& m_snapping;
+	cv::Mat m_paint;
+	SessionHistory m_history;
+	bool m_parametricSolved;	// Indicate whether the current marks are solved for a weight range.
+	bool m_hasResult;
+};
@@ -0,0 +1,360 @@
+#include "SlicHelper.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <queue>
+#include <cfloat>
+#include <sstream>
+
+using namespace std;
+using namespace cv;
+
+SlicHelper::SlicHelper(const Mat& srcImage, int regionSize /* = 10 */, float compactness /* = 10.0f */, int iterations /* = 10 */)
+	: m_compCount(0), m_gridRows(0), m_gridCols(0)
+{
+	SetSrcImage(srcImage);
+	SetSlicConfig(regionSize, compactness, iterations);
+}
+
+SlicHelper::~SlicHelper()
+{
+}
+
+void SlicHelper::Process(bool showRes /* = false */)
+{
+	// SLIC measures color distance in CIELAB space.
+	Mat floatImage, labImage;
+	m_srcImage.convertTo(floatImage, CV_32FC3, 1.0 / 255);
+	cvtColor(floatImage, labImage, COLOR_BGR2Lab);
+	split(labImage, m_labPlanes);
+
+	initCenters();
+	for (int i = 0; i < m_iterations; i++)
+	{
+		assignLabels();
+		if (i < m_iterations - 1)
+			updateCenters();
+	}
+	enforceConnectivity();
+	buildGraph();
+
+	if (showRes)
+		showSlicResult();
+}
+
+void SlicHelper::SetSrcImage(const Mat& srcImage)
+{
+	// Constraint input image type.
+	if (srcImage.type() != CV_8UC3)
+		throw new exception("Input image type must be CV_8UC3");
+	srcImage.copyTo(m_srcImage);
+
+	// Create mask image.
+	m_maskImage.create(m_srcImage.size(), CV_32SC1);
+	m_distImage.create(m_srcImage.size(), CV_32FC1);
+	m_rows = m_maskImage.rows;
+	m_cols = m_maskImage.cols;
+}
+
+void SlicHelper::SetSlicConfig(int regionSize, float compactness, int iterations)
+{
+	if (regionSize < 2 || compactness <= 0 || iterations < 1)
+		throw new exception("Invalid SLIC parameters");
+	m_regionSize = regionSize;
+	m_compactness = compactness;
+	m_iterations = iterations;
+}
+
+Mat SlicHelper::GetMask() const
+{
+	Mat res;
+	m_maskImage.copyTo(res);
+	return res;
+}
+vector<Vec3b> SlicHelper::GetColors() const { return m_nodeColors; }
+vector<Connection> SlicHelper::GetGraph() const { return m_graph; }
+
+string SlicHelper::GetConfigKey() const
+{
+	stringstream key;
+	key << "slic " << m_regionSize << " " << m_compactness << " " << m_iterations;
+	return key.str();
+}
+
+void SlicHelper::GetMemoryReport(MemoryReport& report) const
+{
+	size_t planeBytes = 0;
+	for each(auto& plane in m_labPlanes)
+		planeBytes += MatBytes(plane);
+	report.Add("source image", MatBytes(m_srcImage));
+	report.Add("slic mask", MatBytes(m_maskImage));
+	report.Add("slic lab planes", planeBytes + MatBytes(m_distImage));
+	report.Add("slic centers", VectorBytes(m_centers));
+	report.Add("slic colors", VectorBytes(m_nodeColors));
+	report.Add("slic graph", ConnectionBytes(m_graph));
+}
+
+void SlicHelper::initCenters()
+{
+	// The last grid cell of each row and column absorbs the remaining pixels.
+	m_gridRows = max(1, m_rows / m_regionSize);
+	m_gridCols = max(1, m_cols / m_regionSize);
+	m_centers.clear();
+	for (int i = 0; i < m_gridRows; i++)
+	{
+		int yEnd = (i == m_gridRows - 1) ? m_rows : (i + 1) * m_regionSize;
+		int y = (i * m_regionSize + yEnd) / 2;
+		for (int j = 0; j < m_gridCols; j++)
+		{
+			int xEnd = (j == m_gridCols - 1) ? m_cols : (j + 1) * m_regionSize;
+			int x = (j * m_regionSize + xEnd) / 2;
+			m_centers.push_back(SlicCenter(m_labPlanes[0].at<float>(y, x), m_labPlanes[1].at<float>(y, x),
+				m_labPlanes[2].at<float>(y, x), static_cast<float>(x), static_cast<float>(y)));
+		}
+	}
+}
+
+void SlicHelper::assignLabels()
+{
+	parallel_for_(Range(0, m_rows), [this](const Range& range)
+	{
+		for (int i = range.start; i < range.end; i++)
+			assignRow(i);
+	});
+}
+
+void SlicHelper::assignRow(int row)
+{
+	const float* lptr = m_labPlanes[0].ptr<float>(row);
+	const float* aptr = m_labPlanes[1].ptr<float>(row);
+	const float* bptr = m_labPlanes[2].ptr<float>(row);
+	int* labelptr = m_maskImage.ptr<int>(row);
+	float* distptr = m_distImage.ptr<float>(row);
+	for (int j = 0; j < m_cols; j++)
+		distptr[j] = FLT_MAX;
+
+	float spatialWeight = (m_compactness / m_regionSize) * (m_compactness / m_regionSize);
+	int cellRow = min(row / m_regionSize, m_gridRows - 1);
+	for (int cellCol = 0; cellCol < m_gridCols; cellCol++)
+	{
+		int xStart = cellCol * m_regionSize;
+		int xEnd = (cellCol == m_gridCols - 1) ? m_cols : xStart + m_regionSize;
+
+		// All pixels of the cell share the centers of the 3x3 neighbor cells as candidates.
+		for (int gy = max(0, cellRow - 1); gy <= min(m_gridRows - 1, cellRow + 1); gy++)
+		{
+			for (int gx = max(0, cellCol - 1); gx <= min(m_gridCols - 1, cellCol + 1); gx++)
+			{
+				int k = gy * m_gridCols + gx;
+				const SlicCenter& center = m_centers[k];
+				float rowDist = (row - center.Y) * (row - center.Y) * spatialWeight;
+				int j = xStart;
+#if CV_SIMD128
+				v_float32x4 vl = v_setall_f32(center.L);
+				v_float32x4 va = v_setall_f32(center.A);
+				v_float32x4 vb = v_setall_f32(center.B);
+				v_float32x4 vweight = v_setall_f32(spatialWeight);
+				v_float32x4 vrow = v_setall_f32(rowDist);
+				v_float32x4 vstep(0.0f, 1.0f, 2.0f, 3.0f);
+				v_int32x4 vk = v_setall_s32(k);
+				for (; j <= xEnd - 4; j += 4)
+				{
+					v_float32x4 dl = v_load(lptr + j) - vl;
+					v_float32x4 da = v_load(aptr + j) - va;
+					v_float32x4 db = v_load(bptr + j) - vb;
+					v_float32x4 dx = v_setall_f32(j - center.X) + vstep;
+					v_float32x4 dist = dl * dl + da * da + db * db + dx * dx * vweight + vrow;
+					v_float32x4 best = v_load(distptr + j);
+					v_float32x4 closer = dist < best;
+					v_store(distptr + j, v_select(closer, dist, best));
+					v_store(labelptr + j, v_select(v_reinterpret_as_s32(closer), vk, v_load(labelptr + j)));
+				}
+#endif
+				for (; j < xEnd; j++)
+				{
+					float dl = lptr[j] - center.L;
+					float da = aptr[j] - center.A;
+					float db = bptr[j] - center.B;
+					float dx = j - center.X;
+					float dist = dl * dl + da * da + db * db + dx * dx * spatialWeight + rowDist;
+					if (dist < distptr[j])
+					{
+						distptr[j] = dist;
+						labelptr[j] = k;
+					}
+				}
+			}
+		}
+	}
+}
+
+void SlicHelper::updateCenters()
+{
+	// Each strip accumulates L, A, B, X, Y and pixel count of every center.
+	const int SumSize = 6;
+	int stripCount = max(1, min(getNumThreads(), m_rows));
+	vector<vector<double>> partialSums(stripCount, vector<double>(m_centers.size() * SumSize, 0));
+	parallel_for_(Range(0, stripCount), [&](const Range& range)
+	{
+		for (int s = range.start; s < range.end; s++)
+		{
+			double* sums = partialSums[s].data();
+			for (int i = s * m_rows / stripCount; i < (s + 1) * m_rows / stripCount; i++)
+			{
+				const float* lptr = m_labPlanes[0].ptr<float>(i);
+				const float* aptr = m_labPlanes[1].ptr<float>(i);
+				const float* bptr = m_labPlanes[2].ptr<float>(i);
+				const int* labelptr = m_maskImage.ptr<int>(i);
+				for (int j = 0; j < m_cols; j++)
+				{
+					double* sum = sums + labelptr[j] * SumSize;
+					sum[0] += lptr[j];
+					sum[1] += aptr[j];
+					sum[2] += bptr[j];
+					sum[3] += j;
+					sum[4] += i;
+					sum[5] += 1;
+				}
+			}
+		}
+	});
+
+	for (size_t k = 0; k < m_centers.size(); k++)
+	{
+		double sum[SumSize] = { 0 };
+		for (int s = 0; s < stripCount; s++)
+		{
+			for (int c = 0; c < SumSize; c++)
+				sum[c] += partialSums[s][k * SumSize + c];
+		}
+		if (sum[5] == 0)
+			continue;
+		m_centers[k] = SlicCenter(static_cast<float>(sum[0] / sum[5]), static_cast<float>(sum[1] / sum[5]),
+			static_cast<float>(sum[2] / sum[5]), static_cast<float>(sum[3] / sum[5]), static_cast<float>(sum[4] / sum[5]));
+	}
+}
+
+void SlicHelper::enforceConnectivity()
+{
+	const Point offsets[4] = { Point(-1, 0), Point(0, -1), Point(1, 0), Point(0, 1) };
+	int minSize = max(1, m_regionSize * m_regionSize / 4);
+
+	// Section id start from 1. Zero means not labeled yet.
+	Mat labels(m_maskImage.size(), CV_32SC1);
+	labels = Scalar::all(0);
+	m_compCount = 0;
+	vector<Point> segment;
+	for (int i = 0; i < m_rows; i++)
+	{
+		for (int j = 0; j < m_cols; j++)
+		{
+			if (labels.at<int>(i, j) > 0)
+				continue;
+
+			// The left or upper neighbor is already labeled, it receives the section if too small.
+			Point startPoint(j, i);
+			int adjacentComp = 0;
+			if (j > 0)
+				adjacentComp = labels.at<int>(i, j - 1);
+			else if (i > 0)
+				adjacentComp = labels.at<int>(i - 1, j);
+
+			// Use BFS to traverse the connected section.
+			int currentCenter = m_maskImage.at<int>(startPoint);
+			int currentComp = ++m_compCount;
+			segment.clear();
+			queue<Point> currentNodes;
+			currentNodes.push(startPoint);
+			labels.at<int>(startPoint) = currentComp;
+			while (!currentNodes.empty())
+			{
+				Point currentPixel = currentNodes.front();
+				currentNodes.pop();
+				segment.push_back(currentPixel);
+				for (int k = 0; k < 4; k++)
+				{
+					Point adjacentPixel = currentPixel + offsets[k];
+					if (adjacentPixel.x < 0 || adjacentPixel.x >= m_cols || adjacentPixel.y < 0 || adjacentPixel.y >= m_rows)
+						continue;
+					if (labels.at<int>(adjacentPixel) > 0 || m_maskImage.at<int>(adjacentPixel) != currentCenter)
+						continue;
+					labels.at<int>(adjacentPixel) = currentComp;
+					currentNodes.push(adjacentPixel);
+				}
+			}
+
+			if (static_cast<int>(segment.size()) < minSize && adjacentComp > 0)
+			{
+				for each(auto& pixel in segment)
+					labels.at<int>(pixel) = adjacentComp;
+				m_compCount--;
+			}
+		}
+	}
+	m_maskImage = labels;
+}
+
+void SlicHelper::buildGraph()
+{
+	// Get the average colors.
+	vector<Vec3i> colorSums(m_compCount, Vec3i(0, 0, 0));
+	vector<int> counter(m_compCount, 0);
+	for (int i = 0; i < m_rows; i++)
+	{
+		const int* maskptr = m_maskImage.ptr<int>(i);
+		const Vec3b* srcptr = m_srcImage.ptr<Vec3b>(i);
+		for (int j = 0; j < m_cols; j++)
+		{
+			colorSums[maskptr[j] - 1] += srcptr[j];
+			counter[maskptr[j] - 1]++;
+		}
+	}
+	m_nodeColors.resize(m_compCount);
+	for (int i = 0; i < m_compCount; i++)
+		m_nodeColors[i] = static_cast<Vec3b>(colorSums[i] / counter[i]);
+
+	// Construct graph connection relationship. Every horizontal or vertical pixel pair
+	// crossing a border increases the border length, recorded on the section with the lower id.
+	m_graph.clear();
+	for (int i = 0; i < m_compCount; i++)
+		m_graph.push_back(Connection(i + 1));
+	auto addBorder = [this](int compA, int compB)
+	{
+		vector<Edge>& edges = m_graph[min(compA, compB) - 1].Edges;
+		int adjacentComp = max(compA, compB);
+		for (size_t k = 0; k < edges.size(); k++)
+		{
+			if (edges[k].Id == adjacentComp)
+			{
+				edges[k].Length++;
+				return;
+			}
+		}
+		edges.push_back(Edge(adjacentComp, 1));
+	};
+	for (int i = 0; i < m_rows; i++)
+	{
+		const int* maskptr = m_maskImage.ptr<int>(i);
+		const int* nextptr = (i + 1 < m_rows) ? m_maskImage.ptr<int>(i + 1) : nullptr;
+		for (int j = 0; j < m_cols; j++)
+		{
+			if (j + 1 < m_cols && maskptr[j] != maskptr[j + 1])
+				addBorder(maskptr[j], maskptr[j + 1]);
+			if (nextptr && maskptr[j] != nextptr[j])
+				addBorder(maskptr[j], nextptr[j]);
+		}
+	}
+}
+
+void SlicHelper::showSlicResult()
+{
+	Mat colorRes(m_srcImage.size(), CV_8UC3);
+	for (int i = 0; i < m_rows; i++)
+	{
+		int* maskptr = m_maskImage.ptr<int>(i);
+		Vec3b* resptr = colorRes.ptr<Vec3b>(i);
+		for (int j = 0; j < m_cols; j++)
+			resptr[j] = m_nodeColors[maskptr[j] - 1];
+	}
+	imshow(SlicWindowName, colorRes);
+}
@@ -0,0 +1,43 @@
+#include "SnappingEnergy.h"
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+static const float Infinite = 1e10;
+
+float ColorDistance(const Vec3b& colorA, const Vec3b& colorB)
+{
+	Vec3i diff = static_cast<Vec3i>(colorA) - static_cast<Vec3i>(colorB);
+	return static_cast<float>(sqrt(diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2]));
+}
+
+float MinColorDistance(const Vec3b& color, const vector<Vec3b>& collection)
+{
+	float res = Infinite;
+	float temp = 0;
+	for each(auto& element in collection)
+	{
+		temp = ColorDistance(color, element);
+		if (temp < res)
+			res = temp;
+	}
+	return res;
+}
+
+Point2f LikelihoodEnergy(const Vec3b& color, const vector<Vec3b>& foreColors, const vector<Vec3b>& backColors)
+{
+	float df = MinColorDistance(color, foreColors);
+	float db = MinColorDistance(color, backColors);
+	return Point2f(df / (df + db), db / (df + db));
+}
+
+// Todo: adjust E2 calculation method.
+float PriorEnergy(const Vec3b& colorA, const Vec3b& colorB, float e2weight)
+{
+	Vec3i diff = static_cast<Vec3i>(colorA) - static_cast<Vec3i>(colorB);
+	int distance = diff[0] * diff[0] + diff[1] * diff[1] + diff[2] * diff[2];
+	float epsilon = 1.0f;	// 0.01
+
+	return e2weight / (epsilon + distance);
+}
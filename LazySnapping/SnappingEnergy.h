@@ -0,0 +1,28 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+
+/// <summary>
+/// Calculate the Euclid distance between two colors.
+/// </summary>
+float ColorDistance(const cv::Vec3b& colorA, const cv::Vec3b& colorB);
+
+/// <summary>
+/// Calculate the minimum distance to a color collection.
+/// </summary>
+/// <param name="color">The color value.</param>
+/// <param name="collection">The color collection.</param>
+float MinColorDistance(const cv::Vec3b& color, const std::vector<cv::Vec3b>& collection);
+
+/// <summary>
+/// Calculate the likelihood energy of an unmarked component from the distances to the foreground and background colors.
+/// In the result, x stores the foreground energy and y stores the background energy.
+/// </summary>
+cv::Point2f LikelihoodEnergy(const cv::Vec3b& color, const std::vector<cv::Vec3b>& foreColors, const std::vector<cv::Vec3b>& backColors);
+
+/// <summary>
+/// Calculate the prior energy between two adjacent components. Similar colors are expensive to cut.
+/// </summary>
+/// <param name="e2weight">The prior energy weight.</param>
+float PriorEnergy(const cv::Vec3b& colorA, const cv::Vec3b& colorB, float e2weight);
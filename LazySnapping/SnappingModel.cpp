@@ -0,0 +1,95 @@
+#include "SnappingModel.h"
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+using namespace cv;
+
+SnappingModel::SnappingModel(shared_ptr<const LabelMap> labels, const vector<Vec3b>& nodeColors, const vector<Connection>& connections)
+	: m_labels(labels), m_nodeColors(nodeColors)
+{
+	if (!m_labels)
+		throw new exception("Label map must not be null");
+
+	buildAdjacency(connections);
+	buildNodeBounds();
+}
+
+SnappingModel::SnappingModel(const SnappingModel& model, shared_ptr<const LabelMap> labels)
+	: m_labels(labels), m_nodeColors(model.m_nodeColors), m_adjOffsets(model.m_adjOffsets), m_adjNodes(model.m_adjNodes), m_nodeBounds(model.m_nodeBounds)
+{
+	if (!m_labels || m_labels->Size() != model.m_labels->Size())
+		throw new exception("Label map must have the model size");
+}
+
+SnappingModel::~SnappingModel()
+{
+}
+
+void SnappingModel::GetMemoryReport(MemoryReport& report) const
+{
+	report.Add("labels", m_labels->GetMemoryUsage());
+	report.Add("node colors", VectorBytes(m_nodeColors));
+	report.Add("adjacency", VectorBytes(m_adjOffsets) + VectorBytes(m_adjNodes) + VectorBytes(m_nodeBounds));
+}
+
+void SnappingModel::buildAdjacency(const vector<Connection>& connections)
+{
+	int nodeCount = static_cast<int>(m_nodeColors.size());
+	m_adjOffsets.assign(nodeCount + 1, 0);
+	for each(auto& connection in connections)
+	{
+		for each(auto& edge in connection.Edges)
+		{
+			m_adjOffsets[connection.Id]++;
+			m_adjOffsets[edge.Id]++;
+		}
+	}
+	for (int i = 0; i < nodeCount; i++)
+		m_adjOffsets[i + 1] += m_adjOffsets[i];
+
+	vector<int> position(m_adjOffsets.begin(), m_adjOffsets.end() - 1);
+	m_adjNodes.resize(m_adjOffsets[nodeCount]);
+	for each(auto& connection in connections)
+	{
+		for each(auto& edge in connection.Edges)
+		{
+			m_adjNodes[position[connection.Id - 1]++] = edge.Id - 1;
+			m_adjNodes[position[edge.Id - 1]++] = connection.Id - 1;
+		}
+	}
+}
+
+void SnappingModel::buildNodeBounds()
+{
+	vector<Point> minPoints(m_nodeColors.size(), Point(INT_MAX, INT_MAX));
+	vector<Point> maxPoints(m_nodeColors.size(), Point(-1, -1));
+	vector<int> buffer;
+	for (int t = 0; t < m_labels->TileCount(); t++)
+	{
+		Rect tileRect = m_labels->TileRect(t);
+		buffer.resize(tileRect.width);
+		for (int i = 0; i < tileRect.height; i++)
+		{
+			const int* maskptr = m_labels->TileRow(t, i, buffer.data());
+			for (int j = 0; j < tileRect.width; j++)
+			{
+				Point& minPoint = minPoints[maskptr[j] - 1];
+				Point& maxPoint = maxPoints[maskptr[j] - 1];
+				minPoint.x = min(minPoint.x, tileRect.x + j);
+				minPoint.y = min(minPoint.y, tileRect.y + i);
+				maxPoint.x = max(maxPoint.x, tileRect.x + j);
+				maxPoint.y = max(maxPoint.y, tileRect.y + i);
+			}
+		}
+	}
+
+	m_nodeBounds.resize(m_nodeColors.size());
+	for (size_t i = 0; i < m_nodeBounds.size(); i++)
+	{
+		if (maxPoints[i].x < 0)
+			m_nodeBounds[i] = Rect();
+		else
+			m_nodeBounds[i] = Rect(minPoints[i], maxPoints[i] + Point(1, 1));
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <memory>
+#include "WatershedHelper.h"
+#include "LabelMap.h"
+#include "MemoryReport.h"
+
+/// <summary>
+/// Immutable per image state of lazy snapping: the label map, the color of every component, the
+/// adjacency and the bounding box of every component. A model is never changed after construction,
+/// so any number of LazySnapping sessions may share it and process in parallel threads.
+/// </summary>
+class SnappingModel
+{
+public:
+	/// <summary>
+	/// Build the model of an image.
+	/// </summary>
+	/// <param name="labels">The label map. Component ids must be in [1, node count].</param>
+	/// <param name="nodeColors">The color of every component.</param>
+	/// <param name="connections">The adjacency of the components. It is not kept.</param>
+	SnappingModel(std::shared_ptr<const LabelMap> labels, const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections);
+
+	/// <summary>
+	/// Copy a model with another representation of the same labels.
+	/// </summary>
+	SnappingModel(const SnappingModel& model, std::shared_ptr<const LabelMap> labels);
+	~SnappingModel();
+
+public:
+	const std::shared_ptr<const LabelMap>& GetLabels() const { return m_labels; }
+	const std::vector<cv::Vec3b>& GetNodeColors() const { return m_nodeColors; }
+	int GetNodeCount() const { return static_cast<int>(m_nodeColors.size()); }
+
+	/// <summary>
+	/// Get the number of undirected adjacencies.
+	/// </summary>
+	int GetEdgeCount() const { return static_cast<int>(m_adjNodes.size() / 2); }
+
+	/// <summary>
+	/// Get the adjacency of every component in both directions, in CSR layout with 0-based node indices.
+	/// The neighbors of node i are AdjNodes[AdjOffsets[i]] to AdjNodes[AdjOffsets[i + 1] - 1].
+	/// </summary>
+	const std::vector<int>& GetAdjOffsets() const { return m_adjOffsets; }
+	const std::vector<int>& GetAdjNodes() const { return m_adjNodes; }
+
+	/// <summary>
+	/// Get the bounding box of every component, empty for ids without pixels.
+	/// </summary>
+	const std::vector<cv::Rect>& GetNodeBounds() const { return m_nodeBounds; }
+
+	/// <summary>
+	/// Add the memory of the labels, node colors and adjacency to a report.
+	/// </summary>
+	void GetMemoryReport(MemoryReport& report) const;
+
+private:
+	/// <summary>
+	/// Build the adjacency of every component in both directions from the connections.
+	/// </summary>
+	void buildAdjacency(const std::vector<Connection>& connections);
+
+	/// <summary>
+	/// Build the bounding box of every component.
+	/// </summary>
+	void buildNodeBounds();
+
+private:
+	std::shared_ptr<const LabelMap> m_labels;
+	std::vector<cv::Vec3b> m_nodeColors;
+	std::vector<int> m_adjOffsets;
+	std::vector<int> m_adjNodes;
+	std::vector<cv::Rect> m_nodeBounds;
+};
@@ -0,0 +1,755 @@
+#include "SnappingServer.h"
+#include "SessionRecorder.h"
+#include "TiledImage.h"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/highgui.hpp>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+#include <random>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET NativeSocket;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <sys/time.h>
+typedef int NativeSocket;
+#endif
+
+using namespace std;
+using namespace cv;
+
+static const intptr_t InvalidSocket = -1;
+static const size_t MaxRequestSize = 64 << 20;
+static const int ReceiveTimeout = 30;	// Seconds a client may stay silent before its connection is dropped.
+
+static void closeSocket(intptr_t connection)
+{
+#ifdef _WIN32
+	closesocket(static_cast<NativeSocket>(connection));
+#else
+	close(static_cast<NativeSocket>(connection));
+#endif
+}
+
+/// <summary>
+/// Limit how long a receive waits, so a client that stops sending does not hold a worker.
+/// </summary>
+static void setReceiveTimeout(intptr_t connection, int seconds)
+{
+#ifdef _WIN32
+	DWORD timeout = seconds * 1000;
+#else
+	timeval timeout;
+	timeout.tv_sec = seconds;
+	timeout.tv_usec = 0;
+#endif
+	setsockopt(static_cast<NativeSocket>(connection), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+
+static bool sendAll(intptr_t connection, const string& data)
+{
+	size_t sent = 0;
+	while (sent < data.size())
+	{
+		int count = send(static_cast<NativeSocket>(connection), data.data() + sent, static_cast<int>(data.size() - sent), 0);
+		if (count <= 0)
+			return false;
+		sent += count;
+	}
+	return true;
+}
+
+static string toLower(string text)
+{
+	transform(text.begin(), text.end(), text.begin(), ::tolower);
+	return text;
+}
+
+/// <summary>
+/// Compare secrets in a time independent of the position of the first difference.
+/// </summary>
+static bool equalSecrets(const string& a, const string& b)
+{
+	if (a.size() != b.size())
+		return false;
+	unsigned char difference = 0;
+	for (size_t k = 0; k < a.size(); k++)
+		difference |= static_cast<unsigned char>(a[k] ^ b[k]);
+	return difference == 0;
+}
+
+/// <summary>
+/// Create a random 128-bit token as hex.
+/// </summary>
+static string makeToken()
+{
+	random_device device;
+	ostringstream token;
+	for (int k = 0; k < 4; k++)
+		token << hex << setw(8) << setfill('0') << static_cast<uint32_t>(device());
+	return token.str();
+}
+
+/// <summary>
+/// Read an HTTP message: the header up to the empty line, then Content-Length bytes of body.
+/// </summary>
+/// <param name="connection">The connected socket.</param>
+/// <param name="startLine">The request or status line.</param>
+/// <param name="headers">The header fields, with lower case names and trimmed values.</param>
+/// <param name="body">The message body.</param>
+/// <returns>False if the connection closes early or the message is malformed.</returns>
+static bool readHttpMessage(intptr_t connection, string& startLine, unordered_map<string, string>& headers, string& body)
+{
+	string data;
+	char buffer[4096];
+	size_t headerEnd = string::npos;
+	while ((headerEnd = data.find("\r\n\r\n")) == string::npos)
+	{
+		int count = recv(static_cast<NativeSocket>(connection), buffer, sizeof(buffer), 0);
+		if (count <= 0 || data.size() > MaxRequestSize)
+			return false;
+		data.append(buffer, count);
+	}
+
+	istringstream header(data.substr(0, headerEnd));
+	string line;
+	getline(header, startLine);
+	if (!startLine.empty() && startLine.back() == '\r')
+		startLine.pop_back();
+	headers.clear();
+	while (getline(header, line))
+	{
+		size_t colon = line.find(':');
+		if (colon == string::npos)
+			continue;
+		size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+		size_t valueEnd = line.find_last_not_of(" \t\r");
+		headers[toLower(line.substr(0, colon))] = valueStart == string::npos || valueEnd < valueStart ? "" : line.substr(valueStart, valueEnd - valueStart + 1);
+	}
+	auto length = headers.find("content-length");
+	size_t contentLength = length == headers.end() ? 0 : static_cast<size_t>(atoll(length->second.c_str()));
+	if (contentLength > MaxRequestSize)
+		return false;
+
+	body = data.substr(headerEnd + 4);
+	while (body.size() < contentLength)
+	{
+		int count = recv(static_cast<NativeSocket>(connection), buffer, sizeof(buffer), 0);
+		if (count <= 0)
+			return false;
+		body.append(buffer, count);
+	}
+	body.resize(contentLength);
+	return true;
+}
+
+ModelCache::ModelCache(size_t capacity /* = 8 */)
+	: m_capacity(max(capacity, static_cast<size_t>(1))), m_hits(0), m_misses(0)
+{
+}
+
+ModelCache::~ModelCache()
+{
+}
+
+shared_ptr<const SnappingModel> ModelCache::Get(const string& imagePath)
+{
+	ModelFuture future;
+	promise<shared_ptr<const SnappingModel>> loader;
+	bool miss = false;
+	{
+		lock_guard<mutex> lock(m_mutex);
+		auto it = m_entries.find(imagePath);
+		if (it != m_entries.end())
+		{
+			// Move to the front. The model may still be computed by another request.
+			m_order.splice(m_order.begin(), m_order, it->second.second);
+			future = it->second.first;
+			m_hits++;
+		}
+		else
+		{
+			future = loader.get_future().share();
+			m_order.push_front(imagePath);
+			m_entries[imagePath] = make_pair(future, m_order.begin());
+			m_misses++;
+			miss = true;
+
+			while (m_entries.size() > m_capacity)
+			{
+				m_entries.erase(m_order.back());
+				m_order.pop_back();
+			}
+		}
+	}
+
+	if (miss)
+	{
+		// A failure is passed on to every request waiting for the model, which rethrows it from get.
+		shared_ptr<const SnappingModel> model;
+		exception_ptr failure;
+		try
+		{
+			model = load(imagePath);
+		}
+		catch (const exception* e)
+		{
+			// The pipeline throws by pointer, which every waiter would delete, so pass a copy of the message.
+			failure = make_exception_ptr(runtime_error(e->what()));
+			delete e;
+		}
+		catch (...)
+		{
+			failure = current_exception();
+		}
+
+		if (!model)
+		{
+			// Do not cache failures, the file may appear later. The entry is still pending unless it was evicted and requested again.
+			lock_guard<mutex> lock(m_mutex);
+			auto it = m_entries.find(imagePath);
+			if (it != m_entries.end() && it->second.first.wait_for(chrono::seconds(0)) != future_status::ready)
+			{
+				m_order.erase(it->second.second);
+				m_entries.erase(it);
+			}
+		}
+		if (failure)
+			loader.set_exception(failure);
+		else
+			loader.set_value(model);
+	}
+	return future.get();
+}
+
+int ModelCache::GetHits() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_hits;
+}
+
+int ModelCache::GetMisses() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_misses;
+}
+
+size_t ModelCache::GetSize() const
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_entries.size();
+}
+
+shared_ptr<const SnappingModel> ModelCache::load(const string& imagePath)
+{
+	Mat srcImage = imread(imagePath);
+	if (srcImage.empty() || srcImage.type() != CV_8UC3)
+		return nullptr;
+
+	WatershedHelper watershedHelper(srcImage, 10, 10, 2, 2);
+	watershedHelper.Process();
+	return make_shared<SnappingModel>(make_shared<TiledLabelMap>(make_shared<TiledImage>(watershedHelper.GetMask())), watershedHelper.GetColors(), watershedHelper.GetGraph());
+}
+
+SnappingServer::SnappingServer(int port /* = 8765 */, size_t cacheCapacity /* = 8 */, int workerCount /* = 8 */, size_t maxSessions /* = 64 */, int sessionTimeout /* = 1800 */)
+	: m_port(port), m_listenSocket(InvalidSocket), m_running(false), m_cache(cacheCapacity), m_nextSession(1), m_maxSessions(maxSessions),
+	m_sessionTimeout(sessionTimeout), m_evictedSessions(0), m_workerCount(workerCount), m_acceptDone(false), m_token(makeToken())
+{
+	if (workerCount < 1 || maxSessions < 1)
+		throw new exception("Worker and session numbers must be positive.");
+	if (sessionTimeout < 0)
+		throw new exception("Session timeout must not be negative.");
+
+#ifdef _WIN32
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+SnappingServer::~SnappingServer()
+{
+	Stop();
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+bool SnappingServer::Run()
+{
+	intptr_t listenSocket = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (listenSocket == InvalidSocket)
+		return false;
+	int reuse = 1;
+	setsockopt(static_cast<NativeSocket>(listenSocket), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	// Only serve the local machine.
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<unsigned short>(m_port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (::bind(static_cast<NativeSocket>(listenSocket), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+		|| listen(static_cast<NativeSocket>(listenSocket), SOMAXCONN) != 0)
+	{
+		cout << "Cannot listen on port " << m_port << endl;
+		closeSocket(listenSocket);
+		return false;
+	}
+	m_listenSocket = listenSocket;
+	m_running = true;
+	cout << "Serving on http://127.0.0.1:" << m_port << " with token " << m_token << endl;
+
+	{
+		lock_guard<mutex> lock(m_connectionsMutex);
+		m_acceptDone = false;
+	}
+	vector<thread> workers;
+	for (int k = 0; k < m_workerCount; k++)
+		workers.emplace_back([this]() { serveConnections(); });
+
+	size_t queueCapacity = static_cast<size_t>(m_workerCount) * 4;
+	while (m_running)
+	{
+		intptr_t connection = static_cast<intptr_t>(accept(static_cast<NativeSocket>(listenSocket), nullptr, nullptr));
+		if (connection == InvalidSocket)
+			continue;
+		setReceiveTimeout(connection, ReceiveTimeout);
+
+		unique_lock<mutex> lock(m_connectionsMutex);
+		m_connectionsChanged.wait(lock, [this, queueCapacity]() { return m_connections.size() < queueCapacity; });
+		m_connections.push_back(connection);
+		m_connectionsChanged.notify_all();
+	}
+
+	// Requests in flight and queued connections are finished before returning.
+	{
+		lock_guard<mutex> lock(m_connectionsMutex);
+		m_acceptDone = true;
+	}
+	m_connectionsChanged.notify_all();
+	for each(auto& worker in workers)
+		worker.join();
+	return true;
+}
+
+void SnappingServer::Stop()
+{
+	if (!m_running)
+		return;
+	m_running = false;
+
+	// Wake up the blocking accept with a connection of our own, then close the socket.
+	intptr_t wakeup = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (wakeup != InvalidSocket)
+	{
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(static_cast<unsigned short>(m_port));
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		connect(static_cast<NativeSocket>(wakeup), reinterpret_cast<sockaddr*>(&address), sizeof(address));
+		closeSocket(wakeup);
+	}
+	closeSocket(m_listenSocket);
+	m_listenSocket = InvalidSocket;
+}
+
+void SnappingServer::serveConnections()
+{
+	while (true)
+	{
+		intptr_t connection = InvalidSocket;
+		{
+			unique_lock<mutex> lock(m_connectionsMutex);
+			m_connectionsChanged.wait(lock, [this]() { return !m_connections.empty() || m_acceptDone; });
+			if (m_connections.empty())
+				return;
+			connection = m_connections.front();
+			m_connections.pop_front();
+		}
+		m_connectionsChanged.notify_all();
+		serveConnection(connection);
+	}
+}
+
+void SnappingServer::serveConnection(intptr_t connection)
+{
+	string startLine, body;
+	unordered_map<string, string> headers;
+	if (!readHttpMessage(connection, startLine, headers, body))
+	{
+		closeSocket(connection);
+		return;
+	}
+
+	// METHOD TARGET HTTP/1.1
+	istringstream request(startLine);
+	string method, target;
+	request >> method >> target;
+	int status = 200;
+	string response;
+	try
+	{
+		if (authorize(headers, status))
+			response = handleRequest(method, target, body, status);
+		else
+			response = status == 401 ? "Missing or wrong token\n" : "Forbidden\n";
+	}
+	catch (const exception& e)
+	{
+		status = 500;
+		response = string(e.what()) + "\n";
+	}
+	catch (const exception* e)
+	{
+		// The pipeline throws exceptions by pointer.
+		status = 500;
+		response = string(e->what()) + "\n";
+		delete e;
+	}
+
+	const char* reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : status == 401 ? "Unauthorized" : status == 403 ? "Forbidden"
+		: status == 404 ? "Not Found" : "Internal Server Error";
+	ostringstream message;
+	message << "HTTP/1.1 " << status << " " << reason << "\r\n"
+		<< "Content-Type: text/plain\r\n"
+		<< "Content-Length: " << response.size() << "\r\n"
+		<< "Connection: close\r\n\r\n" << response;
+	sendAll(connection, message.str());
+	closeSocket(connection);
+
+	if (status == 200 && method == "POST" && target == "/shutdown")
+		Stop();
+}
+
+bool SnappingServer::authorize(const unordered_map<string, string>& headers, int& status) const
+{
+	// Listening on loopback does not keep out web pages, whose requests a browser sends to localhost too.
+	// DNS rebinding shows as a foreign host name, a cross site request as a foreign origin, and neither page can read the token.
+	string port = to_string(m_port);
+	auto host = headers.find("host");
+	string hostName = host == headers.end() ? "" : toLower(host->second);
+	auto origin = headers.find("origin");
+	string originName = origin == headers.end() ? "" : toLower(origin->second);
+	if ((hostName != "127.0.0.1:" + port && hostName != "localhost:" + port)
+		|| (origin != headers.end() && originName != "http://127.0.0.1:" + port && originName != "http://localhost:" + port))
+	{
+		status = 403;
+		return false;
+	}
+	auto authorization = headers.find("authorization");
+	if (authorization == headers.end() || !equalSecrets(authorization->second, "Bearer " + m_token))
+	{
+		status = 401;
+		return false;
+	}
+	return true;
+}
+
+string SnappingServer::handleRequest(const string& method, const string& target, const string& body, int& status)
+{
+	const string prefix = "/sessions/";
+	if (method == "POST" && target == "/sessions")
+		return createSession(body.substr(0, body.find_last_not_of("\r\n") + 1), status);
+	if (method == "GET" && target == "/stats")
+		return getStats();
+	if (method == "POST" && target == "/shutdown")
+		return "bye\n";
+	if (target.compare(0, prefix.size(), prefix) == 0)
+	{
+		// /sessions/<id> or /sessions/<id>/events
+		size_t idEnd = target.find('/', prefix.size());
+		int id = atoi(target.substr(prefix.size(), idEnd - prefix.size()).c_str());
+		string action = idEnd == string::npos ? "" : target.substr(idEnd);
+		if (method == "POST" && action == "/events")
+			return applyEvents(id, body, status);
+		if (method == "DELETE" && action.empty())
+			return closeSession(id, status);
+	}
+	status = 404;
+	return "Unknown request\n";
+}
+
+string SnappingServer::createSession(const string& imagePath, int& status)
+{
+	shared_ptr<const SnappingModel> model = m_cache.Get(imagePath);
+	if (!model)
+	{
+		status = 404;
+		return "Cannot read image " + imagePath + "\n";
+	}
+
+	// The model is shared, the segmentation and everything the process changes belong to the session.
+	Size size = model->GetLabels()->Size();
+	auto session = make_shared<Session>();
+	session->Model = model;
+	session->Snapping = make_unique<LazySnapping>(model);
+	session->Replay = make_unique<SessionReplay>(*session->Snapping);
+	session->Mask = Mat::zeros(size, CV_8UC1);
+
+	int id = 0;
+	{
+		lock_guard<mutex> lock(m_sessionsMutex);
+		evictSessions(1);
+		session->LastAccess = chrono::steady_clock::now();
+		id = m_nextSession++;
+		m_sessions[id] = session;
+	}
+	ostringstream response;
+	response << id << " " << size.width << " " << size.height << "\n";
+	return response.str();
+}
+
+string SnappingServer::applyEvents(int id, const string& body, int& status)
+{
+	shared_ptr<Session> session;
+	{
+		lock_guard<mutex> lock(m_sessionsMutex);
+		evictSessions(0);
+		auto it = m_sessions.find(id);
+		if (it != m_sessions.end())
+		{
+			session = it->second;
+			session->LastAccess = chrono::steady_clock::now();
+		}
+	}
+	if (!session)
+	{
+		status = 404;
+		return "Unknown session\n";
+	}
+
+	lock_guard<mutex> lock(session->Mutex);
+	istringstream lines(body);
+	string line;
+	while (getline(lines, line))
+	{
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+		if (line.empty() || line[0] == '#')
+			continue;
+		SessionEvent event;
+		if (!SessionRecorder::ParseEvent(line, event))
+		{
+			status = 400;
+			return "Bad event: " + line + "\n";
+		}
+		session->Replay->Apply(event);
+	}
+
+	// Without marks of both kinds there is no segmentation, the mask is empty.
+	Mat mask;
+	if (session->Replay->HasResult())
+		mask = session->Snapping->GetSegmentation();
+	else
+		mask = Mat::zeros(session->Mask.size(), CV_8UC1);
+
+	string response = encodeMaskDiff(session->Mask, mask);
+	session->Mask = mask;
+	return response;
+}
+
+string SnappingServer::closeSession(int id, int& status)
+{
+	lock_guard<mutex> lock(m_sessionsMutex);
+	if (m_sessions.erase(id) == 0)
+	{
+		status = 404;
+		return "Unknown session\n";
+	}
+	return "closed\n";
+}
+
+string SnappingServer::getStats()
+{
+	size_t sessionCount = 0;
+	int evictedCount = 0;
+	{
+		lock_guard<mutex> lock(m_sessionsMutex);
+		evictSessions(0);
+		sessionCount = m_sessions.size();
+		evictedCount = m_evictedSessions;
+	}
+	ostringstream response;
+	response << "sessions " << sessionCount << "\n"
+		<< "sessions evicted " << evictedCount << "\n"
+		<< "models " << m_cache.GetSize() << "\n"
+		<< "cache hits " << m_cache.GetHits() << "\n"
+		<< "cache misses " << m_cache.GetMisses() << "\n";
+	return response.str();
+}
+
+void SnappingServer::evictSessions(size_t reserve)
+{
+	// A session evicted while a request uses it lives until the request is answered.
+	if (m_sessionTimeout.count() > 0)
+	{
+		chrono::steady_clock::time_point expired = chrono::steady_clock::now() - m_sessionTimeout;
+		for (auto it = m_sessions.begin(); it != m_sessions.end(); )
+		{
+			if (it->second->LastAccess < expired)
+			{
+				it = m_sessions.erase(it);
+				m_evictedSessions++;
+			}
+			else
+				++it;
+		}
+	}
+	while (!m_sessions.empty() && m_sessions.size() + reserve > m_maxSessions)
+	{
+		auto oldest = m_sessions.begin();
+		for (auto it = m_sessions.begin(); it != m_sessions.end(); ++it)
+		{
+			if (it->second->LastAccess < oldest->second->LastAccess)
+				oldest = it;
+		}
+		m_sessions.erase(oldest);
+		m_evictedSessions++;
+	}
+}
+
+string SnappingServer::encodeMaskDiff(const Mat& oldMask, const Mat& newMask)
+{
+	ostringstream runs;
+	int runCount = 0;
+	for (int i = 0; i < newMask.rows; i++)
+	{
+		const uchar* oldptr = oldMask.ptr<uchar>(i);
+		const uchar* newptr = newMask.ptr<uchar>(i);
+		int j = 0;
+		while (j < newMask.cols)
+		{
+			if (oldptr[j] == newptr[j])
+			{
+				j++;
+				continue;
+			}
+			int start = j;
+			while (j < newMask.cols && oldptr[j] != newptr[j] && newptr[j] == newptr[start])
+				j++;
+			runs << i << " " << start << " " << j << " " << static_cast<int>(newptr[start]) << "\n";
+			runCount++;
+		}
+	}
+	return "runs " + to_string(runCount) + "\n" + runs.str();
+}
+
+bool SendHttpRequest(int port, const string& token, const string& method, const string& target, const string& body, int& status, string& response)
+{
+	intptr_t connection = static_cast<intptr_t>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (connection == InvalidSocket)
+		return false;
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<unsigned short>(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(static_cast<NativeSocket>(connection), reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		closeSocket(connection);
+		return false;
+	}
+
+	ostringstream message;
+	message << method << " " << target << " HTTP/1.1\r\n"
+		<< "Host: 127.0.0.1:" << port << "\r\n"
+		<< "Authorization: Bearer " << token << "\r\n"
+		<< "Content-Type: text/plain\r\n"
+		<< "Content-Length: " << body.size() << "\r\n"
+		<< "Connection: close\r\n\r\n" << body;
+	string statusLine;
+	unordered_map<string, string> headers;
+	bool ok = sendAll(connection, message.str()) && readHttpMessage(connection, statusLine, headers, response);
+	closeSocket(connection);
+	if (!ok)
+		return false;
+
+	// HTTP/1.1 <status> <reason>
+	istringstream line(statusLine);
+	string version;
+	line >> version >> status;
+	return true;
+}
+
+void RunTestClient(int port, const string& token, const vector<string>& sessionPaths)
+{
+#ifdef _WIN32
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+	double tickToMs = 1000.0 / getTickFrequency();
+	mutex outputMutex;
+	vector<thread> clients;
+	for each(auto& path in sessionPaths)
+	{
+		clients.push_back(thread([&, path]()
+		{
+			string imagePath;
+			vector<SessionEvent> events;
+			if (!SessionRecorder::Load(path, imagePath, events))
+			{
+				lock_guard<mutex> lock(outputMutex);
+				cout << "Skip " << path << endl;
+				return;
+			}
+
+			int status = 0;
+			string response;
+			int64 start = getTickCount();
+			if (!SendHttpRequest(port, token, "POST", "/sessions", imagePath, status, response) || status != 200)
+			{
+				lock_guard<mutex> lock(outputMutex);
+				cout << "Cannot open session for " << path << ": " << response << endl;
+				return;
+			}
+			double openTime = (getTickCount() - start) * tickToMs;
+			int id = atoi(response.c_str());
+			string eventsTarget = "/sessions/" + to_string(id) + "/events";
+
+			// One request per event, like an annotator drawing stroke after stroke.
+			vector<double> latencies;
+			int totalRuns = 0;
+			for each(auto& event in events)
+			{
+				start = getTickCount();
+				if (!SendHttpRequest(port, token, "POST", eventsTarget, SessionRecorder::FormatEvent(event) + "\n", status, response) || status != 200)
+					break;
+				latencies.push_back((getTickCount() - start) * tickToMs);
+				totalRuns += atoi(response.c_str() + 5);
+			}
+			SendHttpRequest(port, token, "DELETE", "/sessions/" + to_string(id), "", status, response);
+
+			sort(latencies.begin(), latencies.end());
+			lock_guard<mutex> lock(outputMutex);
+			cout << left << setw(36) << path << fixed << setprecision(2) << "open " << setw(10) << openTime
+				<< "events " << setw(6) << latencies.size()
+				<< "median ms " << setw(10) << (latencies.empty() ? 0 : latencies[latencies.size() / 2])
+				<< "max ms " << setw(10) << (latencies.empty() ? 0 : latencies.back())
+				<< "runs " << totalRuns << endl;
+		}));
+	}
+	for each(auto& client in clients)
+		client.join();
+
+	int status = 0;
+	string response;
+	if (SendHttpRequest(port, token, "GET", "/stats", "", status, response))
+		cout << response;
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <list>
+#include <deque>
+#include <chrono>
+#include <unordered_map>
+#include <cstdint>
+#include "LazySnapping.h"
+#include "SessionReplay.h"
+#include "SnappingModel.h"
+
+/// <summary>
+/// Least recently used cache of snapping models keyed by image path. Concurrent requests for
+/// an image being computed wait for that computation instead of starting another one.
+/// Evicted models stay alive as long as a session uses them.
+/// </summary>
+class ModelCache
+{
+public:
+	ModelCache(size_t capacity = 8);
+	~ModelCache();
+
+public:
+	/// <summary>
+	/// Get the model of an image, computing it on a miss. An exception of the computation is thrown
+	/// to every request waiting for it, and neither it nor a null model is cached.
+	/// </summary>
+	/// <param name="imagePath">The image file path.</param>
+	/// <returns>The model, or null if the image cannot be read.</returns>
+	std::shared_ptr<const SnappingModel> Get(const std::string& imagePath);
+
+	int GetHits() const;
+	int GetMisses() const;
+	size_t GetSize() const;
+
+private:
+	typedef std::shared_future<std::shared_ptr<const SnappingModel>> ModelFuture;
+
+	/// <summary>
+	/// Read the image and compute its super pixels and model.
+	/// </summary>
+	static std::shared_ptr<const SnappingModel> load(const std::string& imagePath);
+
+private:
+	mutable std::mutex m_mutex;
+	size_t m_capacity;
+	std::list<std::string> m_order;		// Most recently used first.
+	std::unordered_map<std::string, std::pair<ModelFuture, std::list<std::string>::iterator>> m_entries;
+	int m_hits;
+	int m_misses;
+};
+
+/// <summary>
+/// Long running segmentation service on localhost HTTP. It keeps one lazy snapping session per
+/// annotator and shares the super pixel model between sessions on the same image.
+///
+/// POST /sessions               Body: image path. Returns "<id> <width> <height>".
+/// POST /sessions/<id>/events   Body: session file event lines, see SessionRecorder. The events are
+///                              applied in turn as the interactive loop does, and the changed mask pixels
+///                              are returned as "runs <n>" followed by one "<y> <x0> <x1> <value>"
+///                              line per run of equal new value, x1 exclusive.
+/// DELETE /sessions/<id>        Close a session.
+/// GET /stats                   Session and cache counters.
+/// POST /shutdown               Stop the server.
+///
+/// Every connection carries one request and is served by a fixed pool of worker threads; accepting
+/// waits while the connections queued for the workers fill the queue. Requests of one session are
+/// serialized, requests of different sessions run in parallel. Sessions idle for longer than the
+/// timeout are closed, and so is the least recently used one when a new session exceeds the limit.
+///
+/// Web pages can send requests to localhost as well, so every request must carry the Host 127.0.0.1:<port>
+/// or localhost:<port>, no Origin other than that of the server, and "Authorization: Bearer <token>" with
+/// the random token printed at startup. Other requests are refused with 403 or 401.
+/// </summary>
+class SnappingServer
+{
+public:
+	/// <summary>
+	/// Create a server.
+	/// </summary>
+	/// <param name="port">The port on localhost.</param>
+	/// <param name="cacheCapacity">The number of cached models.</param>
+	/// <param name="workerCount">The number of threads serving connections.</param>
+	/// <param name="maxSessions">The maximum number of open sessions.</param>
+	/// <param name="sessionTimeout">The idle time in seconds after which a session is closed. 0 for no timeout.</param>
+	SnappingServer(int port = 8765, size_t cacheCapacity = 8, int workerCount = 8, size_t maxSessions = 64, int sessionTimeout = 1800);
+	~SnappingServer();
+
+public:
+	/// <summary>
+	/// Serve requests until Stop is called or a shutdown request arrives.
+	/// </summary>
+	/// <returns>False if the port cannot be opened.</returns>
+	bool Run();
+
+	/// <summary>
+	/// Stop accepting connections. Requests in flight are finished.
+	/// </summary>
+	void Stop();
+
+private:
+	/// <summary>
+	/// Mutable state of one annotator.
+	/// </summary>
+	struct Session
+	{
+		std::mutex Mutex;
+		std::shared_ptr<const SnappingModel> Model;
+		std::unique_ptr<LazySnapping> Snapping;
+		std::unique_ptr<SessionReplay> Replay;	// Paint and undo history, applied to Snapping.
+		cv::Mat Mask;		// The mask last returned to the client.
+		std::chrono::steady_clock::time_point LastAccess;	// Guarded by the sessions mutex.
+	};
+
+	/// <summary>
+	/// Serve queued connections until accepting stops and the queue is drained. Runs on every worker thread.
+	/// </summary>
+	void serveConnections();
+
+	/// <summary>
+	/// Read one request from a connection, answer it and close the connection.
+	/// </summary>
+	void serveConnection(intptr_t connection);
+
+	/// <summary>
+	/// Check the Host, Origin and Authorization headers of a request.
+	/// </summary>
+	/// <returns>False with the status set if the request is refused.</returns>
+	bool authorize(const std::unordered_map<std::string, std::string>& headers, int& status) const;
+
+	/// <summary>
+	/// Dispatch a request.
+	/// </summary>
+	/// <returns>The response body.</returns>
+	std::string handleRequest(const std::string& method, const std::string& target, const std::string& body, int& status);
+
+	std::string createSession(const std::string& imagePath, int& status);
+	std::string applyEvents(int id, const std::string& body, int& status);
+	std::string closeSession(int id, int& status);
+	std::string getStats();
+
+	/// <summary>
+	/// Close the idle sessions, then the least recently used ones until there is room for more sessions.
+	/// The sessions mutex must be held.
+	/// </summary>
+	/// <param name="reserve">The number of sessions about to be added.</param>
+	void evictSessions(size_t reserve);
+
+	/// <summary>
+	/// Encode the pixels that differ between two masks as row runs of the new value.
+	/// </summary>
+	static std::string encodeMaskDiff(const cv::Mat& oldMask, const cv::Mat& newMask);
+
+private:
+	int m_port;
+	intptr_t m_listenSocket;
+	std::atomic<bool> m_running;
+
+	ModelCache m_cache;
+	std::mutex m_sessionsMutex;
+	std::unordered_map<int, std::shared_ptr<Session>> m_sessions;
+	int m_nextSession;
+	size_t m_maxSessions;
+	std::chrono::seconds m_sessionTimeout;	// 0 for no timeout.
+	int m_evictedSessions;
+
+	// Accepted connections waiting for a worker.
+	int m_workerCount;
+	std::mutex m_connectionsMutex;
+	std::condition_variable m_connectionsChanged;
+	std::deque<intptr_t> m_connections;
+	bool m_acceptDone;
+
+	std::string m_token;	// Random per launch, required from every client.
+};
+
+/// <summary>
+/// Send one HTTP request to a server on localhost.
+/// </summary>
+/// <param name="port">The server port.</param>
+/// <param name="token">The token printed by the server at startup.</param>
+/// <param name="method">The request method.</param>
+/// <param name="target">The request path.</param>
+/// <param name="body">The request body.</param>
+/// <param name="status">The response status code.</param>
+/// <param name="response">The response body.</param>
+/// <returns>False if the server cannot be reached.</returns>
+bool SendHttpRequest(int port, const std::string& token, const std::string& method, const std::string& target, const std::string& body, int& status, std::string& response);
+
+/// <summary>
+/// Stand in for the web frontend: replay session files against a running server, one session per
+/// file on its own thread, and report the latency of every event request and the mask diff size.
+/// </summary>
+/// <param name="port">The server port.</param>
+/// <param name="token">The token printed by the server at startup.</param>
+/// <param name="sessionPaths">The session file paths, see SessionRecorder.</param>
+void RunTestClient(int port, const std::string& token, const std::vector<std::string>& sessionPaths);
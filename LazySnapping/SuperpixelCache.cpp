@@ -0,0 +1,241 @@
+#include "SuperpixelCache.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+using namespace cv;
+
+static const char CacheMagic[8] = { 'L', 'S', 'S', 'P', 'C', '0', '2', '\0' };
+static const uint64_t FnvOffset = 14695981039346656037ULL;
+static const uint64_t FnvPrime = 1099511628211ULL;
+static const uint64_t PageSize = 4096;
+
+static uint64_t fnvUpdate(uint64_t hash, const uchar* data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= FnvPrime;
+	}
+	return hash;
+}
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+/// <summary>
+/// Check that a section of count elements lies inside the file and is aligned for its element type.
+/// </summary>
+static bool sectionFits(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+{
+	if (offset % elementSize != 0 || offset > fileSize)
+		return false;
+	return count <= (fileSize - offset) / elementSize;
+}
+
+SuperpixelCache::SuperpixelCache(const string& directory)
+	: m_directory(directory), m_header(nullptr)
+{
+#ifdef _WIN32
+	_mkdir(m_directory.c_str());
+#else
+	mkdir(m_directory.c_str(), 0755);
+#endif
+}
+
+SuperpixelCache::~SuperpixelCache()
+{
+}
+
+bool SuperpixelCache::Load(const Mat& srcImage, const string& configKey)
+{
+	m_header = nullptr;
+	uint64_t imageHash = HashImage(srcImage);
+	uint64_t configHash = HashString(configKey);
+	// Copy on write, so writes through the mask never reach the file.
+	if (!m_file.Open(cachePath(imageHash, configHash), false, true))
+		return false;
+
+	// Validate the header before trusting any offset.
+	if (m_file.Size() < sizeof(SuperpixelCacheHeader))
+		return false;
+	const SuperpixelCacheHeader* header = reinterpret_cast<const SuperpixelCacheHeader*>(m_file.Data());
+	if (memcmp(header->Magic, CacheMagic, sizeof(CacheMagic)) != 0 || header->ImageHash != imageHash || header->ConfigHash != configHash
+		|| header->Rows != srcImage.rows || header->Cols != srcImage.cols)
+		return false;
+	if (header->Rows <= 0 || header->Cols <= 0 || header->NodeCount < 1 || header->EdgeCount < 0)
+		return false;
+
+	// Every section must lie inside the file, so a truncated or corrupt file is rejected here.
+	uint64_t fileSize = m_file.Size();
+	if (!sectionFits(header->MaskOffset, static_cast<uint64_t>(header->Rows) * header->Cols, sizeof(int32_t), fileSize)
+		|| !sectionFits(header->OffsetsOffset, static_cast<uint64_t>(header->NodeCount) + 1, sizeof(int32_t), fileSize)
+		|| !sectionFits(header->EdgesOffset, static_cast<uint64_t>(header->EdgeCount) * 2, sizeof(int32_t), fileSize)
+		|| !sectionFits(header->ColorsOffset, static_cast<uint64_t>(header->NodeCount), sizeof(Vec3b), fileSize))
+		return false;
+
+	// The CSR offsets must be monotonic and end at the edge count, and every edge must refer to a node.
+	const int32_t* offsets = reinterpret_cast<const int32_t*>(m_file.Data() + header->OffsetsOffset);
+	if (offsets[0] != 0 || offsets[header->NodeCount] != header->EdgeCount)
+		return false;
+	for (int i = 0; i < header->NodeCount; i++)
+	{
+		if (offsets[i + 1] < offsets[i])
+			return false;
+	}
+	const int32_t* edges = reinterpret_cast<const int32_t*>(m_file.Data() + header->EdgesOffset);
+	for (int k = 0; k < header->EdgeCount; k++)
+	{
+		if (edges[k * 2] < 1 || edges[k * 2] > header->NodeCount)
+			return false;
+	}
+
+	// Labels index the node arrays, so every label must refer to a node.
+	const int32_t* labels = reinterpret_cast<const int32_t*>(m_file.Data() + header->MaskOffset);
+	size_t labelCount = static_cast<size_t>(header->Rows) * header->Cols;
+	for (size_t i = 0; i < labelCount; i++)
+	{
+		if (labels[i] < 1 || labels[i] > header->NodeCount)
+			return false;
+	}
+
+	m_header = header;
+	return true;
+}
+
+bool SuperpixelCache::Store(const Mat& srcImage, const string& configKey, const Mat& maskImage,
+	const vector<Vec3b>& nodeColors, const vector<Connection>& connections)
+{
+	if (maskImage.type() != CV_32SC1 || maskImage.size() != srcImage.size())
+		throw new exception("Mask image type must be CV_32SC1");
+
+	// The loaded entry is valid and its mapping may still be in use, so it is never replaced.
+	uint64_t imageHash = HashImage(srcImage);
+	uint64_t configHash = HashString(configKey);
+	if (m_header && m_header->ImageHash == imageHash && m_header->ConfigHash == configHash)
+		return false;
+
+	// Flatten the graph to CSR layout indexed by node id.
+	int nodeCount = static_cast<int>(nodeColors.size());
+	vector<int32_t> offsets(nodeCount + 1, 0);
+	for each(auto& connection in connections)
+		offsets[connection.Id] = static_cast<int32_t>(connection.Edges.size());
+	for (int i = 0; i < nodeCount; i++)
+		offsets[i + 1] += offsets[i];
+	vector<int32_t> edges(offsets[nodeCount] * 2);
+	for each(auto& connection in connections)
+	{
+		int32_t* edgeptr = &edges[0] + offsets[connection.Id - 1] * 2;
+		for each(auto& edge in connection.Edges)
+		{
+			*edgeptr++ = edge.Id;
+			*edgeptr++ = edge.Length;
+		}
+	}
+
+	SuperpixelCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+	header.ImageHash = imageHash;
+	header.ConfigHash = configHash;
+	header.Rows = maskImage.rows;
+	header.Cols = maskImage.cols;
+	header.NodeCount = nodeCount;
+	header.EdgeCount = offsets[nodeCount];
+	header.MaskOffset = alignOffset(sizeof(header), PageSize);
+	header.OffsetsOffset = header.MaskOffset + static_cast<uint64_t>(maskImage.total()) * sizeof(int32_t);
+	header.EdgesOffset = header.OffsetsOffset + offsets.size() * sizeof(int32_t);
+	header.ColorsOffset = header.EdgesOffset + edges.size() * sizeof(int32_t);
+
+	// Write to a temporary file first, so a broken write never leaves a valid looking cache.
+	string path = cachePath(header.ImageHash, header.ConfigHash);
+	string tempPath = path + ".tmp";
+	{
+		ofstream file(tempPath, ios::binary | ios::trunc);
+		if (!file)
+			return false;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		vector<char> padding(static_cast<size_t>(header.MaskOffset - sizeof(header)), 0);
+		file.write(padding.data(), padding.size());
+		for (int i = 0; i < maskImage.rows; i++)
+			file.write(reinterpret_cast<const char*>(maskImage.ptr<int>(i)), maskImage.cols * sizeof(int32_t));
+		file.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(int32_t));
+		if (!edges.empty())
+			file.write(reinterpret_cast<const char*>(edges.data()), edges.size() * sizeof(int32_t));
+		if (!nodeColors.empty())
+			file.write(reinterpret_cast<const char*>(nodeColors.data()), nodeColors.size() * sizeof(Vec3b));
+		if (!file)
+			return false;
+	}
+	remove(path.c_str());
+	return rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+Mat SuperpixelCache::GetMask() const
+{
+	if (!m_header)
+		throw new exception("Cache is not loaded.");
+	return Mat(m_header->Rows, m_header->Cols, CV_32SC1, m_file.Data() + m_header->MaskOffset);
+}
+
+vector<Vec3b> SuperpixelCache::GetColors() const
+{
+	if (!m_header)
+		throw new exception("Cache is not loaded.");
+	const Vec3b* colors = reinterpret_cast<const Vec3b*>(m_file.Data() + m_header->ColorsOffset);
+	return vector<Vec3b>(colors, colors + m_header->NodeCount);
+}
+
+vector<Connection> SuperpixelCache::GetGraph() const
+{
+	if (!m_header)
+		throw new exception("Cache is not loaded.");
+	const int32_t* offsets = reinterpret_cast<const int32_t*>(m_file.Data() + m_header->OffsetsOffset);
+	const int32_t* edges = reinterpret_cast<const int32_t*>(m_file.Data() + m_header->EdgesOffset);
+	vector<Connection> graph;
+	graph.reserve(m_header->NodeCount);
+	for (int i = 0; i < m_header->NodeCount; i++)
+	{
+		graph.push_back(Connection(i + 1));
+		Connection& connection = graph[graph.size() - 1];
+		for (int k = offsets[i]; k < offsets[i + 1]; k++)
+			connection.Edges.push_back(Edge(edges[k * 2], edges[k * 2 + 1]));
+	}
+	return graph;
+}
+
+void SuperpixelCache::GetMemoryReport(MemoryReport& report) const
+{
+	report.Add("superpixel cache mapping", m_file.IsOpen() ? m_file.Size() : 0);
+}
+
+uint64_t SuperpixelCache::HashImage(const Mat& image)
+{
+	uint64_t hash = FnvOffset;
+	int size[3] = { image.rows, image.cols, image.type() };
+	hash = fnvUpdate(hash, reinterpret_cast<const uchar*>(size), sizeof(size));
+	for (int i = 0; i < image.rows; i++)
+		hash = fnvUpdate(hash, image.ptr<uchar>(i), image.cols * image.elemSize());
+	return hash;
+}
+
+uint64_t SuperpixelCache::HashString(const string& text)
+{
+	return fnvUpdate(FnvOffset, reinterpret_cast<const uchar*>(text.data()), text.size());
+}
+
+string SuperpixelCache::cachePath(uint64_t imageHash, uint64_t configHash) const
+{
+	stringstream path;
+	path << m_directory << "/" << hex << setfill('0') << setw(16) << imageHash << "-" << setw(16) << configHash << ".spc";
+	return path.str();
+}
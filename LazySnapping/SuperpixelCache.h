@@ -0,0 +1,89 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "WatershedHelper.h"
+#include "MappedFile.h"
+
+/// <summary>
+/// Header of one superpixel cache file.
+/// The file stores the label map, the graph in CSR layout and the node colors.
+/// The label map starts at a page aligned offset so it can be mapped directly.
+/// </summary>
+struct SuperpixelCacheHeader
+{
+	char Magic[8];
+	uint64_t ImageHash;
+	uint64_t ConfigHash;
+	int32_t Rows;
+	int32_t Cols;
+	int32_t NodeCount;
+	int32_t EdgeCount;
+	uint64_t MaskOffset;		// int32 labels, Rows * Cols.
+	uint64_t OffsetsOffset;		// int32 CSR offsets, NodeCount + 1.
+	uint64_t EdgesOffset;		// (Id, Length) int32 pairs, EdgeCount.
+	uint64_t ColorsOffset;		// BGR bytes, NodeCount.
+};
+
+/// <summary>
+/// Persistent on-disk cache of super pixel results, keyed by image content hash and seed configuration.
+/// </summary>
+class SuperpixelCache
+{
+public:
+	SuperpixelCache(const std::string& directory);
+	~SuperpixelCache();
+
+public:
+	/// <summary>
+	/// Look up the cache. The label map is memory mapped and only read from disk on first access.
+	/// </summary>
+	/// <param name="srcImage">The source image.</param>
+	/// <param name="configKey">The super pixel configuration, see WatershedHelper::GetConfigKey.</param>
+	/// <returns>True if the cache is hit.</returns>
+	bool Load(const cv::Mat& srcImage, const std::string& configKey);
+
+	/// <summary>
+	/// Write the super pixel result of the source image to the cache.
+	/// The loaded entry is not replaced, as masks returned by GetMask still refer to its mapping.
+	/// </summary>
+	/// <returns>True for successful operation, false if the key is the loaded one or the file cannot be written.</returns>
+	bool Store(const cv::Mat& srcImage, const std::string& configKey, const cv::Mat& maskImage,
+		const std::vector<cv::Vec3b>& nodeColors, const std::vector<Connection>& connections);
+
+	/// <summary>
+	/// Get the loaded label map. It refers to the mapped file and stays valid until the next Load or destruction.
+	/// The file is mapped copy on write, so writing to the mask changes private copies of its pages only.
+	/// </summary>
+	cv::Mat GetMask() const;
+	std::vector<cv::Vec3b> GetColors() const;
+	std::vector<Connection> GetGraph() const;
+
+	/// <summary>
+	/// Add the mapping of the loaded entry to a report. It is counted at its file size, though only the pages read are resident.
+	/// </summary>
+	void GetMemoryReport(MemoryReport& report) const;
+
+	/// <summary>
+	/// Calculate the FNV-1a hash of the image content and size.
+	/// </summary>
+	static uint64_t HashImage(const cv::Mat& image);
+
+	/// <summary>
+	/// Calculate the FNV-1a hash of a string.
+	/// </summary>
+	static uint64_t HashString(const std::string& text);
+
+private:
+	/// <summary>
+	/// Get the cache file path for the specified key.
+	/// </summary>
+	std::string cachePath(uint64_t imageHash, uint64_t configHash) const;
+
+private:
+	std::string m_directory;
+	MappedFile m_file;
+	const SuperpixelCacheHeader* m_header;
+};
@@ -0,0 +1,198 @@
+#include "SyntheticData.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+using namespace cv;
+
+/// <summary>
+/// Stateless 64 bit hash (splitmix64 finalizer). Pixels and regions hash their own coordinates,
+/// so rows can be generated in parallel and in any order.
+/// </summary>
+static inline uint64 mixHash(uint64 value)
+{
+	value += 0x9E3779B97F4A7C15ULL;
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+	return value ^ (value >> 31);
+}
+
+static inline uint64 mixHash(uint64 a, uint64 b, uint64 seed)
+{
+	return mixHash(mixHash(mixHash(seed) ^ a) ^ b);
+}
+
+/// <summary>
+/// Map a hash to [0, 1).
+/// </summary>
+static inline float unitFloat(uint64 hash)
+{
+	return static_cast<float>(hash >> 40) / static_cast<float>(1 << 24);
+}
+
+Mat GenerateTexturedImage(const Size& size, int regionSize /* = 64 */, uint64 seed /* = 1 */)
+{
+	Mat image(size, CV_8UC3);
+	regionSize = max(regionSize, 4);
+	int cellCols = (size.width + regionSize - 1) / regionSize;
+	int cellRows = (size.height + regionSize - 1) / regionSize;
+
+	// One jittered site per cell; a pixel belongs to the nearest site among the 3 x 3 cells around it.
+	vector<Point2f> sites(cellCols * cellRows);
+	for (int cy = 0; cy < cellRows; cy++)
+	{
+		for (int cx = 0; cx < cellCols; cx++)
+		{
+			uint64 hash = mixHash(cx, cy, seed);
+			sites[cy * cellCols + cx] = Point2f((cx + unitFloat(hash)) * regionSize, (cy + unitFloat(mixHash(hash))) * regionSize);
+		}
+	}
+
+	parallel_for_(Range(0, size.height), [&](const Range& range)
+	{
+		for (int i = range.start; i < range.end; i++)
+		{
+			Vec3b* imageptr = image.ptr<Vec3b>(i);
+			int cy = i / regionSize;
+			for (int j = 0; j < size.width; j++)
+			{
+				int cx = j / regionSize;
+				int region = 0;
+				float bestDist = FLT_MAX;
+				for (int y = max(cy - 1, 0); y <= min(cy + 1, cellRows - 1); y++)
+				{
+					for (int x = max(cx - 1, 0); x <= min(cx + 1, cellCols - 1); x++)
+					{
+						const Point2f& site = sites[y * cellCols + x];
+						float dist = (site.x - j) * (site.x - j) + (site.y - i) * (site.y - i);
+						if (dist < bestDist)
+						{
+							bestDist = dist;
+							region = y * cellCols + x;
+						}
+					}
+				}
+
+				// Region base color and stripe texture.
+				uint64 hash = mixHash(region, 0, seed ^ 0x5A5A5A5AULL);
+				float angle = unitFloat(hash) * static_cast<float>(CV_PI);
+				float frequency = 0.1f + 0.5f * unitFloat(mixHash(hash + 1));
+				float stripe = 24.0f * sin(frequency * (j * cos(angle) + i * sin(angle)));
+				float noise = 24.0f * (unitFloat(mixHash(j, i, seed)) - 0.5f);
+				for (int c = 0; c < 3; c++)
+				{
+					float base = 32.0f + 192.0f * unitFloat(mixHash(hash + 2 + c));
+					imageptr[j][c] = saturate_cast<uchar>(base + stripe + noise);
+				}
+			}
+		}
+	});
+	return image;
+}
+
+/// <summary>
+/// Draw one n-link capacity.
+/// </summary>
+static float sampleCapacity(CapacityDistribution distribution, RNG& rng)
+{
+	float u = 1.0f - rng.uniform(0.0f, 1.0f);	// (0, 1]
+	switch (distribution)
+	{
+	case CapacityDistribution::Exponential:
+		return -log(u);
+	case CapacityDistribution::Bimodal:
+		return rng.uniform(0.0f, 1.0f) < 0.1f ? 0.05f * u : 1.0f + u;
+	default:
+		return u;
+	}
+}
+
+/// <summary>
+/// Terminal capacities of a node. Nodes inside the object prefer the sink, with 10% of the nodes flipped as noise.
+/// </summary>
+static Vec2f sampleTerminalCaps(bool inside, RNG& rng)
+{
+	if (rng.uniform(0.0f, 1.0f) < 0.1f)
+		inside = !inside;
+	float strong = 0.5f + rng.uniform(0.0f, 1.0f);
+	float weak = 0.5f * rng.uniform(0.0f, 1.0f);
+	return inside ? Vec2f(weak, strong) : Vec2f(strong, weak);
+}
+
+CutProblem GenerateGridProblem(int width, int height, CapacityDistribution distribution, uint64 seed /* = 1 */)
+{
+	CutProblem problem;
+	RNG rng(seed);
+	problem.NodeCount = width * height;
+	problem.TerminalCaps.resize(problem.NodeCount);
+	problem.Edges.reserve(2 * problem.NodeCount);
+	problem.EdgeCaps.reserve(2 * problem.NodeCount);
+
+	float radius = 0.35f * min(width, height);
+	for (int i = 0; i < height; i++)
+	{
+		for (int j = 0; j < width; j++)
+		{
+			int node = i * width + j;
+			float dx = j - 0.5f * width, dy = i - 0.5f * height;
+			problem.TerminalCaps[node] = sampleTerminalCaps(dx * dx + dy * dy < radius * radius, rng);
+			if (j + 1 < width)
+			{
+				float cap = sampleCapacity(distribution, rng);
+				problem.Edges.push_back(Vec2i(node, node + 1));
+				problem.EdgeCaps.push_back(Vec2f(cap, cap));
+			}
+			if (i + 1 < height)
+			{
+				float cap = sampleCapacity(distribution, rng);
+				problem.Edges.push_back(Vec2i(node, node + width));
+				problem.EdgeCaps.push_back(Vec2f(cap, cap));
+			}
+		}
+	}
+	return problem;
+}
+
+CutProblem GeneratePlanarProblem(int nodeCount, CapacityDistribution distribution, uint64 seed /* = 1 */)
+{
+	CutProblem problem;
+	RNG rng(seed);
+	int side = max(static_cast<int>(ceil(sqrt(static_cast<double>(nodeCount)))), 2);
+	problem.NodeCount = side * side;
+	problem.TerminalCaps.resize(problem.NodeCount);
+	problem.Edges.reserve(3 * problem.NodeCount);
+	problem.EdgeCaps.reserve(3 * problem.NodeCount);
+
+	auto addEdge = [&](int a, int b)
+	{
+		float cap = sampleCapacity(distribution, rng);
+		problem.Edges.push_back(Vec2i(a, b));
+		problem.EdgeCaps.push_back(Vec2f(cap, cap));
+	};
+
+	float radius = 0.35f * side;
+	for (int i = 0; i < side; i++)
+	{
+		for (int j = 0; j < side; j++)
+		{
+			int node = i * side + j;
+			float dx = j + rng.uniform(-0.5f, 0.5f) - 0.5f * side;
+			float dy = i + rng.uniform(-0.5f, 0.5f) - 0.5f * side;
+			problem.TerminalCaps[node] = sampleTerminalCaps(dx * dx + dy * dy < radius * radius, rng);
+			if (j + 1 < side)
+				addEdge(node, node + 1);
+			if (i + 1 < side)
+				addEdge(node, node + side);
+			if (j + 1 < side && i + 1 < side)
+			{
+				// Split the cell by one of its diagonals, which keeps the graph planar.
+				if (rng.uniform(0, 2) == 0)
+					addEdge(node, node + side + 1);
+				else
+					addEdge(node + 1, node + side);
+			}
+		}
+	}
+	return problem;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include "ProblemIO.h"
+
+/// <summary>
+/// Distribution of the n-link capacities of a synthetic graph.
+/// </summary>
+enum class CapacityDistribution
+{
+	Uniform,		// Uniform in (0, 1].
+	Exponential,	// Exponential with mean 1, a few strong links and many weak ones.
+	Bimodal			// Mostly strong links with 10% weak ones, like object boundaries.
+};
+
+/// <summary>
+/// Generate a textured image of arbitrary size. The image is tiled by jittered Voronoi regions,
+/// each with its own base color and stripe texture, plus pixel noise. The same arguments always
+/// produce the same image, independent of the thread count.
+/// </summary>
+/// <param name="size">The image size.</param>
+/// <param name="regionSize">The mean region diameter in pixels.</param>
+/// <param name="seed">The random seed.</param>
+/// <returns>The CV_8UC3 image.</returns>
+cv::Mat GenerateTexturedImage(const cv::Size& size, int regionSize = 64, uint64 seed = 1);
+
+/// <summary>
+/// Generate a cut problem on a 4-connected grid. Nodes inside a centered disc prefer the sink (foreground).
+/// </summary>
+/// <param name="width">The grid width.</param>
+/// <param name="height">The grid height.</param>
+/// <param name="distribution">The n-link capacity distribution.</param>
+/// <param name="seed">The random seed.</param>
+CutProblem GenerateGridProblem(int width, int height, CapacityDistribution distribution, uint64 seed = 1);
+
+/// <summary>
+/// Generate a cut problem on a random planar graph, like a super pixel adjacency graph.
+/// Nodes are jittered grid points; every grid cell is split by a random diagonal, so node degrees vary around 6.
+/// </summary>
+/// <param name="nodeCount">The approximate node count.</param>
+/// <param name="distribution">The n-link capacity distribution.</param>
+/// <param name="seed">The random seed.</param>
+CutProblem GeneratePlanarProblem(int nodeCount, CapacityDistribution distribution, uint64 seed = 1);
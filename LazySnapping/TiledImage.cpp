@@ -0,0 +1,98 @@
+#include "TiledImage.h"
+
+using namespace std;
+using namespace cv;
+
+TiledImage::TiledImage(const Mat& image)
+	: m_image(image), m_size(image.size()), m_type(image.type()), m_tileRows(1), m_tileCols(1), m_tileBytes(0)
+{
+	if (image.channels() != 1)
+		throw new exception("Tiled image must be single channel");
+	m_tileSize = max(max(image.rows, image.cols), 1);
+}
+
+TiledImage::TiledImage(const string& path, const cv::Size& size, int type, int tileSize /* = 1024 */)
+	: m_size(size), m_type(type), m_tileSize(tileSize)
+{
+	if (CV_MAT_CN(type) != 1)
+		throw new exception("Tiled image must be single channel");
+	if (tileSize < 16 || size.width <= 0 || size.height <= 0)
+		throw new exception("Invalid tiled image size");
+
+	// Every tile occupies a full slot, so the tile address is a multiplication.
+	m_tileRows = (size.height + tileSize - 1) / tileSize;
+	m_tileCols = (size.width + tileSize - 1) / tileSize;
+	m_tileBytes = static_cast<size_t>(tileSize) * tileSize * CV_ELEM_SIZE(type);
+	m_file.reset(new MappedFile());
+	if (!m_file->Create(path, m_tileBytes * m_tileRows * m_tileCols))
+		throw new exception("Cannot create tiled image file");
+}
+
+TiledImage::~TiledImage()
+{
+}
+
+Rect TiledImage::TileRect(int index) const
+{
+	if (index < 0 || index >= TileCount())
+		throw new exception("No such tile.");
+	int x = (index % m_tileCols) * m_tileSize;
+	int y = (index / m_tileCols) * m_tileSize;
+	return Rect(x, y, min(m_tileSize, m_size.width - x), min(m_tileSize, m_size.height - y));
+}
+
+Mat TiledImage::Tile(int index) const
+{
+	if (!m_file)
+		return m_image;
+	Rect rect = TileRect(index);
+	uchar* data = m_file->Data() + m_tileBytes * index;
+	return Mat(rect.height, rect.width, m_type, data, m_tileSize * CV_ELEM_SIZE(m_type));
+}
+
+void TiledImage::Read(const Rect& area, Mat& dst) const
+{
+	dst.create(area.size(), m_type);
+	copyArea(area, dst, false);
+}
+
+void TiledImage::Write(const Rect& area, const Mat& src)
+{
+	if (src.size() != area.size() || src.type() != m_type)
+		throw new exception("Image size not match.");
+	Mat image = src;
+	copyArea(area, image, true);
+}
+
+void TiledImage::SetTo(const Scalar& value)
+{
+	for (int i = 0; i < TileCount(); i++)
+	{
+		Mat tile = Tile(i);
+		tile = value;
+	}
+}
+
+void TiledImage::copyArea(const Rect& area, Mat& image, bool toTiles) const
+{
+	if ((area & Rect(Point(0, 0), m_size)) != area)
+		throw new exception("Area out of image bound.");
+
+	int firstRow = area.y / m_tileSize, lastRow = (area.y + area.height - 1) / m_tileSize;
+	int firstCol = area.x / m_tileSize, lastCol = (area.x + area.width - 1) / m_tileSize;
+	for (int ty = firstRow; ty <= lastRow; ty++)
+	{
+		for (int tx = firstCol; tx <= lastCol; tx++)
+		{
+			int index = ty * m_tileCols + tx;
+			Rect tileRect = TileRect(index);
+			Rect overlap = tileRect & area;
+			Mat tilePart = Tile(index)(overlap - tileRect.tl());
+			Mat imagePart = image(overlap - area.tl());
+			if (toTiles)
+				imagePart.copyTo(tilePart);
+			else
+				tilePart.copyTo(imagePart);
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <string>
+#include <memory>
+#include "MappedFile.h"
+
+/// <summary>
+/// Single channel image stored as square tiles. The tiles either live in a memory mapped file,
+/// so images larger than RAM can be streamed tile by tile, or the whole in-memory image is one tile.
+/// </summary>
+class TiledImage
+{
+public:
+	/// <summary>
+	/// Wrap an in-memory image as a single tile. No data is copied.
+	/// </summary>
+	TiledImage(const cv::Mat& image);
+
+	/// <summary>
+	/// Create a tiled image in a memory mapped file. Existing file content is discarded.
+	/// </summary>
+	/// <param name="path">The backing file path.</param>
+	/// <param name="size">The image size.</param>
+	/// <param name="type">The single channel image type.</param>
+	/// <param name="tileSize">The tile width and height in pixels.</param>
+	TiledImage(const std::string& path, const cv::Size& size, int type, int tileSize = 1024);
+	~TiledImage();
+
+public:
+	cv::Size Size() const { return m_size; }
+	int Type() const { return m_type; }
+	int TileCount() const { return m_tileRows * m_tileCols; }
+	bool IsMapped() const { return m_file != nullptr; }
+
+	/// <summary>
+	/// Get the image area covered by the specified tile.
+	/// </summary>
+	cv::Rect TileRect(int index) const;
+
+	/// <summary>
+	/// Get the specified tile. It refers to the storage, so writing the returned Mat writes the image.
+	/// </summary>
+	cv::Mat Tile(int index) const;
+
+	/// <summary>
+	/// Copy an area of the image, which may span several tiles.
+	/// </summary>
+	void Read(const cv::Rect& area, cv::Mat& dst) const;
+
+	/// <summary>
+	/// Write an area of the image, which may span several tiles.
+	/// </summary>
+	void Write(const cv::Rect& area, const cv::Mat& src);
+
+	/// <summary>
+	/// Set all pixels to the specified value.
+	/// </summary>
+	void SetTo(const cv::Scalar& value);
+
+	/// <summary>
+	/// Access one pixel.
+	/// </summary>
+	template<typename T> T& At(const cv::Point& pos) const
+	{
+		int index = (pos.y / m_tileSize) * m_tileCols + pos.x / m_tileSize;
+		return Tile(index).at<T>(pos.y % m_tileSize, pos.x % m_tileSize);
+	}
+
+private:
+	/// <summary>
+	/// Copy between an image area and the tiles. Writes to the tiles if toTiles is true.
+	/// </summary>
+	void copyArea(const cv::Rect& area, cv::Mat& image, bool toTiles) const;
+
+private:
+	cv::Mat m_image;
+	std::unique_ptr<MappedFile> m_file;
+
+	cv::Size m_size;
+	int m_type;
+	int m_tileSize;
+	int m_tileRows;
+	int m_tileCols;
+	size_t m_tileBytes;
+};
@@ -0,0 +1,76 @@
+#include "Trace.h"
+#include <fstream>
+#include <algorithm>
+
+using namespace std;
+
+TraceRecorder& TraceRecorder::Instance()
+{
+	static TraceRecorder recorder;
+	return recorder;
+}
+
+TraceRecorder::TraceRecorder()
+	: m_enabled(false), m_origin(chrono::steady_clock::now())
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	if (!m_outputPath.empty())
+		Write(m_outputPath);
+}
+
+void TraceRecorder::SetOutputPath(const string& path)
+{
+	lock_guard<mutex> lock(m_mutex);
+	m_outputPath = path;
+	m_enabled = !path.empty();
+}
+
+void TraceRecorder::AddSpan(const char* name, chrono::steady_clock::time_point begin, chrono::steady_clock::time_point end)
+{
+	Span span;
+	span.Name = name;
+	span.Begin = chrono::duration_cast<chrono::microseconds>(begin - m_origin).count();
+	span.Duration = chrono::duration_cast<chrono::microseconds>(end - begin).count();
+
+	lock_guard<mutex> lock(m_mutex);
+	span.Thread = threadIndex(this_thread::get_id());
+	m_spans.push_back(span);
+}
+
+bool TraceRecorder::Write(const string& path)
+{
+	lock_guard<mutex> lock(m_mutex);
+	ofstream file(path, ios::out | ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	// Complete events ("ph": "X"), plus one thread name event per thread.
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	for (size_t t = 0; t < m_threads.size(); t++)
+	{
+		file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+			<< ",\"args\":{\"name\":\"thread " << t << "\"}}";
+		first = false;
+	}
+	for each(auto& span in m_spans)
+	{
+		file << (first ? "" : ",") << "\n{\"name\":\"" << span.Name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.Thread
+			<< ",\"ts\":" << span.Begin << ",\"dur\":" << span.Duration << "}";
+		first = false;
+	}
+	file << "\n]}" << endl;
+	return static_cast<bool>(file);
+}
+
+int TraceRecorder::threadIndex(thread::id id)
+{
+	auto it = find(m_threads.begin(), m_threads.end(), id);
+	if (it != m_threads.end())
+		return static_cast<int>(it - m_threads.begin());
+	m_threads.push_back(id);
+	return static_cast<int>(m_threads.size()) - 1;
+}
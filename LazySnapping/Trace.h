@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+/// <summary>
+/// Collect timed spans from any thread and write them as Chrome trace JSON, which chrome://tracing
+/// and Perfetto show as one timeline per thread. Spans are added with TRACE_SCOPE, which compiles to
+/// nothing unless LAZYSNAPPING_TRACE is defined.
+/// </summary>
+class TraceRecorder
+{
+public:
+	/// <summary>
+	/// Get the process wide recorder.
+	/// </summary>
+	static TraceRecorder& Instance();
+
+	/// <summary>
+	/// Write the trace to the specified file when the process exits. Tracing is off without an output path.
+	/// </summary>
+	void SetOutputPath(const std::string& path);
+
+	bool IsEnabled() const { return m_enabled; }
+
+	/// <summary>
+	/// Add a finished span.
+	/// </summary>
+	/// <param name="name">The span name. It must be a string literal.</param>
+	/// <param name="begin">The start time.</param>
+	/// <param name="end">The end time.</param>
+	void AddSpan(const char* name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+	/// <summary>
+	/// Write the spans so far as Chrome trace JSON.
+	/// </summary>
+	/// <returns>True for successful operation.</returns>
+	bool Write(const std::string& path);
+
+private:
+	TraceRecorder();
+	~TraceRecorder();
+
+	TraceRecorder(const TraceRecorder&) = delete;
+	TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+	/// <summary>
+	/// Get a small id of the calling thread in order of first use. Must be called with the lock held.
+	/// </summary>
+	int threadIndex(std::thread::id id);
+
+private:
+	struct Span
+	{
+		const char* Name;
+		long long Begin;	// Microseconds since the recorder was created.
+		long long Duration;
+		int Thread;
+	};
+
+	std::mutex m_mutex;
+	bool m_enabled;
+	std::string m_outputPath;
+	std::chrono::steady_clock::time_point m_origin;
+	std::vector<Span> m_spans;
+	std::vector<std::thread::id> m_threads;
+};
+
+/// <summary>
+/// Record the lifetime of a scope as one span.
+/// </summary>
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name)
+		: m_name(name), m_enabled(TraceRecorder::Instance().IsEnabled())
+	{
+		if (m_enabled)
+			m_begin = std::chrono::steady_clock::now();
+	}
+
+	~TraceScope()
+	{
+		if (m_enabled)
+			TraceRecorder::Instance().AddSpan(m_name, m_begin, std::chrono::steady_clock::now());
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* m_name;
+	bool m_enabled;
+	std::chrono::steady_clock::time_point m_begin;
+};
+
+#ifdef LAZYSNAPPING_TRACE
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
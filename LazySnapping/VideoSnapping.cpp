@@ -0,0 +1,184 @@
+#include "VideoSnapping.h"
+#include "LazySnapping.h"
+#include "ColorKmeans.h"
+#include <opencv2/imgproc.hpp>
+#include <iostream>
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+// Scale of the gray frames for the motion estimate, a 1080p frame becomes 480x270.
+static const double MotionScale = 0.25;
+
+VideoSnapping::VideoSnapping(int clusterNum /* = 64 */, float e2weight /* = 1000.0 */, float temporalWeight /* = 0.5f */)
+	: m_clusterNum(clusterNum), m_e2weight(e2weight), m_temporalWeight(temporalWeight)
+{
+	if (m_temporalWeight < 0 || m_temporalWeight > 1)
+		throw new exception("Temporal weight must be in [0, 1].");
+}
+
+VideoSnapping::~VideoSnapping()
+{
+}
+
+bool VideoSnapping::Start(const Mat& frame, Mat& paintImage)
+{
+	FrameSuperpixels superpixels = computeSuperpixels(frame);
+	LazySnapping snapping(superpixels.Mask, superpixels.Colors, superpixels.Graph, m_clusterNum, m_e2weight);
+	if (!snapping.Process(paintImage))
+		return false;
+
+	snapping.GetColorModels(m_foreColors, m_backColors);
+	m_segmentation = snapping.GetSegmentation();
+	m_gray = superpixels.Gray;
+	createHanningWindow(m_window, m_gray.size(), CV_32F);
+	return true;
+}
+
+Mat VideoSnapping::ProcessFrame(const Mat& frame)
+{
+	return solveFrame(computeSuperpixels(frame));
+}
+
+vector<Mat> VideoSnapping::ProcessSequence(const vector<Mat>& frames)
+{
+	// Super pixels only depend on their own frame, the solve depends on the previous one.
+	// Keep one super pixel job per thread running ahead of the solve.
+	size_t lookahead = max(1, getNumThreads());
+	deque<future<FrameSuperpixels>> pending;
+	size_t next = 0;
+	for (; next < frames.size() && next < lookahead; next++)
+		pending.push_back(async(launch::async, computeSuperpixels, cref(frames[next])));
+
+	vector<Mat> res;
+	res.reserve(frames.size());
+	while (!pending.empty())
+	{
+		FrameSuperpixels superpixels = pending.front().get();
+		pending.pop_front();
+		if (next < frames.size())
+		{
+			pending.push_back(async(launch::async, computeSuperpixels, cref(frames[next])));
+			next++;
+		}
+		res.push_back(solveFrame(superpixels));
+	}
+	return res;
+}
+
+Mat VideoSnapping::GetSegmentation() const
+{
+	return m_segmentation;
+}
+
+void VideoSnapping::SetTemporalWeight(float weight)
+{
+	if (weight < 0 || weight > 1)
+	{
+		cout << "Temporal weight must be in [0, 1]." << endl;
+		return;
+	}
+	m_temporalWeight = weight;
+}
+
+VideoSnapping::FrameSuperpixels VideoSnapping::computeSuperpixels(const Mat& frame)
+{
+	WatershedHelper watershed(frame, 10, 10, 2, 2);
+	watershed.Process();
+
+	FrameSuperpixels res;
+	res.Mask = watershed.GetMask();
+	res.Colors = watershed.GetColors();
+	res.Graph = watershed.GetGraph();
+
+	Mat gray;
+	cvtColor(frame, gray, COLOR_BGR2GRAY);
+	resize(gray, gray, Size(), MotionScale, MotionScale, INTER_AREA);
+	gray.convertTo(res.Gray, CV_32F);
+	return res;
+}
+
+Mat VideoSnapping::solveFrame(const FrameSuperpixels& superpixels)
+{
+	if (m_segmentation.empty())
+		throw new exception("Call Start with the first frame before processing the sequence.");
+	if (superpixels.Mask.size() != m_segmentation.size())
+		throw new exception("Frame size not match.");
+
+	// The graph topology changes every frame, so a new graph is built and only the models are carried over.
+	LazySnapping snapping(superpixels.Mask, superpixels.Colors, superpixels.Graph, m_clusterNum, m_e2weight);
+	vector<float> prior = propagatePrior(superpixels.Mask, compensateMotion(superpixels.Gray), static_cast<int>(superpixels.Colors.size()));
+	if (!snapping.ProcessPropagated(m_foreColors, m_backColors, prior, m_temporalWeight))
+	{
+		cout << "Cannot solve the frame, the previous segmentation is kept." << endl;
+		return Mat();
+	}
+	m_segmentation = snapping.GetSegmentation();
+	m_gray = superpixels.Gray;
+	updateColorModels(superpixels, snapping.GetNodeLabels());
+	return m_segmentation.clone();
+}
+
+void VideoSnapping::updateColorModels(const FrameSuperpixels& superpixels, const vector<uchar>& nodeLabels)
+{
+	vector<int> foreComps, backComps;
+	for (size_t i = 0; i < nodeLabels.size(); i++)
+	{
+		if (nodeLabels[i])
+			foreComps.push_back(static_cast<int>(i) + 1);
+		else
+			backComps.push_back(static_cast<int>(i) + 1);
+	}
+
+	ColorKmeans kmeans(m_clusterNum);
+	if (!foreComps.empty())
+	{
+		kmeans.Process(superpixels.Colors, foreComps);
+		m_foreColors = kmeans.GetColors();
+	}
+	if (!backComps.empty())
+	{
+		kmeans.Process(superpixels.Colors, backComps);
+		m_backColors = kmeans.GetColors();
+	}
+}
+
+Mat VideoSnapping::compensateMotion(const Mat& gray) const
+{
+	// The content moves by the detected shift from the previous frame to this one.
+	Point2d shift = phaseCorrelate(m_gray, gray, m_window) * (1.0 / MotionScale);
+	if (abs(shift.x) < 0.5 && abs(shift.y) < 0.5)
+		return m_segmentation;
+
+	Mat transform = (Mat_<double>(2, 3) << 1, 0, shift.x, 0, 1, shift.y);
+	Mat shifted;
+	warpAffine(m_segmentation, shifted, transform, m_segmentation.size(), INTER_NEAREST, BORDER_REPLICATE);
+	return shifted;
+}
+
+vector<float> VideoSnapping::propagatePrior(const Mat& mask, const Mat& segmentation, int nodeCount)
+{
+	vector<int> foreCount(nodeCount, 0);
+	vector<int> totalCount(nodeCount, 0);
+	for (int i = 0; i < mask.rows; i++)
+	{
+		const int* maskptr = mask.ptr<int>(i);
+		const uchar* segptr = segmentation.ptr<uchar>(i);
+		for (int j = 0; j < mask.cols; j++)
+		{
+			totalCount[maskptr[j] - 1]++;
+			if (segptr[j])
+				foreCount[maskptr[j] - 1]++;
+		}
+	}
+
+	// Add one pixel of each label, so small components stay uncertain.
+	vector<float> res(nodeCount);
+	for (int i = 0; i < nodeCount; i++)
+		res[i] = (foreCount[i] + 1.0f) / (totalCount[i] + 2.0f);
+	return res;
+}
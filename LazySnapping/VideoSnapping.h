@@ -0,0 +1,101 @@
+#pragma once
+
+#include<opencv2/core.hpp>
+#include <vector>
+#include "WatershedHelper.h"
+
+/// <summary>
+/// Segment a video frame sequence. The first frame is segmented from marks, every following frame
+/// from the color models and the segmentation of the previous frame. The previous segmentation is
+/// shifted by the global translation between the frames, estimated by phase correlation on small gray
+/// frames, so camera pans keep the prior aligned; other motion is not compensated. The color models are
+/// clustered again from every solved frame, so they follow gradual changes of the scene.
+/// </summary>
+class VideoSnapping
+{
+public:
+	VideoSnapping(int clusterNum = 64, float e2weight = 1000.0, float temporalWeight = 0.5f);
+	~VideoSnapping();
+
+public:
+	/// <summary>
+	/// Segment the first frame from marks and keep its color models.
+	/// </summary>
+	/// <param name="frame">The first frame.</param>
+	/// <param name="paintImage">The paint image. 1 for foreground mark, 2 for background mark.</param>
+	/// <returns>True for successful operation.</returns>
+	bool Start(const cv::Mat& frame, cv::Mat& paintImage);
+
+	/// <summary>
+	/// Segment the next frame by propagating the previous segmentation.
+	/// </summary>
+	/// <returns>The segmentation of the frame. 255 for foreground and 0 for background.
+	/// Empty if the frame cannot be solved, then the previous segmentation and color models are kept.</returns>
+	cv::Mat ProcessFrame(const cv::Mat& frame);
+
+	/// <summary>
+	/// Segment the frames following the start frame in order. The super pixels of upcoming frames
+	/// are computed concurrently while the current frame is solved.
+	/// </summary>
+	/// <returns>The segmentation of every frame, empty for frames that cannot be solved.</returns>
+	std::vector<cv::Mat> ProcessSequence(const std::vector<cv::Mat>& frames);
+
+	/// <summary>
+	/// Get the segmentation of the last frame.
+	/// </summary>
+	cv::Mat GetSegmentation() const;
+
+	/// <summary>
+	/// Set the weight of the propagated segmentation in the likelihood energy.
+	/// </summary>
+	void SetTemporalWeight(float weight);
+
+private:
+	/// <summary>
+	/// Super pixels of one frame.
+	/// </summary>
+	struct FrameSuperpixels
+	{
+		cv::Mat Mask;
+		std::vector<cv::Vec3b> Colors;
+		std::vector<Connection> Graph;
+		cv::Mat Gray;		// Downscaled CV_32FC1 frame for the motion estimate.
+	};
+
+	/// <summary>
+	/// Compute the super pixels of one frame. It only reads the frame, so frames can be processed concurrently.
+	/// </summary>
+	static FrameSuperpixels computeSuperpixels(const cv::Mat& frame);
+
+	/// <summary>
+	/// Segment a frame from its super pixels and the previous segmentation.
+	/// </summary>
+	cv::Mat solveFrame(const FrameSuperpixels& superpixels);
+
+	/// <summary>
+	/// Cluster the color models again from the foreground and background components of a solved frame.
+	/// A side without components keeps its previous model.
+	/// </summary>
+	void updateColorModels(const FrameSuperpixels& superpixels, const std::vector<uchar>& nodeLabels);
+
+	/// <summary>
+	/// Shift the previous segmentation by the global translation from its frame to the given one.
+	/// </summary>
+	cv::Mat compensateMotion(const cv::Mat& gray) const;
+
+	/// <summary>
+	/// Calculate the foreground probability of every component from its foreground pixel ratio in a segmentation.
+	/// </summary>
+	static std::vector<float> propagatePrior(const cv::Mat& mask, const cv::Mat& segmentation, int nodeCount);
+
+private:
+	std::vector<cv::Vec3b> m_foreColors;
+	std::vector<cv::Vec3b> m_backColors;
+	cv::Mat m_segmentation;
+	cv::Mat m_gray;			// Downscaled frame of the segmentation.
+	cv::Mat m_window;		// Hanning window of the phase correlation.
+
+	int m_clusterNum;
+	float m_e2weight;
+	float m_temporalWeight;
+};
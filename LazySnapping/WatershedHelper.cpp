@@ -1,26 +1,67 @@
 #include "WatershedHelper.h"
+#include "Trace.h"
 #include <opencv2/imgproc.hpp>
 #include <queue>
 #include <iostream>
+#include <sstream>
 #include <opencv2/highgui.hpp>
 
 
 using namespace std;
 using namespace cv;
 
+void MergeUndirectedEdges(vector<Connection>& graph)
+{
+	// Locate every section's connection, the graph may be in any order.
+	vector<int> position(graph.size() + 1, -1);
+	for (size_t i = 0; i < graph.size(); i++)
+		position[graph[i].Id] = static_cast<int>(i);
+
+	vector<vector<Edge>> merged(graph.size());
+	for each(auto& connection in graph)
+	{
+		for each(auto& edge in connection.Edges)
+		{
+			int lowId = min(connection.Id, edge.Id);
+			int highId = max(connection.Id, edge.Id);
+			vector<Edge>& edges = merged[position[lowId]];
+			bool flag = false;
+			for (size_t k = 0; k < edges.size(); k++)
+			{
+				if (edges[k].Id == highId)
+				{
+					flag = true;
+					edges[k].Length += edge.Length;
+					break;
+				}
+			}
+			if (!flag)
+				edges.push_back(Edge(highId, edge.Length));
+		}
+	}
+	for (size_t i = 0; i < graph.size(); i++)
+		graph[i].Edges.swap(merged[i]);
+}
+
+size_t ConnectionBytes(const vector<Connection>& graph)
+{
+	size_t bytes = VectorBytes(graph);
+	for each(auto& connection in graph)
+		bytes += VectorBytes(connection.Edges);
+	return bytes;
+}
+
 // Todo: adjust seed generate parameters.
 WatershedHelper::WatershedHelper(const Mat& srcImage, int hs /* = 2 */, int vs /* = 2 */, int hf /* = 2 */, int vf /* = 2 */)
-	: m_compCount(0), m_hspace(hs), m_vspace(vs), m_hoffset(hf), m_voffset(vf), m_seedRowCount(0), m_seedColCount(0)
+	: m_compCount(0), m_hspace(hs), m_vspace(vs), m_hoffset(hf), m_voffset(vf), m_seedMode(SeedMode::Grid), m_gradientThreshold(40.0f), m_maxLevel(3)
 {
 	// Constraint input image type.
 	if (srcImage.type() != CV_8UC3)
 		throw new exception("Input image type must be CV_8UC3");
-	srcImage.copyTo(m_srcImage);
-	
-	// Create mask image.
-	m_maskImage.create(m_srcImage.size(), CV_32SC1);
-	m_rows = m_maskImage.rows;
-	m_cols = m_maskImage.cols;
+	// Keep a reference only, so a view of a mapped file is read tile by tile in ProcessTiled.
+	m_srcImage = srcImage;
+	m_rows = m_srcImage.rows;
+	m_cols = m_srcImage.cols;
 }
 
 WatershedHelper::~WatershedHelper()
@@ -29,8 +70,15 @@ WatershedHelper::~WatershedHelper()
 
 void WatershedHelper::Process(bool showRes /* = false */)
 {
+	TRACE_SCOPE("WatershedHelper::Process");
+	// The mask image is created on demand, tiled processing never allocates the full image.
+	m_maskImage.create(m_srcImage.size(), CV_32SC1);
+	m_graph.clear();
 	generateSeeds();
-	watershed(m_srcImage, m_maskImage);
+	{
+		TRACE_SCOPE("watershed");
+		watershed(m_srcImage, m_maskImage);
+	}
 	buildGraph();
 	removeBorder();
 
@@ -48,17 +96,66 @@ void WatershedHelper::Process(bool showRes /* = false */)
 		showWatershedResult();
 }
 
+void WatershedHelper::ProcessTiled(TiledImage& labels)
+{
+	if (labels.Type() != CV_32SC1 || labels.Size() != m_srcImage.size())
+		throw new exception("Label image must be CV_32SC1 with the source image size");
+
+	m_maskImage.release();
+	m_nodeColors.clear();
+	m_graph.clear();
+	m_compCount = 0;
+	for (int t = 0; t < labels.TileCount(); t++)
+	{
+		// Each tile is an independent watershed problem.
+		Rect tileRect = labels.TileRect(t);
+		WatershedHelper tileHelper(m_srcImage(tileRect), m_hspace, m_vspace, min(m_hoffset, tileRect.width - 1), min(m_voffset, tileRect.height - 1));
+		tileHelper.SetSeedMode(m_seedMode, m_gradientThreshold, m_maxLevel);
+		tileHelper.Process();
+
+		// Shift the section ids so they are unique over the whole image.
+		int idOffset = m_compCount;
+		Mat tileLabels = labels.Tile(t);
+		for (int i = 0; i < tileRect.height; i++)
+		{
+			const int* srcptr = tileHelper.m_maskImage.ptr<int>(i);
+			int* dstptr = tileLabels.ptr<int>(i);
+			for (int j = 0; j < tileRect.width; j++)
+				dstptr[j] = srcptr[j] + idOffset;
+		}
+
+		m_compCount += tileHelper.m_compCount;
+		m_nodeColors.insert(m_nodeColors.end(), tileHelper.m_nodeColors.begin(), tileHelper.m_nodeColors.end());
+		for (int id = idOffset + 1; id <= m_compCount; id++)
+			m_graph.push_back(Connection(id));
+		for each(auto& connection in tileHelper.m_graph)
+		{
+			Connection& target = m_graph[connection.Id + idOffset - 1];
+			for each(auto& edge in connection.Edges)
+				target.Edges.push_back(Edge(edge.Id + idOffset, edge.Length));
+		}
+	}
+	stitchTiles(labels);
+}
+
+void WatershedHelper::GetMemoryReport(MemoryReport& report) const
+{
+	report.Add("source image", MatBytes(m_srcImage));
+	report.Add("watershed mask", MatBytes(m_maskImage));
+	report.Add("watershed colors", VectorBytes(m_nodeColors));
+	report.Add("watershed graph", ConnectionBytes(m_graph));
+	report.Add("watershed seeds", VectorBytes(m_seedPoints));
+}
+
 void WatershedHelper::SetSrcImage(const cv::Mat& srcImage)
 {
 	// Constraint input image type.
 	if (srcImage.type() != CV_8UC3)
 		throw new exception("Input image type must be CV_8UC3");
-	srcImage.copyTo(m_srcImage);
-
-	// Create mask image.
-	m_maskImage.create(m_srcImage.size(), CV_32SC1);
-	m_rows = m_maskImage.rows;
-	m_cols = m_maskImage.cols;
+	// Keep a reference only, so a view of a mapped file is read tile by tile in ProcessTiled.
+	m_srcImage = srcImage;
+	m_rows = m_srcImage.rows;
+	m_cols = m_srcImage.cols;
 }
 
 void WatershedHelper::SetSeedConfig(int hs, int vs, int hf, int vf)
@@ -69,6 +166,15 @@ void WatershedHelper::SetSeedConfig(int hs, int vs, int hf, int vf)
 	m_voffset = vf;
 }
 
+void WatershedHelper::SetSeedMode(SeedMode mode, float gradientThreshold /* = 40.0f */, int maxLevel /* = 3 */)
+{
+	if (gradientThreshold < 0 || maxLevel < 0 || maxLevel > 8)
+		throw new exception("Invalid adaptive seed parameters");
+	m_seedMode = mode;
+	m_gradientThreshold = gradientThreshold;
+	m_maxLevel = maxLevel;
+}
+
 Mat WatershedHelper::GetMask() const
 {
 	Mat res;
@@ -78,8 +184,18 @@ Mat WatershedHelper::GetMask() const
 vector<Vec3b> WatershedHelper::GetColors() const { return m_nodeColors; }
 vector<Connection> WatershedHelper::GetGraph() const { return m_graph; }
 
+string WatershedHelper::GetConfigKey() const
+{
+	stringstream key;
+	key << "watershed " << m_hspace << " " << m_vspace << " " << m_hoffset << " " << m_voffset;
+	if (m_seedMode == SeedMode::Adaptive)
+		key << " adaptive " << m_gradientThreshold << " " << m_maxLevel;
+	return key.str();
+}
+
 void WatershedHelper::buildGraph()
 {
+	TRACE_SCOPE("buildGraph");
 	// Use cache to mark the pixels which have been visited.
 	Mat cache(m_maskImage.size(), CV_8SC1);
 	cache = Scalar::all(0);
@@ -182,31 +298,101 @@ void WatershedHelper::buildGraph()
 			borderNodes.push(element.Pos);
 		}
 	}
+
+	// A border may be recorded by both sections.
+	MergeUndirectedEdges(m_graph);
 }
 
 void WatershedHelper::generateSeeds()
 {
+	TRACE_SCOPE("generateSeeds");
 	if (m_hoffset >= m_srcImage.cols || m_voffset >= m_srcImage.rows)
 		throw new exception("Invalid offset parameters");
 
 	// Seed start from 1.
 	m_maskImage = Scalar::all(0);
-	m_compCount = 1;
+	m_seedPoints.clear();
+	if (m_seedMode == SeedMode::Adaptive)
+		generateAdaptiveSeeds();
+	else
+		generateGridSeeds();
+	m_compCount = static_cast<int>(m_seedPoints.size());
+}
+
+void WatershedHelper::generateGridSeeds()
+{
 	for (int i = m_voffset; i < m_rows; i += m_vspace)
 	{
 		for (int j = m_hoffset; j < m_cols; j += m_hspace)
 		{
-			m_maskImage.at<int>(i, j) = m_compCount++;
+			addSeed(Point(j, i));
+		}
+	}
+}
+
+void WatershedHelper::generateAdaptiveSeeds()
+{
+	// Mark strong gradient pixels as edge pixels and count them with an integral image,
+	// so the edge pixel number inside any cell is read in constant time.
+	Mat gray, dx, dy, gradient;
+	cvtColor(m_srcImage, gray, COLOR_BGR2GRAY);
+	GaussianBlur(gray, gray, Size(3, 3), 0);
+	Sobel(gray, dx, CV_32F, 1, 0);
+	Sobel(gray, dy, CV_32F, 0, 1);
+	magnitude(dx, dy, gradient);
+	Mat edges = gradient > m_gradientThreshold;
+	edges.convertTo(edges, CV_32S, 1.0 / 255);
+	Mat edgeSum;
+	integral(edges, edgeSum, CV_32S);
+
+	// Tile the image with the coarsest cells. The offsets are not used in this mode.
+	int cellWidth = m_hspace << m_maxLevel;
+	int cellHeight = m_vspace << m_maxLevel;
+	for (int i = 0; i < m_rows; i += cellHeight)
+	{
+		for (int j = 0; j < m_cols; j += cellWidth)
+		{
+			Rect cell(j, i, min(cellWidth, m_cols - j), min(cellHeight, m_rows - i));
+			subdivideCell(cell, edgeSum);
 		}
 	}
-	m_compCount--;
+}
+
+void WatershedHelper::subdivideCell(const Rect& cell, const Mat& edgeSum)
+{
+	int edgeCount = edgeSum.at<int>(cell.y + cell.height, cell.x + cell.width)
+		- edgeSum.at<int>(cell.y, cell.x + cell.width)
+		- edgeSum.at<int>(cell.y + cell.height, cell.x)
+		+ edgeSum.at<int>(cell.y, cell.x);
+	// Isolated noise pixels should not split a cell.
+	int minEdgeCount = max(1, min(cell.width, cell.height) / 4);
+
+	if (edgeCount < minEdgeCount || cell.width <= m_hspace || cell.height <= m_vspace)
+	{
+		addSeed(Point(cell.x + cell.width / 2, cell.y + cell.height / 2));
+		return;
+	}
 
-	m_seedRowCount = 1 + (m_rows - m_voffset - 1) / m_vspace;
-	m_seedColCount = 1 + (m_cols - m_hoffset - 1) / m_hspace;
+	int halfWidth = (cell.width + 1) / 2;
+	int halfHeight = (cell.height + 1) / 2;
+	subdivideCell(Rect(cell.x, cell.y, halfWidth, halfHeight), edgeSum);
+	if (cell.width > halfWidth)
+		subdivideCell(Rect(cell.x + halfWidth, cell.y, cell.width - halfWidth, halfHeight), edgeSum);
+	if (cell.height > halfHeight)
+		subdivideCell(Rect(cell.x, cell.y + halfHeight, halfWidth, cell.height - halfHeight), edgeSum);
+	if (cell.width > halfWidth && cell.height > halfHeight)
+		subdivideCell(Rect(cell.x + halfWidth, cell.y + halfHeight, cell.width - halfWidth, cell.height - halfHeight), edgeSum);
+}
+
+void WatershedHelper::addSeed(const Point& pos)
+{
+	m_seedPoints.push_back(pos);
+	m_maskImage.at<int>(pos) = static_cast<int>(m_seedPoints.size());
 }
 
 void WatershedHelper::removeBorder()
 {
+	TRACE_SCOPE("removeBorder");
 	// Use cache to mark the pixels which have been visited.
 	Mat cache(m_maskImage.size(), CV_8SC1);
 	cache = Scalar::all(0);
@@ -268,6 +454,46 @@ void WatershedHelper::removeBorder()
 	}
 }
 
+void WatershedHelper::stitchTiles(const TiledImage& labels)
+{
+	// Count the pixel pairs across every vertical and horizontal tile seam.
+	Mat strip;
+	for (int t = 0; t < labels.TileCount(); t++)
+	{
+		Rect tileRect = labels.TileRect(t);
+		if (tileRect.x + tileRect.width < m_cols)
+		{
+			labels.Read(Rect(tileRect.x + tileRect.width - 1, tileRect.y, 2, tileRect.height), strip);
+			for (int i = 0; i < strip.rows; i++)
+				addBorder(strip.at<int>(i, 0), strip.at<int>(i, 1));
+		}
+		if (tileRect.y + tileRect.height < m_rows)
+		{
+			labels.Read(Rect(tileRect.x, tileRect.y + tileRect.height - 1, tileRect.width, 2), strip);
+			for (int j = 0; j < strip.cols; j++)
+				addBorder(strip.at<int>(0, j), strip.at<int>(1, j));
+		}
+	}
+}
+
+void WatershedHelper::addBorder(int compA, int compB)
+{
+	if (compA == compB)
+		return;
+	vector<Edge>& edges = m_graph[min(compA, compB) - 1].Edges;
+	int adjacentComp = max(compA, compB);
+	for (size_t k = 0; k < edges.size(); k++)
+	{
+		if (edges[k].Id == adjacentComp)
+		{
+			// Already border, increase border length.
+			edges[k].Length++;
+			return;
+		}
+	}
+	edges.push_back(Edge(adjacentComp, 1));
+}
+
 bool WatershedHelper::isBound(const Point& pos) const
 {
 	if (pos.x < 0 || pos.x >= m_cols || pos.y < 0 || pos.y >= m_rows)
@@ -313,17 +539,8 @@ void WatershedHelper::showWatershedResult()
 
 Point WatershedHelper::TransCompIdToPoint(int id) const
 {
-	int r = id / m_seedColCount;
-	int c = id % m_seedColCount - 1;
-	if (c < 0)
-	{
-		r--;
-		c += m_seedColCount;
-	}
-	r = m_voffset + r*m_vspace;
-	c = m_hoffset + c*m_hspace;
-
-	return Point(c, r);
+	if (id < 1 || id > static_cast<int>(m_seedPoints.size()))
+		throw new exception("No such component id.");
+	return m_seedPoints[id - 1];
 }
 
-
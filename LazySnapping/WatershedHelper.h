@@ -3,6 +3,8 @@
 #include<opencv2/core.hpp>
 #include <vector>
 #include <string>
+#include "TiledImage.h"
+#include "MemoryReport.h"
 
 /// <summary>
 /// One section edge. It record the adjacent section's id and border length.
@@ -18,6 +20,7 @@ struct Edge
 
 /// <summary>
 /// Node relationship in graph.
+/// Each undirected adjacency is stored once, on the section with the lower id.
 /// </summary>
 struct Connection
 {
@@ -28,6 +31,18 @@ struct Connection
 	std::vector<Edge> Edges;
 };
 
+/// <summary>
+/// Store every adjacency of the graph once, on the section with the lower id.
+/// Border lengths recorded from both sides are summed.
+/// </summary>
+/// <param name="graph">The graph. Section ids must be in [1, graph size].</param>
+void MergeUndirectedEdges(std::vector<Connection>& graph);
+
+/// <summary>
+/// Get the memory used by a graph in bytes.
+/// </summary>
+size_t ConnectionBytes(const std::vector<Connection>& graph);
+
 /// <summary>
 /// Section border information. It record adjacent section's id, border length and seed.
 /// </summary>
@@ -42,8 +57,20 @@ struct BorderElement
 };
 
 
+/// <summary>
+/// Seed placement strategy used by "generateSeeds" method.
+/// Grid places seeds uniformly. Adaptive places seeds on a gradient driven quadtree,
+/// so homogeneous areas get fewer and larger sections.
+/// </summary>
+enum class SeedMode
+{
+	Grid,
+	Adaptive
+};
+
 /// <summary>
 /// Segment image using watershed algorithm to generate super pixels.
+/// The source image is referenced, not copied, and must not change while it is processed.
 /// </summary>
 class WatershedHelper
 {
@@ -54,11 +81,20 @@ public:
 public:
 	/// <summary>
 	/// Watershed the source image. Each watershed section is filled with the average color.
-	/// The directed graph will be build.
+	/// The section graph will be build.
 	/// </summary>
 	/// <param name="showWatershed">Set to true to show watershed result.</param>
 	void Process(bool showWatershed = false);
 
+	/// <summary>
+	/// Watershed the source image tile by tile and write the labels to a tiled image, so the full label map
+	/// never has to fit in memory. Sections do not cross tile borders. Tiles are stitched in the graph.
+	/// Only one tile of the source image is read at a time, so it may be a view of a mapped file.
+	/// GetMask is not available afterwards.
+	/// </summary>
+	/// <param name="labels">The CV_32SC1 label storage with the source image size.</param>
+	void ProcessTiled(TiledImage& labels);
+
 	/// <summary>
 	/// Set the source image.
 	/// </summary>
@@ -74,26 +110,77 @@ public:
 	/// <param name="vf">The vertical offset.</param>
 	void SetSeedConfig(int hs, int vs, int hf, int vf);
 
+	/// <summary>
+	/// Sets the seed placement mode.
+	/// </summary>
+	/// <param name="mode">The seed mode.</param>
+	/// <param name="gradientThreshold">Adaptive mode only. Pixel whose gradient magnitude exceeds this value is an edge pixel.</param>
+	/// <param name="maxLevel">Adaptive mode only. The coarsest cell is (space << maxLevel) pixels wide.</param>
+	void SetSeedMode(SeedMode mode, float gradientThreshold = 40.0f, int maxLevel = 3);
+
 	cv::Mat GetMask() const;
 	std::vector<cv::Vec3b> GetColors() const;
 	std::vector<Connection> GetGraph() const;
 
+	/// <summary>
+	/// Get a text key of all parameters affecting the result. Used by SuperpixelCache.
+	/// </summary>
+	std::string GetConfigKey() const;
+
+	/// <summary>
+	/// Add the memory of the source image, mask, node colors, graph and seeds to a report.
+	/// </summary>
+	void GetMemoryReport(MemoryReport& report) const;
+
 private:
 	/// <summary>
-	/// Generate seed points uniformly.
+	/// Generate seed points according to the seed mode.
 	/// </summary>
 	void generateSeeds();
 
+	/// <summary>
+	/// Generate seed points uniformly.
+	/// </summary>
+	void generateGridSeeds();
+
+	/// <summary>
+	/// Generate seed points on a quadtree. A cell is split while it contains edge pixels
+	/// and it is larger than the grid space.
+	/// </summary>
+	void generateAdaptiveSeeds();
+
+	/// <summary>
+	/// Recursively subdivide one quadtree cell and place the seeds.
+	/// </summary>
+	/// <param name="cell">The cell area.</param>
+	/// <param name="edgeSum">Integral image of the edge pixel map.</param>
+	void subdivideCell(const cv::Rect& cell, const cv::Mat& edgeSum);
+
+	/// <summary>
+	/// Place one seed at the specified position.
+	/// </summary>
+	void addSeed(const cv::Point& pos);
+
 	/// <summary>
 	/// Remove the watershed border residue after build graph process. Use BFS method. 
 	/// </summary>
 	void removeBorder();
 
 	/// <summary>
-	/// Build the watershed graph. It will be a directed graph.
+	/// Build the watershed graph. Each adjacency is stored once.
 	/// </summary>
 	void buildGraph();
 
+	/// <summary>
+	/// Add the edges between sections across tile seams after tiled processing.
+	/// </summary>
+	void stitchTiles(const TiledImage& labels);
+
+	/// <summary>
+	/// Increase the border length between two sections by one.
+	/// </summary>
+	void addBorder(int compA, int compB);
+
 	/// <summary>
 	/// Determine whether the specified point is in the image area.
 	/// </summary>
@@ -129,10 +216,13 @@ private:
 	int m_hoffset;
 	int m_voffset;
 
+	SeedMode m_seedMode;
+	float m_gradientThreshold;
+	int m_maxLevel;
+	std::vector<cv::Point> m_seedPoints;
+
 	int m_rows;
 	int m_cols;
-	int m_seedRowCount;
-	int m_seedColCount;
 
 	const std::string WatershedWindowName = "Watershed";
 	const std::string GraphWindowName = "Graph";
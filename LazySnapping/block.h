@@ -91,6 +91,7 @@
 #define __BLOCK_H__
 
 #include <stdlib.h>
+#include <new>
 
 /***********************************************************************/
 /***********************************************************************/
@@ -102,7 +103,8 @@ public:
 	/* Constructor. Arguments are the block size and
 	   (optionally) the pointer to the function which
 	   will be called if allocation failed; the message
-	   passed to this function is "Not enough memory!" */
+	   passed to this function is "Not enough memory!".
+	   std::bad_alloc is thrown afterwards */
 	Block(int size, void (*err_function)(char *) = NULL) { first = last = NULL; block_size = size; error_function = err_function; }
 
 	/* Destructor. Deallocates all items added so far */
@@ -120,8 +122,8 @@ public:
 			if (last && last->next) last = last -> next;
 			else
 			{
-				block *next = (block *) new char [sizeof(block) + (block_size-1)*sizeof(Type)];
-				if (!next) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+				block *next = (block *) new (std::nothrow) char [sizeof(block) + (block_size-1)*sizeof(Type)];
+				if (!next) { if (error_function) (*error_function)("Not enough memory!"); throw std::bad_alloc(); }
 				if (last) last -> next = next;
 				else first = next;
 				last = next;
@@ -205,8 +207,9 @@ public:
 	/* Constructor. Arguments are the block size and
 	   (optionally) the pointer to the function which
 	   will be called if allocation failed; the message
-	   passed to this function is "Not enough memory!" */
-	DBlock(int size, void (*err_function)(char *) = NULL) { first = NULL; first_free = NULL; block_size = size; error_function = err_function; }
+	   passed to this function is "Not enough memory!".
+	   std::bad_alloc is thrown afterwards */
+	DBlock(int size, void (*err_function)(char *) = NULL) { first = NULL; first_free = NULL; block_size = size; block_num = 0; error_function = err_function; }
 
 	/* Destructor. Deallocates all items added so far */
 	~DBlock() { while (first) { block *next = first -> next; delete[] ((char*)first); first = next; } }
@@ -218,14 +221,15 @@ public:
 
 		if (!first_free)
 		{
-			block *next = first;
-			first = (block *) new char [sizeof(block) + (block_size-1)*sizeof(block_item)];
-			if (!first) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+			block *next = (block *) new (std::nothrow) char [get_block_memory()];
+			if (!next) { if (error_function) (*error_function)("Not enough memory!"); throw std::bad_alloc(); }
+			next -> next = first;
+			first = next;
 			first_free = & (first -> data[0] );
 			for (item=first_free; item<first_free+block_size-1; item++)
 				item -> next_free = item + 1;
 			item -> next_free = NULL;
-			first -> next = next;
+			block_num ++;
 		}
 
 		item = first_free;
@@ -240,6 +244,16 @@ public:
 		first_free = (block_item *) t;
 	}
 
+	/* Returns true if the next New() allocates a new block */
+	bool is_full() const { return !first_free; }
+
+	/* Returns the size of one block in bytes */
+	size_t get_block_memory() const { return sizeof(block) + (block_size-1)*sizeof(block_item); }
+
+	/* Returns the memory allocated so far in bytes. Deleted items
+	   are kept for reuse, so it never shrinks */
+	size_t get_memory_usage() const { return (size_t) block_num * get_block_memory(); }
+
 /***********************************************************************/
 
 private:
@@ -257,6 +271,7 @@ private:
 	} block;
 
 	int			block_size;
+	int			block_num;
 	block		*first;
 	block_item	*first_free;
 
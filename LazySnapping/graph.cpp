@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 #include "graph.h"
 
 
@@ -11,14 +12,15 @@ template <typename captype, typename tcaptype, typename flowtype>
 	Graph<captype, tcaptype, flowtype>::Graph(int node_num_max, int edge_num_max, void (*err_function)(char *))
 	: node_num(0),
 	  nodeptr_block(NULL),
-	  error_function(err_function)
+	  error_function(err_function),
+	  memory_limit(0)
 {
 	if (node_num_max < 16) node_num_max = 16;
 	if (edge_num_max < 16) edge_num_max = 16;
 
 	nodes = (node*) malloc(node_num_max*sizeof(node));
 	arcs = (arc*) malloc(2*edge_num_max*sizeof(arc));
-	if (!nodes || !arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+	if (!nodes || !arcs) { free(nodes); free(arcs); memory_error(); }
 
 	node_last = nodes;
 	node_max = nodes + node_num_max;
@@ -27,6 +29,8 @@ template <typename captype, typename tcaptype, typename flowtype>
 
 	maxflow_iteration = 0;
 	flow = 0;
+	current_node = NULL;
+	maxflow_pending = false;
 }
 
 template <typename captype, typename tcaptype, typename flowtype> 
@@ -56,6 +60,8 @@ template <typename captype, typename tcaptype, typename flowtype>
 
 	maxflow_iteration = 0;
 	flow = 0;
+	current_node = NULL;
+	maxflow_pending = false;
 }
 
 template <typename captype, typename tcaptype, typename flowtype> 
@@ -66,8 +72,9 @@ template <typename captype, typename tcaptype, typename flowtype>
 
 	node_num_max += node_num_max / 2;
 	if (node_num_max < node_num + num) node_num_max = node_num + num;
+	if (memory_limit && (size_t)node_num_max*sizeof(node) + (size_t)(arc_max - arcs)*sizeof(arc) + get_orphan_memory() > memory_limit) memory_error();
 	nodes = (node*) realloc(nodes_old, node_num_max*sizeof(node));
-	if (!nodes) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+	if (!nodes) { nodes = nodes_old; memory_error(); }
 
 	node_last = nodes + node_num;
 	node_max = nodes + node_num_max;
@@ -90,8 +97,9 @@ template <typename captype, typename tcaptype, typename flowtype>
 	arc* arcs_old = arcs;
 
 	arc_num_max += arc_num_max / 2; if (arc_num_max & 1) arc_num_max ++;
+	if (memory_limit && (size_t)(node_max - nodes)*sizeof(node) + (size_t)arc_num_max*sizeof(arc) + get_orphan_memory() > memory_limit) memory_error();
 	arcs = (arc*) realloc(arcs_old, arc_num_max*sizeof(arc));
-	if (!arcs) { if (error_function) (*error_function)("Not enough memory!"); exit(1); }
+	if (!arcs) { arcs = arcs_old; memory_error(); }
 
 	arc_last = arcs + arc_num;
 	arc_max = arcs + arc_num_max;
@@ -112,4 +120,29 @@ template <typename captype, typename tcaptype, typename flowtype>
 	}
 }
 
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::memory_error()
+{
+	if (error_function) (*error_function)("Not enough memory!");
+	throw std::bad_alloc();
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	size_t Graph<captype,tcaptype,flowtype>::get_memory_usage()
+{
+	return (size_t)(node_max - nodes)*sizeof(node) + (size_t)(arc_max - arcs)*sizeof(arc) + get_orphan_memory();
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	size_t Graph<captype,tcaptype,flowtype>::get_orphan_memory() const
+{
+	return nodeptr_block ? nodeptr_block->get_memory_usage() : 0;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::set_memory_limit(size_t bytes)
+{
+	memory_limit = bytes;
+}
+
 #include "instances.inc"
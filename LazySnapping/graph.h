@@ -72,7 +72,7 @@ public:
 	// to the graph, and the second argument is an estimate of the maximum number of edges.
 	// The last (optional) argument is the pointer to the function which will be called 
 	// if an error occurs; an error message is passed to this function. 
-	// If this argument is omitted, exit(1) will be called.
+	// If this argument is omitted, std::bad_alloc will be thrown if memory runs out.
 	//
 	// IMPORTANT: It is possible to add more nodes to the graph than node_num_max 
 	// (and node_num_max can be zero). However, if the count is exceeded, then 
@@ -114,6 +114,20 @@ public:
 	// to both the source and the sink, then default_segm is returned.
 	termtype what_segment(node_id i, termtype default_segm = SOURCE);
 
+	// Same as maxflow(), but stops after at most max_growths growth steps.
+	// Returns true if the maxflow is complete. Otherwise the search state is kept and
+	// maxflow_resume() continues from it; the graph must not be modified in between.
+	// While the maxflow is incomplete, what_segment() reports the current search trees,
+	// which is a valid but possibly suboptimal cut, and get_flow() the flow found so far.
+	bool maxflow_limited(long max_growths, bool reuse_trees = false, Block<node_id>* changed_list = NULL);
+	bool maxflow_resume(long max_growths);
+
+	// Returns true if a maxflow_limited() computation has not completed yet.
+	bool maxflow_incomplete() { return maxflow_pending; }
+
+	// Returns the flow pushed so far.
+	flowtype get_flow() { return flow; }
+
 
 
 	//////////////////////////////////////////////
@@ -162,6 +176,16 @@ public:
 	int get_arc_num() { return (int)(arc_last - arcs); }
 	void get_arc_ends(arc_id a, node_id& i, node_id& j); // returns i,j to that a = i->j
 
+	// returns the memory allocated by the graph in bytes: the node and arc arrays, including
+	// the unused capacity left by growing them by 50%, and the orphan blocks of maxflow()
+	size_t get_memory_usage();
+
+	// limits the node and arc arrays and the orphan blocks of maxflow() to 'bytes' (0 means no limit).
+	// Growing beyond the limit fails like running out of memory: the error function is called and
+	// std::bad_alloc is thrown. Adding nodes or edges leaves the graph as it was before the failed call;
+	// a failed maxflow() leaves it in the middle of the solve, so it must be reset before it is used again.
+	void set_memory_limit(size_t bytes);
+
 	///////////////////////////////////////////////////
 	// 3. Functions for reading residual capacities. //
 	///////////////////////////////////////////////////
@@ -301,8 +325,9 @@ private:
 	DBlock<nodeptr>		*nodeptr_block;
 
 	void	(*error_function)(char *);	// this function is called if a error occurs,
-										// with a corresponding error message
-										// (or exit(1) is called if it's NULL)
+										// with a corresponding error message;
+										// std::bad_alloc is thrown afterwards for memory errors
+	size_t				memory_limit;	// limit of the node and arc arrays and orphan blocks in bytes, 0 for no limit
 
 	flowtype			flow;		// total flow
 
@@ -310,6 +335,11 @@ private:
 	int					maxflow_iteration; // counter
 	Block<node_id>		*changed_list;
 
+	// state of an interrupted maxflow computation
+	node				*current_node;
+	bool				maxflow_pending;
+	bool				reuse_trees_pending;
+
 	/////////////////////////////////////////////////////////////////////////
 
 	node				*queue_first[2], *queue_last[2];	// list of active nodes
@@ -320,12 +350,15 @@ private:
 
 	void reallocate_nodes(int num); // num is the number of new nodes
 	void reallocate_arcs();
+	void memory_error(); // reports a failed allocation and throws std::bad_alloc
+	size_t get_orphan_memory() const; // memory of the orphan blocks in bytes
 
 	// functions for processing active list
 	void set_active(node *i);
 	node *next_active();
 
 	// functions for processing orphans list
+	nodeptr *new_nodeptr(); // allocates an orphan list item within the memory limit
 	void set_orphan_front(node* i); // add to the beginning of the list
 	void set_orphan_rear(node* i);  // add to the end of the list
 
@@ -333,6 +366,8 @@ private:
 
 	void maxflow_init();             // called if reuse_trees == false
 	void maxflow_reuse_trees_init(); // called if reuse_trees == true
+	void maxflow_start(bool reuse_trees, Block<node_id>* changed_list);
+	bool maxflow_run(long max_growths); // max_growths <= 0 means no limit
 	void augment(arc *middle_arc);
 	void process_source_orphan(node *i);
 	void process_sink_orphan(node *i);
@@ -76,12 +76,20 @@ template <typename captype, typename tcaptype, typename flowtype>
 
 /***********************************************************************/
 
+template <typename captype, typename tcaptype, typename flowtype> 
+	inline typename Graph<captype,tcaptype,flowtype>::nodeptr* Graph<captype,tcaptype,flowtype>::new_nodeptr()
+{
+	// a new orphan block counts against the memory limit like the node and arc arrays
+	if (memory_limit && nodeptr_block -> is_full() && get_memory_usage() + nodeptr_block -> get_block_memory() > memory_limit) memory_error();
+	return nodeptr_block -> New();
+}
+
 template <typename captype, typename tcaptype, typename flowtype> 
 	inline void Graph<captype,tcaptype,flowtype>::set_orphan_front(node *i)
 {
 	nodeptr *np;
 	i -> parent = ORPHAN;
-	np = nodeptr_block -> New();
+	np = new_nodeptr();
 	np -> ptr = i;
 	np -> next = orphan_first;
 	orphan_first = np;
@@ -92,7 +100,7 @@ template <typename captype, typename tcaptype, typename flowtype>
 {
 	nodeptr *np;
 	i -> parent = ORPHAN;
-	np = nodeptr_block -> New();
+	np = new_nodeptr();
 	np -> ptr = i;
 	if (orphan_last) orphan_last -> next = np;
 	else             orphan_first        = np;
@@ -471,10 +479,28 @@ template <typename captype, typename tcaptype, typename flowtype>
 template <typename captype, typename tcaptype, typename flowtype> 
 	flowtype Graph<captype,tcaptype,flowtype>::maxflow(bool reuse_trees, Block<node_id>* _changed_list)
 {
-	node *i, *j, *current_node = NULL;
-	arc *a;
-	nodeptr *np, *np_next;
+	maxflow_start(reuse_trees, _changed_list);
+	maxflow_run(0);
+	return flow;
+}
 
+template <typename captype, typename tcaptype, typename flowtype> 
+	bool Graph<captype,tcaptype,flowtype>::maxflow_limited(long max_growths, bool reuse_trees, Block<node_id>* _changed_list)
+{
+	maxflow_start(reuse_trees, _changed_list);
+	return maxflow_run(max_growths);
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	bool Graph<captype,tcaptype,flowtype>::maxflow_resume(long max_growths)
+{
+	if (!maxflow_pending) return true;
+	return maxflow_run(max_growths);
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	void Graph<captype,tcaptype,flowtype>::maxflow_start(bool reuse_trees, Block<node_id>* _changed_list)
+{
 	if (!nodeptr_block)
 	{
 		nodeptr_block = new DBlock<nodeptr>(NODEPTR_BLOCK_SIZE, error_function);
@@ -487,11 +513,28 @@ template <typename captype, typename tcaptype, typename flowtype>
 	if (reuse_trees) maxflow_reuse_trees_init();
 	else             maxflow_init();
 
+	current_node = NULL;
+	reuse_trees_pending = reuse_trees;
+	maxflow_pending = true;
+}
+
+template <typename captype, typename tcaptype, typename flowtype> 
+	bool Graph<captype,tcaptype,flowtype>::maxflow_run(long max_growths)
+{
+	node *i, *j;
+	arc *a;
+	nodeptr *np, *np_next;
+	long growths = 0;
+
 	// main loop
 	while ( 1 )
 	{
 		// test_consistency(current_node);
 
+		// stop between iterations, where the trees and the active list are consistent
+		if (max_growths > 0 && growths >= max_growths) return false;
+		growths ++;
+
 		if ((i=current_node))
 		{
 			i -> next = NULL; /* remove active flag */
@@ -593,14 +636,16 @@ template <typename captype, typename tcaptype, typename flowtype>
 	}
 	// test_consistency();
 
-	if (!reuse_trees || (maxflow_iteration % 64) == 0)
+	if (!reuse_trees_pending || (maxflow_iteration % 64) == 0)
 	{
 		delete nodeptr_block; 
 		nodeptr_block = NULL; 
 	}
 
 	maxflow_iteration ++;
-	return flow;
+	current_node = NULL;
+	maxflow_pending = false;
+	return true;
 }
 
 /***********************************************************************/
@@ -1,8 +1,19 @@
 #include "WatershedHelper.h"
+#include "SlicHelper.h"
 #include "LazySnapping.h"
+#include "SuperpixelCache.h"
+#include "Benchmark.h"
+#include "ContourOverlay.h"
+#include "SessionHistory.h"
+#include "SessionRecorder.h"
+#include "SnappingServer.h"
+#include "BatchPipeline.h"
+#include "MaskEncoding.h"
+#include "Trace.h"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
 #include <memory>
@@ -13,23 +24,201 @@ using namespace cv;
 Mat InterImg, ResImg, BackUpImg, PaintMask;
 Point OldPt;
 bool IsPressed = false;
+bool ParametricSolved = false;	// Indicate whether the segmentation of the current marks is solved for a weight range.
+bool RoiMode = false;
 
 int CurrentMode = 0;	// Indicate foreground or background, foreground as default. 0 for foreground and 1 for background.
 const Scalar PaintColor[2] = { CV_RGB(0,0,255),CV_RGB(255,0,0) };
 const string WindowName = "LazySnapping";
+const string CacheDirectory = "cache";
+const string ImagePath = "images/ear_2.jpg";
 unique_ptr<WatershedHelper> WatershedProcessor;
+unique_ptr<SuperpixelCache> SuperpixelCacheProcessor;	// Keeps the cached mask mapped.
 unique_ptr<LazySnapping> LazySnappingProcessor;
+unique_ptr<ContourOverlay> ContourProcessor;
+unique_ptr<SessionHistory> History;
+SessionRecorder Recorder;
 
-void FindConnectedComponents(const Mat& mask, vector<vector<Point>>& contours, bool poly1_hull0 = true,	float perimScale = 4);
 void onMouse(int event, int x, int y, int flags, void*);
 void Help();
 void Process();
+void ShowResult(bool record = true);
+void RestorePaint();
 
-void main()
+void main(int argc, char** argv)
 {
+#ifdef LAZYSNAPPING_TRACE
+	// Write the trace spans of this run on exit.
+	TraceRecorder::Instance().SetOutputPath("trace.json");
+#endif
+	if (argc > 1 && string(argv[1]) == "--bench-seeds")
+	{
+		// Benchmark seed modes on the bundled images.
+		vector<String> imagePaths, earPaths;
+		glob("images/*", imagePaths);
+		glob("ear/*", earPaths);
+		imagePaths.insert(imagePaths.end(), earPaths.begin(), earPaths.end());
+		RunSeedBenchmark(vector<string>(imagePaths.begin(), imagePaths.end()));
+		return;
+	}
+	if (argc > 1 && string(argv[1]) == "--bench-scaling")
+	{
+		// Scale synthetic inputs up to the given megapixels and graph nodes.
+		double maxMegapixels = argc > 2 ? atof(argv[2]) : 16;
+		int maxNodes = argc > 3 ? atoi(argv[3]) : 1 << 20;
+		RunScalingBenchmark("scaling.csv", maxMegapixels, maxNodes);
+		return;
+	}
+	if (argc > 1 && string(argv[1]) == "--solve")
+	{
+		// Solve exported min cut problems.
+		RunProblemBenchmark(vector<string>(argv + 2, argv + argc));
+		return;
+	}
+	if (argc > 1 && string(argv[1]) == "--replay")
+	{
+		// Replay the given sessions, or the checked in ones.
+		vector<string> sessionPaths(argv + 2, argv + argc);
+		if (sessionPaths.empty())
+		{
+			vector<String> paths;
+			glob("sessions/*.session", paths);
+			sessionPaths.assign(paths.begin(), paths.end());
+		}
+		RunSessionReplay(sessionPaths);
+		return;
+	}
+	if (argc > 3 && string(argv[1]) == "--multi")
+	{
+		// Segment every object seeded in a paint image.
+		RunMultiObject(argv[2], argv[3]);
+		return;
+	}
+	if (argc > 2 && string(argv[1]) == "--video")
+	{
+		// Segment a frame sequence and report frame latency and rate.
+		RunVideoBenchmark(argv[2], argc > 3 ? argv[3] : "");
+		return;
+	}
+	if (argc > 2 && string(argv[1]) == "--tiled")
+	{
+		// Replay a session with mapped tiled labels and segmentation.
+		RunTiledSession(argv[2], argc > 3 ? atoi(argv[3]) : 1024);
+		return;
+	}
+	if (argc > 1 && string(argv[1]) == "--bench-sessions")
+	{
+		// Run concurrent sessions on shared models.
+		int threadCount = argc > 2 ? atoi(argv[2]) : getNumberOfCPUs();
+		vector<string> sessionPaths;
+		if (argc > 3)
+			sessionPaths.assign(argv + 3, argv + argc);
+		else
+		{
+			vector<String> paths;
+			glob("sessions/*.session", paths);
+			sessionPaths.assign(paths.begin(), paths.end());
+		}
+		RunConcurrentSessions(sessionPaths, threadCount);
+		return;
+	}
+	if (argc > 1 && string(argv[1]) == "--batch")
+	{
+		// Segment sessions offline with the given decode, super pixel, solve and write thread counts,
+		// optionally followed by the mask format png, rle or poly.
+		BatchOptions options;
+		if (argc > 2)
+		{
+			char separators[3] = { 0, 0, 0 };
+			istringstream counts(argv[2]);
+			counts >> options.DecodeThreads >> separators[0] >> options.SuperpixelThreads >> separators[1] >> options.SolveThreads >> separators[2] >> options.WriteThreads;
+			if (!counts || counts.peek() != EOF || separators[0] != ',' || separators[1] != ',' || separators[2] != ','
+				|| options.DecodeThreads < 1 || options.SuperpixelThreads < 1 || options.SolveThreads < 1 || options.WriteThreads < 1)
+			{
+				cout << "Usage: --batch [decode,superpixel,solve,write] [png|rle|poly] [files]" << endl
+					<< "The thread counts must be positive, e.g. 4,6,4,2." << endl;
+				return;
+			}
+		}
+		int first = 3;
+		if (argc > 3)
+		{
+			string format = argv[3];
+			if (format == "png" || format == "rle" || format == "poly")
+			{
+				options.Format = format == "rle" ? MaskFormat::Rle : format == "poly" ? MaskFormat::Polygons : MaskFormat::Png;
+				first = 4;
+			}
+		}
+		vector<string> sessionPaths;
+		if (argc > first)
+			sessionPaths.assign(argv + first, argv + argc);
+		else
+		{
+			vector<String> paths;
+			glob("sessions/*.session", paths);
+			sessionPaths.assign(paths.begin(), paths.end());
+		}
+		BatchPipeline pipeline(options);
+		int written = pipeline.Run(sessionPaths);
+		cout << written << " of " << sessionPaths.size() << " masks written to " << options.OutputDirectory << endl;
+		pipeline.PrintReport(cout);
+		return;
+	}
+	if (argc > 1 && string(argv[1]) == "--serve")
+	{
+		// Serve lazy snapping sessions on localhost until a shutdown request.
+		SnappingServer server(argc > 2 ? atoi(argv[2]) : 8765);
+		server.Run();
+		return;
+	}
+	if (argc > 1 && string(argv[1]) == "--client")
+	{
+		// Replay sessions concurrently against a running server.
+		if (argc < 4)
+		{
+			cout << "Usage: --client <port> <token> [files]" << endl
+				<< "The token is printed by the server at startup." << endl;
+			return;
+		}
+		int port = atoi(argv[2]);
+		vector<string> sessionPaths;
+		if (argc > 4)
+			sessionPaths.assign(argv + 4, argv + argc);
+		else
+		{
+			vector<String> paths;
+			glob("sessions/*.session", paths);
+			sessionPaths.assign(paths.begin(), paths.end());
+		}
+		RunTestClient(port, argv[3], sessionPaths);
+		return;
+	}
+
+	// Options of the interactive session, in any order.
+	bool useSlic = false;
+	bool captureProblems = false;
+	string recordPath;
+	for (int i = 1; i < argc; i++)
+	{
+		string option = argv[i];
+		if (option == "--slic")
+			useSlic = true;
+		else if (option == "--capture")
+			captureProblems = true;
+		else if (option == "--record" && i + 1 < argc)
+			recordPath = argv[++i];
+		else
+		{
+			cout << "Usage: [--slic] [--capture] [--record file], in any order." << endl
+				<< "Unknown option " << option << endl;
+			return;
+		}
+	}
+
 	Help();
 
-	InterImg = imread("images/ear_2.jpg");
+	InterImg = imread(ImagePath);
 	if (InterImg.type() != CV_8UC3)
 	{
 		cout << "Input image type is not CV_8UC3" << endl;
@@ -39,9 +228,54 @@ void main()
 	PaintMask.create(InterImg.size(), CV_8UC1);
 	PaintMask = Scalar::all(0);
 
-	WatershedProcessor = make_unique<WatershedHelper>(InterImg, 10, 10, 2, 2);
-	WatershedProcessor->Process(true);
-	LazySnappingProcessor = make_unique<LazySnapping>(WatershedProcessor->GetMask(), WatershedProcessor->GetColors(), WatershedProcessor->GetGraph());
+	// Use SLIC super pixels instead of watershed if required.
+	SlicHelper slicHelper(InterImg, 10);
+	// The watershed references its source, so give it the unpainted copy.
+	WatershedProcessor = make_unique<WatershedHelper>(BackUpImg, 10, 10, 2, 2);
+	string configKey = useSlic ? slicHelper.GetConfigKey() : WatershedProcessor->GetConfigKey();
+
+	// Reuse the super pixels of a previous session if the image was opened before.
+	SuperpixelCacheProcessor = make_unique<SuperpixelCache>(CacheDirectory);
+	shared_ptr<const SnappingModel> model;
+	bool cachedModel = SuperpixelCacheProcessor->Load(InterImg, configKey);
+	if (cachedModel)
+	{
+		model = make_shared<SnappingModel>(make_shared<TiledLabelMap>(make_shared<TiledImage>(SuperpixelCacheProcessor->GetMask())), SuperpixelCacheProcessor->GetColors(), SuperpixelCacheProcessor->GetGraph());
+	}
+	else
+	{
+		Mat mask;
+		vector<Vec3b> colors;
+		vector<Connection> graph;
+		if (useSlic)
+		{
+			slicHelper.Process(true);
+			mask = slicHelper.GetMask();
+			colors = slicHelper.GetColors();
+			graph = slicHelper.GetGraph();
+		}
+		else
+		{
+			WatershedProcessor->Process(true);
+			mask = WatershedProcessor->GetMask();
+			colors = WatershedProcessor->GetColors();
+			graph = WatershedProcessor->GetGraph();
+		}
+		if (!SuperpixelCacheProcessor->Store(InterImg, configKey, mask, colors, graph))
+			cout << "Cannot write super pixel cache." << endl;
+		model = make_shared<SnappingModel>(make_shared<TiledLabelMap>(make_shared<TiledImage>(mask)), colors, graph);
+	}
+	LazySnappingProcessor = make_unique<LazySnapping>(model);
+
+	// Copying every problem costs memory and time, so only keep them when they may be exported.
+	LazySnappingProcessor->SetProblemCapture(captureProblems);
+	ContourProcessor = make_unique<ContourOverlay>(LazySnappingProcessor->GetLabelMap(), static_cast<int>(LazySnappingProcessor->GetNodeLabels().size()));
+	History = make_unique<SessionHistory>(InterImg.size(), static_cast<int>(LazySnappingProcessor->GetNodeLabels().size()));
+	InterImg.copyTo(ResImg);
+
+	// Record the session for replay if required.
+	if (!recordPath.empty() && !Recorder.Open(recordPath, ImagePath))
+		cout << "Cannot write session file " << recordPath << endl;
 
 	imshow(WindowName, InterImg);
 	setMouseCallback(WindowName, onMouse, nullptr);
@@ -58,8 +292,14 @@ void main()
 		else if (c == 'r')
 		{
 			BackUpImg.copyTo(InterImg);
+			BackUpImg.copyTo(ResImg);
+			ContourProcessor->Reset();
+			History->Clear();
+			Recorder.RecordReset();
+			LazySnappingProcessor->ResetRoi();
 			PaintMask = Scalar::all(0);
 			CurrentMode = 0;
+			ParametricSolved = false;
 			imshow(WindowName, InterImg);
 		}
 		else if (c == 'b')
@@ -77,6 +317,7 @@ void main()
 			int temp = 64;
 			cout << "Input Kmeans number: ";
 			cin >> temp;
+			Recorder.RecordClusterNum(temp);
 			LazySnappingProcessor->SetClusterNum(temp);
 			Process();
 		}
@@ -85,9 +326,125 @@ void main()
 			float temp = 100;
 			cout << "E2 weight: ";
 			cin >> temp;
-			LazySnappingProcessor->SetE2Weight(temp);
+			Recorder.RecordE2Weight(temp);
+			// Reuse the parametric result when the weight is inside its range.
+			if (ParametricSolved && LazySnappingProcessor->SelectE2Weight(temp))
+			{
+				ShowResult();
+			}
+			else
+			{
+				LazySnappingProcessor->SetE2Weight(temp);
+				Process();
+			}
+		}
+		else if(c == 'd')
+		{
+			double temp = 0;
+			cout << "Solve deadline in ms (0 to disable): ";
+			cin >> temp;
+			Recorder.RecordDeadline(temp);
+			LazySnappingProcessor->SetSolveDeadline(temp);
+		}
+		else if(c == 'c')
+		{
+			// Continue an incomplete solve.
+			if (!LazySnappingProcessor->IsSolveComplete())
+			{
+				Recorder.RecordResume();
+				LazySnappingProcessor->ResumeSolve(true);
+				ShowResult();
+			}
+		}
+		else if(c == 'o')
+		{
+			// Toggle solving only around new strokes.
+			RoiMode = !RoiMode;
+			Recorder.RecordRoiMode(RoiMode);
+			LazySnappingProcessor->SetRoiMode(RoiMode);
+			cout << "ROI mode " << (RoiMode ? "on" : "off") << endl;
+		}
+		else if(c == 'p')
+		{
+			float minWeight = 10, maxWeight = 10000;
+			cout << "Parametric e2 weight range (min max): ";
+			cin >> minWeight >> maxWeight;
+			Recorder.RecordParametric(minWeight, maxWeight);
+			ParametricSolved = LazySnappingProcessor->ProcessParametric(PaintMask, minWeight, maxWeight, 32, true);
+			if (ParametricSolved)
+				ShowResult();
+		}
+		else if(c == 'z')
+		{
+			// Undo.
+			if (History->Undo(PaintMask, *LazySnappingProcessor))
+			{
+				Recorder.RecordUndo();
+				RestorePaint();
+				ShowResult(false);
+			}
+		}
+		else if(c == 'y')
+		{
+			// Redo.
+			if (History->Redo(PaintMask, *LazySnappingProcessor))
+			{
+				Recorder.RecordRedo();
+				RestorePaint();
+				ShowResult(false);
+			}
+		}
+		else if(c == 'l')
+		{
+			int temp = 0;
+			cout << "E1 lookup bits (0 to disable): ";
+			cin >> temp;
+			Recorder.RecordLookupBits(temp);
+			LazySnappingProcessor->SetE1LookupBits(temp);
 			Process();
 		}
+		else if(c == 'm')
+		{
+			// Report the super pixel backend that produced the model.
+			MemoryReport report;
+			if (cachedModel)
+				SuperpixelCacheProcessor->GetMemoryReport(report);
+			else if (useSlic)
+				slicHelper.GetMemoryReport(report);
+			else
+				WatershedProcessor->GetMemoryReport(report);
+			LazySnappingProcessor->GetMemoryReport(report);
+			report.Print(cout);
+
+			double temp = 0;
+			cout << "Memory budget of lazy snapping in MB (0 to disable): ";
+			cin >> temp;
+			LazySnappingProcessor->SetMemoryBudget(static_cast<size_t>(temp * (1 << 20)));
+		}
+		else if(c == 'w')
+		{
+			// Write the segmentation as run lengths and polygons, streamed from the labels.
+			shared_ptr<const LabelMap> labels = LazySnappingProcessor->GetLabelMap();
+			const vector<uchar>& nodeLabels = LazySnappingProcessor->GetNodeLabels();
+			if (WriteMaskRle("mask.rle.json", *labels, nodeLabels) && WriteMaskPolygons("mask.poly.json", *labels, nodeLabels))
+				cout << "Wrote mask.rle.json and mask.poly.json" << endl;
+			else
+				cout << "Cannot write mask files" << endl;
+		}
+		else if(c == 'x')
+		{
+			// Export the last min cut problem.
+			if (!captureProblems)
+			{
+				cout << "Start with --capture to export problems." << endl;
+				continue;
+			}
+			const CutProblem& problem = LazySnappingProcessor->GetLastProblem();
+			if (SaveProblem("problem.max", problem) && SaveProblem("problem.cut", problem))
+				cout << "Exported " << problem.NodeCount << " nodes and " << problem.Edges.size() << " edges to problem.max and problem.cut" << endl;
+			else
+				cout << "Cannot write problem files" << endl;
+		}
 	}
 }
 
@@ -98,6 +455,14 @@ void Help()
 		<< "Press 'r' to reset image." << endl
 		<< "Press 'k' to set kmeans cluster number." << endl
 		<< "Press 'e' to set e2 weight." << endl
+		<< "Press 'l' to set e1 lookup table bits." << endl
+		<< "Press 'd' to set solve deadline, then 'c' continues an incomplete solve." << endl
+		<< "Press 'o' to toggle solving only around new strokes." << endl
+		<< "Press 'z' to undo and 'y' to redo." << endl
+		<< "Press 'p' to solve a range of e2 weights, then 'e' selects within it." << endl
+		<< "Press 'w' to write the mask as run lengths and polygons." << endl
+		<< "Press 'x' to export the last min cut problem, if started with --capture." << endl
+		<< "Press 'm' to show memory usage and set a memory budget." << endl
 		<< "--------------------------------------------------" << endl
 		<< endl;
 }
@@ -105,32 +470,62 @@ void Help()
 void Process()
 {
 	// Process Lazy Snapping.
+	ParametricSolved = false;
 	if (!LazySnappingProcessor->Process(PaintMask, true))
 		return;
-	Mat segmentation = LazySnappingProcessor->GetSegmentation();
+	ShowResult();
+}
 
-	vector<vector<Point>> contours;
-	vector<Vec4i> hierarchy;
-	findContours(segmentation, contours, hierarchy, CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE);
+void ShowResult(bool record /* = true */)
+{
+	if (record)
+		History->Commit(PaintMask, *LazySnappingProcessor);
+	if (!LazySnappingProcessor->IsSolveComplete())
+		cout << "Solve deadline expired, flow gap: " << LazySnappingProcessor->GetFlowGap() << endl;
 
-	//FindConnectedComponents(segmentation, contours, true, 4);
-	InterImg.copyTo(ResImg);
-	drawContours(ResImg, contours, -1, Scalar(0, 255, 0));
+	// Only the contours of changed super pixels are redrawn, ResImg keeps the strokes and the previous contours.
+	ContourProcessor->Update(LazySnappingProcessor->GetNodeLabels(), InterImg, ResImg);
 	imshow(WindowName, ResImg);
 }
 
+/// <summary>
+/// Redraw the strokes at the paint pixels changed by undo or redo.
+/// Contour pixels of the result image keep the contour, which the following update moves if needed.
+/// </summary>
+void RestorePaint()
+{
+	for each(auto& index in History->GetRestoredPixels())
+	{
+		int row = index / PaintMask.cols;
+		int col = index % PaintMask.cols;
+		uchar value = PaintMask.at<uchar>(row, col);
+		Vec3b color = BackUpImg.at<Vec3b>(row, col);
+		if (value > 0)
+			color = Vec3b(static_cast<uchar>(PaintColor[value - 1][0]), static_cast<uchar>(PaintColor[value - 1][1]), static_cast<uchar>(PaintColor[value - 1][2]));
+		InterImg.at<Vec3b>(row, col) = color;
+		if (!ContourProcessor->IsDrawn(Point(col, row)))
+			ResImg.at<Vec3b>(row, col) = color;
+	}
+}
+
 void onMouse(int event, int x, int y, int flags, void*)
 {
 	if (event == CV_EVENT_LBUTTONDOWN)
 	{
 		OldPt = Point(x, y);
 		IsPressed = true;
+		Recorder.BeginStroke(CurrentMode, OldPt);
 	}
 	else if (event == CV_EVENT_MOUSEMOVE && flags & CV_EVENT_FLAG_LBUTTON)
 	{
 		Point pt(x, y);
 		line(InterImg, OldPt, pt, PaintColor[CurrentMode], 2);
+		line(ResImg, OldPt, pt, PaintColor[CurrentMode], 2);
 		line(PaintMask, OldPt, pt, Scalar(CurrentMode + 1), 2);
+		// Report the changed paint around the 2 pixel thick line.
+		Rect segment(OldPt, pt);
+		LazySnappingProcessor->AddPaintRegion(Rect(segment.tl() - Point(2, 2), segment.br() + Point(3, 3)));
+		Recorder.AddPoint(pt);
 		OldPt = pt;
 		imshow(WindowName, InterImg);
 	}
@@ -140,51 +535,7 @@ void onMouse(int event, int x, int y, int flags, void*)
 			return;
 		IsPressed = false;
 
+		Recorder.EndStroke();
 		Process();
 	}
 }
-
-/// <summary>
-/// Find the connected components in a binary mask image.
-/// </summary>
-/// <param name="mask">The mask image.</param>
-/// <param name="contours">The output contours.</param>
-/// <param name="poly1_hull0">Set to true to use polygon approximation. Set false to use convex hull approximation.</param>
-/// <param name="perimScale">The perimeter scale.</param>
-void FindConnectedComponents(
-	const Mat& mask,
-	vector<vector<Point>>& contours,
-	bool poly1_hull0,
-	float perimScale)
-{
-	// Clean up raw mask.
-	morphologyEx(mask, mask, MORPH_OPEN, NULL, Point(-1, -1), 1);
-	morphologyEx(mask, mask, MORPH_CLOSE, NULL, Point(-1, -1), 1);
-
-	// Find contours around only big regions.
-	vector<vector<Point>> orgContours;
-	vector<Vec4i> hierarchy;
-
-	contours.clear();
-	findContours(mask, orgContours, hierarchy, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-	for each(auto& contour in orgContours)
-	{
-		double len = arcLength(contour, true);
-		// Calculate perimeter len threshold
-		double q = (mask.rows + mask.cols) / perimScale;
-
-		// Get rid of blob if its perimeter is too small.
-		if (len < q)
-			continue;
-
-		// Smooth its edge if it is large enough.
-		vector<Point> res;
-		if (poly1_hull0)
-			// Polygonal approximation.
-			approxPolyDP(contour, res, 2.0, true);
-		else
-			// Convex hull of the segmentation.
-			convexHull(contour, res, true);
-		contours.push_back(res);
-	}
-}
\ No newline at end of file